@@ -0,0 +1,696 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <airspy.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "file_writer.h"
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
+/*
+ * Offline conversion of a raw AIRSPY_SAMPLE_UINT16_REAL capture (airspy_rx -r -t 4) on several cores.
+ * The mapped input is cut in chunks converted in parallel, each by its own converter. A converter
+ * first runs on WARMUP_SAMPLES raw samples preceding its chunk, whose output is dropped, so the
+ * filters of every chunk start from the state of a sequential conversion.
+ */
+
+#define RAW_BUFFER_SAMPLES (131072) /* Raw samples in one USB transfer */
+#define DEFAULT_CHUNK_BUFFERS (32)
+#define CHUNK_BUFFERS_MAX (1024)
+#define WARMUP_SAMPLES (8192) /* Far longer than the filters memory */
+#define MAX_THREADS (64)
+#define JOBS_PER_THREAD (2)
+
+#define BENCH_SAMPLES (8 * RAW_BUFFER_SAMPLES) /* Raw samples per timed round */
+#define BENCH_SECONDS (0.5) /* Minimum CPU time per measure */
+#define BENCH_DFT_LEN (65536) /* Output samples of the rejection measure */
+#define BENCH_TONE_AMPLITUDE (1500.0) /* ADC counts */
+#define BENCH_TONES (10) /* Tones of a rejection measure */
+
+#define FD_BUFFER_SIZE (1024*1024)
+
+#define JOB_FREE (0)
+#define JOB_QUEUED (1)
+#define JOB_DONE (2)
+
+typedef struct
+{
+	uint64_t first; /* First raw sample of the chunk */
+	uint32_t count; /* Raw samples, multiple of 4 */
+	uint8_t* output;
+	uint32_t output_size;
+	int error;
+	volatile int state;
+} convert_job_t;
+
+typedef struct
+{
+	enum airspy_sample_type sample_type;
+	enum airspy_converter_profile profile;
+	const uint16_t* input;
+	convert_job_t jobs[MAX_THREADS * JOBS_PER_THREAD];
+	uint32_t job_count;
+	uint64_t submitted;
+	uint64_t taken;
+	pthread_mutex_t mp;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	bool stop;
+} convert_ctx_t;
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: airspy_convert -i <file> -t <sample_type> [-o <file>] [-q profile] [-j threads] [-c chunk] [-v]\n");
+	fprintf(stderr, "       airspy_convert -b\n");
+	fprintf(stderr, "Convert a raw capture (airspy_rx -r -t 4) to another sample type using all CPU cores\n");
+	fprintf(stderr, "-i <file>: Raw UINT16_REAL input file\n");
+	fprintf(stderr, "-t <sample_type>: 0=FLOAT32_IQ, 1=FLOAT32_REAL, 2=INT16_IQ, 3=INT16_REAL, 4=U16_REAL, 5=INT12_PACKED_IQ, 6=INT8_BFP_IQ\n");
+	fprintf(stderr, "[-o <file>]: Output file (default stdout)\n");
+	fprintf(stderr, "[-q profile]: Converter filter, 0=FAST (15 taps), 1=LIGHT (31), 2=DEFAULT (47), 3=SHARP (95)\n");
+	fprintf(stderr, "[-j threads]: Worker threads (default number of CPUs, max %d)\n", MAX_THREADS);
+	fprintf(stderr, "[-c chunk]: Chunk size in USB transfers of %d samples (default %d, max %d)\n",
+		RAW_BUFFER_SAMPLES, DEFAULT_CHUNK_BUFFERS, CHUNK_BUFFERS_MAX);
+	fprintf(stderr, "[-v]: Print the conversion speed\n");
+	fprintf(stderr, "-b: Print the CPU cost and image rejection of each converter profile\n");
+}
+
+static int parse_u32(const char* s, uint32_t* value)
+{
+	char* end;
+	unsigned long v;
+
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno != 0 || end == s || *end != '\0' || v > 0xFFFFFFFFul)
+		return -1;
+	*value = (uint32_t) v;
+	return 0;
+}
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0) ? (int) n : 1;
+#endif
+}
+
+static double now_seconds(void)
+{
+#ifdef _WIN32
+	return GetTickCount() / 1000.0;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+/* Output bytes for sample_count converted samples */
+static uint32_t output_bytes(enum airspy_sample_type sample_type, uint32_t sample_count)
+{
+	switch (sample_type)
+	{
+		case AIRSPY_SAMPLE_FLOAT32_IQ:
+			return sample_count * 8;
+
+		case AIRSPY_SAMPLE_FLOAT32_REAL:
+		case AIRSPY_SAMPLE_INT16_IQ:
+			return sample_count * 4;
+
+		case AIRSPY_SAMPLE_INT12_PACKED_IQ:
+			return sample_count * 3;
+
+		case AIRSPY_SAMPLE_INT8_BFP_IQ:
+			return sample_count * 2 + (sample_count + AIRSPY_INT8_BFP_BLOCK_LEN - 1) / AIRSPY_INT8_BFP_BLOCK_LEN;
+
+		default:
+			return sample_count * 2;
+	}
+}
+
+/* Read only mapping of a whole file */
+static const void* map_file(const char* path, uint64_t* size)
+{
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	LARGE_INTEGER file_size;
+	const void* data = NULL;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+	*size = (data != NULL) ? (uint64_t) file_size.QuadPart : 0;
+	return data;
+#else
+	struct stat st;
+	void* data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+	madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+	*size = (uint64_t) st.st_size;
+	return data;
+#endif
+}
+
+static void unmap_file(const void* data, uint64_t size)
+{
+#ifdef _WIN32
+	(void) size;
+	UnmapViewOfFile(data);
+#else
+	munmap((void*) data, (size_t) size);
+#endif
+}
+
+static int convert_chunk(convert_ctx_t* ctx, convert_job_t* job, void* warmup_output)
+{
+	struct airspy_converter* converter;
+	uint32_t warmup;
+	int result;
+
+	converter = airspy_converter_create(ctx->sample_type);
+	if (converter == NULL)
+		return -1;
+	if (airspy_converter_set_profile(converter, ctx->profile) != AIRSPY_SUCCESS)
+	{
+		airspy_converter_free(converter);
+		return -1;
+	}
+
+	warmup = (job->first < WARMUP_SAMPLES) ? (uint32_t) job->first : WARMUP_SAMPLES;
+	result = airspy_converter_process(converter, ctx->input + job->first - warmup, warmup, warmup_output);
+	if (result >= 0)
+		result = airspy_converter_process(converter, ctx->input + job->first, job->count, job->output);
+	if (result >= 0)
+		job->output_size = output_bytes(ctx->sample_type, result);
+
+	airspy_converter_free(converter);
+	return (result >= 0) ? 0 : -1;
+}
+
+static void* convert_threadproc(void* arg)
+{
+	convert_ctx_t* ctx = (convert_ctx_t*) arg;
+	convert_job_t* job;
+	void* warmup_output;
+
+	warmup_output = malloc(WARMUP_SAMPLES * sizeof(float));
+
+	pthread_mutex_lock(&ctx->mp);
+	while (true)
+	{
+		while (ctx->taken == ctx->submitted && !ctx->stop)
+		{
+			pthread_cond_wait(&ctx->work_cv, &ctx->mp);
+		}
+		if (ctx->taken == ctx->submitted)
+		{
+			break;
+		}
+		job = &ctx->jobs[ctx->taken % ctx->job_count];
+		ctx->taken++;
+		pthread_mutex_unlock(&ctx->mp);
+
+		job->error = (warmup_output != NULL) ? convert_chunk(ctx, job, warmup_output) : -1;
+
+		pthread_mutex_lock(&ctx->mp);
+		job->state = JOB_DONE;
+		pthread_cond_broadcast(&ctx->done_cv);
+	}
+	pthread_mutex_unlock(&ctx->mp);
+
+	free(warmup_output);
+	return NULL;
+}
+
+/* Raw samples of a tone at frequency cycles per sample, with 1 LSB of dither */
+static void bench_tone(uint16_t* raw, uint32_t count, double frequency)
+{
+	uint32_t seed = 1;
+	uint32_t i;
+	double x;
+
+	for (i = 0; i < count; i++)
+	{
+		seed = seed * 1103515245u + 12345u;
+		x = 2048.0 + BENCH_TONE_AMPLITUDE * cos(2.0 * M_PI * frequency * i) + (seed >> 16) / 65536.0 - 0.5;
+		raw[i] = (uint16_t) floor(x + 0.5);
+	}
+}
+
+/* Power in dB of bin k of the DFT of count IQ samples */
+static double bench_bin_power(enum airspy_sample_type sample_type, const void* samples, uint32_t count, int32_t k)
+{
+	const float* f = (const float*) samples;
+	const int16_t* s = (const int16_t*) samples;
+	double re = 0.0;
+	double im = 0.0;
+	double i_value;
+	double q_value;
+	double phase;
+	uint32_t n;
+
+	for (n = 0; n < count; n++)
+	{
+		if (sample_type == AIRSPY_SAMPLE_FLOAT32_IQ)
+		{
+			i_value = f[2 * n];
+			q_value = f[2 * n + 1];
+		}
+		else
+		{
+			i_value = s[2 * n];
+			q_value = s[2 * n + 1];
+		}
+		phase = -2.0 * M_PI * (double) k * n / count;
+		re += i_value * cos(phase) - q_value * sin(phase);
+		im += i_value * sin(phase) + q_value * cos(phase);
+	}
+
+	return 10.0 * log10(re * re + im * im + 1e-30);
+}
+
+/*
+ * Image rejection at position (fraction of the one sided output band): a tone that lands at
+ * +/-position is converted, the rejection is the ratio of the tone to its mirror.
+ */
+static double bench_tone_rejection(enum airspy_sample_type sample_type, enum airspy_converter_profile profile,
+	uint16_t* raw, void* output, double position)
+{
+	struct airspy_converter* converter;
+	uint32_t raw_count = WARMUP_SAMPLES + 2 * BENCH_DFT_LEN;
+	int32_t k;
+	double a;
+	double b;
+	int result;
+
+	/* Odd bin, the tone harmonics do not fall on its mirror */
+	k = ((int32_t) (position * BENCH_DFT_LEN / 2)) | 1;
+	bench_tone(raw, raw_count, 0.25 + (double) k / BENCH_DFT_LEN / 2);
+
+	converter = airspy_converter_create(sample_type);
+	if (converter == NULL)
+		return 0.0;
+	airspy_converter_set_profile(converter, profile);
+	result = airspy_converter_process(converter, raw, WARMUP_SAMPLES, output);
+	if (result >= 0)
+		result = airspy_converter_process(converter, raw + WARMUP_SAMPLES, 2 * BENCH_DFT_LEN, output);
+	airspy_converter_free(converter);
+	if (result != BENCH_DFT_LEN)
+		return 0.0;
+
+	a = bench_bin_power(sample_type, output, BENCH_DFT_LEN, k);
+	b = bench_bin_power(sample_type, output, BENCH_DFT_LEN, -k);
+	return fabs(a - b);
+}
+
+/* Worst image rejection of BENCH_TONES tones spread up to position */
+static double bench_rejection(enum airspy_sample_type sample_type, enum airspy_converter_profile profile,
+	uint16_t* raw, void* output, double position)
+{
+	double worst = 1000.0;
+	double rejection;
+	int i;
+
+	for (i = 1; i <= BENCH_TONES; i++)
+	{
+		rejection = bench_tone_rejection(sample_type, profile, raw, output, position * i / BENCH_TONES);
+		if (rejection < worst)
+			worst = rejection;
+	}
+
+	return worst;
+}
+
+/* CPU time per raw sample in ns */
+static double bench_cost(enum airspy_sample_type sample_type, enum airspy_converter_profile profile,
+	const uint16_t* raw, void* output)
+{
+	struct airspy_converter* converter;
+	clock_t start;
+	clock_t elapsed;
+	uint64_t samples = 0;
+
+	converter = airspy_converter_create(sample_type);
+	if (converter == NULL)
+		return 0.0;
+	airspy_converter_set_profile(converter, profile);
+
+	start = clock();
+	do
+	{
+		airspy_converter_process(converter, raw, BENCH_SAMPLES, output);
+		samples += BENCH_SAMPLES;
+		elapsed = clock() - start;
+	} while (elapsed < BENCH_SECONDS * CLOCKS_PER_SEC);
+
+	airspy_converter_free(converter);
+	return (double) elapsed / CLOCKS_PER_SEC * 1e9 / samples;
+}
+
+static int benchmark(void)
+{
+	static const char* const profile_names[AIRSPY_CONVERTER_END] = { "FAST", "LIGHT", "DEFAULT", "SHARP" };
+	static const int profile_taps[AIRSPY_CONVERTER_END] = { 15, 31, 47, 95 };
+	static const enum airspy_sample_type types[2] = { AIRSPY_SAMPLE_FLOAT32_IQ, AIRSPY_SAMPLE_INT16_IQ };
+	uint16_t* raw;
+	void* output;
+	double cost;
+	int profile;
+	int t;
+
+	raw = (uint16_t*) malloc(BENCH_SAMPLES * sizeof(uint16_t));
+	output = malloc(BENCH_SAMPLES * sizeof(float));
+	if (raw == NULL || output == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		free(raw);
+		free(output);
+		return EXIT_FAILURE;
+	}
+
+	printf("Profile  Taps  Type        ns/sample  MSPS/core  Worst rejection to 50%%  75%%  90%% of the band\n");
+	for (profile = 0; profile < AIRSPY_CONVERTER_END; profile++)
+	{
+		for (t = 0; t < 2; t++)
+		{
+			bench_tone(raw, BENCH_SAMPLES, 0.3);
+			cost = bench_cost(types[t], (enum airspy_converter_profile) profile, raw, output);
+			printf("%-7s  %4d  %-10s  %9.2f  %9.1f  %20.1f dB  %4.1f  %4.1f\n",
+				profile_names[profile], profile_taps[profile],
+				(types[t] == AIRSPY_SAMPLE_FLOAT32_IQ) ? "FLOAT32_IQ" : "INT16_IQ",
+				cost, (cost > 0) ? 1000.0 / cost : 0.0,
+				bench_rejection(types[t], (enum airspy_converter_profile) profile, raw, output, 0.5),
+				bench_rejection(types[t], (enum airspy_converter_profile) profile, raw, output, 0.75),
+				bench_rejection(types[t], (enum airspy_converter_profile) profile, raw, output, 0.9));
+			fflush(stdout);
+		}
+	}
+
+	free(raw);
+	free(output);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path_in = NULL;
+	const char* path_out = NULL;
+	uint32_t sample_type_u32 = AIRSPY_SAMPLE_END;
+	uint32_t threads_u32 = 0;
+	uint32_t chunk_buffers = DEFAULT_CHUNK_BUFFERS;
+	uint32_t profile_u32 = AIRSPY_CONVERTER_DEFAULT;
+	bool verbose = false;
+	convert_ctx_t ctx;
+	convert_job_t* job;
+	pthread_t threads[MAX_THREADS];
+	int thread_count = 0;
+	file_writer_t* writer;
+	const void* input;
+	uint64_t input_size;
+	uint64_t total_samples;
+	uint64_t next_sample;
+	uint64_t written;
+	uint32_t chunk_samples;
+	double start_time;
+	double elapsed;
+	int exit_code = EXIT_SUCCESS;
+	uint32_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:o:t:q:j:c:vb")) != EOF)
+	{
+		switch (opt)
+		{
+		case 'i':
+			path_in = optarg;
+			break;
+
+		case 'o':
+			path_out = optarg;
+			break;
+
+		case 't':
+			if (parse_u32(optarg, &sample_type_u32) != 0 || sample_type_u32 >= AIRSPY_SAMPLE_END)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'q':
+			if (parse_u32(optarg, &profile_u32) != 0 || profile_u32 >= AIRSPY_CONVERTER_END)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'b':
+			return benchmark();
+
+		case 'j':
+			if (parse_u32(optarg, &threads_u32) != 0 || threads_u32 < 1 || threads_u32 > MAX_THREADS)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'c':
+			if (parse_u32(optarg, &chunk_buffers) != 0 || chunk_buffers < 1 || chunk_buffers > CHUNK_BUFFERS_MAX)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'v':
+			verbose = true;
+			break;
+
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (path_in == NULL || sample_type_u32 == AIRSPY_SAMPLE_END)
+	{
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if (threads_u32 == 0)
+	{
+		threads_u32 = cpu_count();
+		if (threads_u32 > MAX_THREADS)
+			threads_u32 = MAX_THREADS;
+	}
+
+	input = map_file(path_in, &input_size);
+	if (input == NULL)
+	{
+		fprintf(stderr, "Failed to map file: %s (%s)\n", path_in, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	/* The converters work on groups of 4 samples, a trailing partial group is dropped */
+	total_samples = (input_size / sizeof(uint16_t)) & ~(uint64_t) 3;
+
+	if (path_out != NULL)
+		writer = file_writer_open(path_out, FILE_WRITER_STDIO, FD_BUFFER_SIZE, 0);
+	else
+		writer = file_writer_open_stream(stdout, FD_BUFFER_SIZE);
+	if (writer == NULL)
+	{
+		fprintf(stderr, "Failed to open file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+		unmap_file(input, input_size);
+		return EXIT_FAILURE;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.sample_type = (enum airspy_sample_type) sample_type_u32;
+	ctx.profile = (enum airspy_converter_profile) profile_u32;
+	ctx.input = (const uint16_t*) input;
+	ctx.job_count = threads_u32 * JOBS_PER_THREAD;
+	pthread_mutex_init(&ctx.mp, NULL);
+	pthread_cond_init(&ctx.work_cv, NULL);
+	pthread_cond_init(&ctx.done_cv, NULL);
+
+	/* Whole USB transfers per chunk, the INT8_BFP_IQ blocks fall where airspy_rx would put them */
+	chunk_samples = chunk_buffers * RAW_BUFFER_SAMPLES;
+	for (i = 0; i < ctx.job_count; i++)
+	{
+		ctx.jobs[i].output = (uint8_t*) malloc((size_t) chunk_samples * sizeof(float));
+		if (ctx.jobs[i].output == NULL)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit_code = EXIT_FAILURE;
+			goto done;
+		}
+	}
+
+	for (thread_count = 0; thread_count < (int) threads_u32; thread_count++)
+	{
+		if (pthread_create(&threads[thread_count], NULL, convert_threadproc, &ctx) != 0)
+		{
+			fprintf(stderr, "Failed to create thread\n");
+			exit_code = EXIT_FAILURE;
+			goto done;
+		}
+	}
+
+	start_time = now_seconds();
+	next_sample = 0;
+	written = 0;
+	while (written < ctx.submitted || next_sample < total_samples)
+	{
+		/* Queue chunks while a job is free */
+		while (next_sample < total_samples && ctx.submitted - written < ctx.job_count)
+		{
+			job = &ctx.jobs[ctx.submitted % ctx.job_count];
+			job->first = next_sample;
+			job->count = (total_samples - next_sample < chunk_samples) ? (uint32_t)(total_samples - next_sample) : chunk_samples;
+			next_sample += job->count;
+
+			pthread_mutex_lock(&ctx.mp);
+			job->state = JOB_QUEUED;
+			ctx.submitted++;
+			pthread_cond_signal(&ctx.work_cv);
+			pthread_mutex_unlock(&ctx.mp);
+		}
+
+		/* Write the oldest chunk once converted */
+		job = &ctx.jobs[written % ctx.job_count];
+		pthread_mutex_lock(&ctx.mp);
+		while (job->state != JOB_DONE)
+		{
+			pthread_cond_wait(&ctx.done_cv, &ctx.mp);
+		}
+		pthread_mutex_unlock(&ctx.mp);
+
+		if (job->error != 0)
+		{
+			fprintf(stderr, "Conversion failed\n");
+			exit_code = EXIT_FAILURE;
+			break;
+		}
+		if (file_writer_write(writer, job->output, job->output_size) != (int) job->output_size)
+		{
+			fprintf(stderr, "Failed to write file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+			exit_code = EXIT_FAILURE;
+			break;
+		}
+		job->state = JOB_FREE;
+		written++;
+	}
+
+	if (verbose && exit_code == EXIT_SUCCESS)
+	{
+		elapsed = now_seconds() - start_time;
+		fprintf(stderr, "%llu samples converted in %.3f s with %u threads (%.1f MSPS)\n",
+			(unsigned long long) total_samples, elapsed, threads_u32,
+			(elapsed > 0) ? total_samples / elapsed / 1e6 : 0.0);
+	}
+
+done:
+	pthread_mutex_lock(&ctx.mp);
+	ctx.stop = true;
+	ctx.submitted = ctx.taken; /* Drop the chunks not started after an error */
+	pthread_cond_broadcast(&ctx.work_cv);
+	pthread_mutex_unlock(&ctx.mp);
+	while (thread_count > 0)
+	{
+		pthread_join(threads[--thread_count], NULL);
+	}
+
+	if (file_writer_close(writer) != 0 && exit_code == EXIT_SUCCESS)
+	{
+		fprintf(stderr, "Failed to write file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+		exit_code = EXIT_FAILURE;
+	}
+
+	for (i = 0; i < ctx.job_count; i++)
+	{
+		free(ctx.jobs[i].output);
+	}
+	pthread_cond_destroy(&ctx.done_cv);
+	pthread_cond_destroy(&ctx.work_cv);
+	pthread_mutex_destroy(&ctx.mp);
+	unmap_file(input, input_size);
+	return exit_code;
+}
@@ -0,0 +1,830 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include <airspy.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "file_writer.h"
+#include "fm_demod.h"
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#define sleep(a) Sleep( (a*1000) )
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+#else
+#include <unistd.h>
+#endif
+
+/*
+ * FM demodulation of several channels of one AIRSPY_SAMPLE_FLOAT32_IQ stream.
+ * The receive callback copies each block into a ring shared by the worker threads, each worker
+ * demodulates its share of the channels over every block and writes their audio. A block is
+ * reused once all the workers are past it, when the ring is full the callback skips the block
+ * (replaying a file as fast as possible, it waits instead).
+ */
+
+#define DEFAULT_VGA_IF_GAIN (5)
+#define DEFAULT_LNA_GAIN (1)
+#define DEFAULT_MIXER_GAIN (5)
+#define VGA_GAIN_MAX (15)
+#define MIXER_GAIN_MAX (15)
+#define LNA_GAIN_MAX (14)
+
+#define FREQ_ONE_MHZ (1000000.0)
+#define FREQ_HZ_MIN (24000000.0)
+#define FREQ_HZ_MAX (1900000000.0)
+
+#define MAX_CHANNELS (256)
+#define MAX_THREADS (64)
+#define BLOCK_COUNT (16) /* Blocks between the callback and the workers */
+#define BLOCK_SAMPLES (65536) /* IQ samples per block, one transfer */
+
+#define FD_BUFFER_SIZE (64*1024)
+
+#define BENCH_SECONDS (0.5) /* Minimum CPU time per measure */
+#define BENCH_TONE_HZ (1000.0)
+#define BENCH_AUDIO_SAMPLES (10000) /* Audio samples of the SINAD measure, whole periods of the tone */
+#define BENCH_WARMUP (0.05) /* Seconds of signal before the measure */
+
+typedef struct
+{
+	fm_channel_t* demod;
+	uint32_t freq_hz;
+	char path[FILENAME_MAX];
+	file_writer_t* writer;
+	uint64_t audio_samples;
+	bool failed;
+} fm_output_t;
+
+typedef struct fm_worker
+{
+	struct fm_ctx* ctx;
+	int first; /* Channels first, first + worker_count... */
+	pthread_t thread;
+	uint64_t processed; /* Blocks done */
+	int16_t* audio;
+} fm_worker_t;
+
+typedef struct fm_ctx
+{
+	fm_output_t channels[MAX_CHANNELS];
+	int channel_count;
+	fm_worker_t workers[MAX_THREADS];
+	int worker_count;
+	float* blocks[BLOCK_COUNT];
+	uint32_t block_count[BLOCK_COUNT];
+	uint64_t pushed;
+	uint64_t samples; /* IQ samples pushed */
+	uint64_t skipped; /* IQ samples of the blocks skipped */
+	uint64_t dropped; /* IQ samples lost before the callback */
+	uint64_t limit; /* Stop after limit IQ samples, 0 for none */
+	bool lossless;
+	bool stop;
+	pthread_mutex_t mp;
+	pthread_cond_t cv;
+} fm_ctx_t;
+
+static volatile bool do_exit = false;
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: airspy_fm -c <MHz[,MHz...]> [-o prefix] [-f center_MHz] [-M mode] [-w Hz] [-x Hz] [-e us] [-r Hz] [-j threads]\n");
+	fprintf(stderr, "       [-a sample_rate] [-i|-I raw_file] [-l lna_gain] [-m mixer_gain] [-v vga_gain] [-T seconds] [-d]\n");
+	fprintf(stderr, "       airspy_fm -B\n");
+	fprintf(stderr, "Demodulate FM channels to raw 16 bit signed native endian mono PCM, one file per channel\n");
+	fprintf(stderr, "-c <MHz[,MHz...]>: Channel frequencies, up to %d\n", MAX_CHANNELS);
+	fprintf(stderr, "[-o prefix]: Write channel MHz to prefix_<frequency_Hz>.s16 (default stdout, one channel only)\n");
+	fprintf(stderr, "[-f center_MHz]: Tuning frequency (default middle of the channels)\n");
+	fprintf(stderr, "[-M mode]: 0=wide (200kHz, 75kHz deviation, 50us de-emphasis, default), 1=narrow (12.5kHz, 2.5kHz deviation)\n");
+	fprintf(stderr, "[-w Hz]: Channel width (default of the mode)\n");
+	fprintf(stderr, "[-x Hz]: Deviation giving a full scale sample (default of the mode)\n");
+	fprintf(stderr, "[-e us]: De-emphasis time constant, 0 for none (default of the mode)\n");
+	fprintf(stderr, "[-r Hz]: Audio sample rate, shall divide the IQ sample rate (default 50000)\n");
+	fprintf(stderr, "[-j threads]: Demodulation threads (default number of CPUs, max %d)\n", MAX_THREADS);
+	fprintf(stderr, "[-a sample_rate]: 0=10MSPS(default), 1=2.5MSPS\n");
+	fprintf(stderr, "[-i raw_file]: Replay a raw capture (airspy_rx -r -t 4) in real time instead of opening a device\n");
+	fprintf(stderr, "[-I raw_file]: Replay a raw capture as fast as possible, no block is skipped\n");
+	fprintf(stderr, "[-l lna_gain]: LNA gain, 0-%d (default %d)\n", LNA_GAIN_MAX, DEFAULT_LNA_GAIN);
+	fprintf(stderr, "[-m mixer_gain]: Mixer gain, 0-%d (default %d)\n", MIXER_GAIN_MAX, DEFAULT_MIXER_GAIN);
+	fprintf(stderr, "[-v vga_gain]: VGA/IF gain, 0-%d (default %d)\n", VGA_GAIN_MAX, DEFAULT_VGA_IF_GAIN);
+	fprintf(stderr, "[-T seconds]: Stop after seconds of samples (default unlimited)\n");
+	fprintf(stderr, "[-d]: Verbose, print the filter stages and the demodulation speed\n");
+	fprintf(stderr, "-B: Print the CPU cost, channels per core and SINAD of each mode\n");
+}
+
+static int parse_u32(const char* s, uint32_t* value)
+{
+	char* end;
+	unsigned long v;
+
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno != 0 || end == s || *end != '\0' || v > 0xFFFFFFFFul)
+		return -1;
+	*value = (uint32_t) v;
+	return 0;
+}
+
+/* Comma separated MHz values, return the count or -1 */
+static int parse_channels(const char* s, uint32_t* freq_hz, int max)
+{
+	char* end;
+	double mhz;
+	int count = 0;
+
+	while (true)
+	{
+		errno = 0;
+		mhz = strtod(s, &end);
+		if (errno != 0 || end == s || (*end != ',' && *end != '\0') || count == max ||
+			mhz * FREQ_ONE_MHZ < FREQ_HZ_MIN || mhz * FREQ_ONE_MHZ > FREQ_HZ_MAX)
+		{
+			return -1;
+		}
+		freq_hz[count++] = (uint32_t) floor(mhz * FREQ_ONE_MHZ + 0.5);
+		if (*end == '\0')
+			return count;
+		s = end + 1;
+	}
+}
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n > 0) ? (int) n : 1;
+#endif
+}
+
+#ifdef _MSC_VER
+static BOOL WINAPI sighandler(int signum)
+{
+	if (CTRL_C_EVENT == signum) {
+		fprintf(stderr, "Caught signal %d\n", signum);
+		do_exit = true;
+		return TRUE;
+	}
+	return FALSE;
+}
+#else
+static void sigint_callback_handler(int signum)
+{
+	fprintf(stderr, "Caught signal %d\n", signum);
+	do_exit = true;
+}
+#endif
+
+static uint64_t oldest_processed(fm_ctx_t* ctx)
+{
+	uint64_t oldest = ctx->pushed;
+	int i;
+
+	for (i = 0; i < ctx->worker_count; i++)
+	{
+		if (ctx->workers[i].processed < oldest)
+			oldest = ctx->workers[i].processed;
+	}
+	return oldest;
+}
+
+static int rx_callback(airspy_transfer_t* transfer)
+{
+	fm_ctx_t* ctx = (fm_ctx_t*) transfer->ctx;
+	const float* samples = (const float*) transfer->samples;
+	uint32_t remaining = (uint32_t) transfer->sample_count;
+	uint32_t count;
+	int slot;
+
+	ctx->dropped += transfer->dropped_samples;
+	while (remaining > 0)
+	{
+		count = (remaining < BLOCK_SAMPLES) ? remaining : BLOCK_SAMPLES;
+		if (ctx->limit != 0 && ctx->samples + count > ctx->limit)
+			count = (uint32_t) (ctx->limit - ctx->samples);
+		if (count == 0)
+		{
+			do_exit = true;
+			return -1;
+		}
+
+		pthread_mutex_lock(&ctx->mp);
+		while (ctx->lossless && ctx->pushed - oldest_processed(ctx) == BLOCK_COUNT)
+		{
+			pthread_cond_wait(&ctx->cv, &ctx->mp);
+		}
+		if (ctx->pushed - oldest_processed(ctx) == BLOCK_COUNT)
+		{
+			ctx->skipped += count;
+			slot = -1;
+		}
+		else
+		{
+			slot = (int) (ctx->pushed % BLOCK_COUNT);
+		}
+		pthread_mutex_unlock(&ctx->mp);
+
+		/* No worker reads the slot until it is pushed */
+		if (slot >= 0)
+		{
+			memcpy(ctx->blocks[slot], samples, count * 2 * sizeof(float));
+			ctx->block_count[slot] = count;
+			pthread_mutex_lock(&ctx->mp);
+			ctx->pushed++;
+			pthread_cond_broadcast(&ctx->cv);
+			pthread_mutex_unlock(&ctx->mp);
+		}
+
+		ctx->samples += count;
+		samples += 2 * count;
+		remaining -= count;
+	}
+
+	return 0;
+}
+
+static void* worker_threadproc(void* arg)
+{
+	fm_worker_t* worker = (fm_worker_t*) arg;
+	fm_ctx_t* ctx = worker->ctx;
+	fm_output_t* channel;
+	const float* block;
+	uint32_t count;
+	uint32_t n;
+	int slot;
+	int i;
+
+	pthread_mutex_lock(&ctx->mp);
+	while (true)
+	{
+		while (worker->processed == ctx->pushed && !ctx->stop)
+		{
+			pthread_cond_wait(&ctx->cv, &ctx->mp);
+		}
+		if (worker->processed == ctx->pushed)
+		{
+			break;
+		}
+		slot = (int) (worker->processed % BLOCK_COUNT);
+		block = ctx->blocks[slot];
+		count = ctx->block_count[slot];
+		pthread_mutex_unlock(&ctx->mp);
+
+		for (i = worker->first; i < ctx->channel_count; i += ctx->worker_count)
+		{
+			channel = &ctx->channels[i];
+			n = fm_channel_process(channel->demod, block, count, worker->audio);
+			channel->audio_samples += n;
+			if (!channel->failed && file_writer_write(channel->writer, worker->audio, n * sizeof(int16_t)) != (int) (n * sizeof(int16_t)))
+			{
+				fprintf(stderr, "Failed to write file: %s (%s)\n", channel->path, strerror(errno));
+				channel->failed = true;
+			}
+		}
+
+		pthread_mutex_lock(&ctx->mp);
+		worker->processed++;
+		pthread_cond_broadcast(&ctx->cv);
+	}
+	pthread_mutex_unlock(&ctx->mp);
+
+	return NULL;
+}
+
+static void print_stages(fm_channel_t* demod, uint32_t freq_hz)
+{
+	int factors[FM_MAX_STAGES + 1];
+	int taps[FM_MAX_STAGES + 1];
+	uint32_t if_rate;
+	int count;
+	int i;
+
+	count = fm_channel_stages(demod, &if_rate, factors, taps);
+	fprintf(stderr, "%.6f MHz: IF %u Hz, stages (decimation/taps)", freq_hz / FREQ_ONE_MHZ, if_rate);
+	for (i = 0; i < count; i++)
+	{
+		fprintf(stderr, " %d/%d", factors[i], taps[i]);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* count IQ samples of an FM carrier at offset_hz modulated by BENCH_TONE_HZ at half the deviation, with an equal carrier two channels above */
+static void bench_signal(float* iq, uint32_t count, const fm_params_t* params)
+{
+	double phase = 0.0;
+	double w0 = 2.0 * M_PI * params->offset_hz / params->sample_rate;
+	double w1 = 2.0 * M_PI * (params->offset_hz + 2.0 * params->bandwidth) / params->sample_rate;
+	double a;
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		a = w0 * i + phase;
+		iq[2 * i] = (float) (0.1 * cos(a) + 0.1 * cos(w1 * i));
+		iq[2 * i + 1] = (float) (0.1 * sin(a) + 0.1 * sin(w1 * i));
+		phase += 2.0 * M_PI * 0.5 * params->deviation / params->sample_rate * sin(2.0 * M_PI * BENCH_TONE_HZ * i / params->sample_rate);
+	}
+}
+
+/* Ratio of the tone to everything else in the last BENCH_AUDIO_SAMPLES samples, in dB */
+static double bench_sinad(const int16_t* audio, uint32_t rate)
+{
+	double mean = 0.0;
+	double re = 0.0;
+	double im = 0.0;
+	double total = 0.0;
+	double tone;
+	double v;
+	int i;
+
+	for (i = 0; i < BENCH_AUDIO_SAMPLES; i++)
+	{
+		mean += audio[i];
+	}
+	mean /= BENCH_AUDIO_SAMPLES;
+
+	for (i = 0; i < BENCH_AUDIO_SAMPLES; i++)
+	{
+		v = audio[i] - mean;
+		re += v * cos(2.0 * M_PI * BENCH_TONE_HZ * i / rate);
+		im += v * sin(2.0 * M_PI * BENCH_TONE_HZ * i / rate);
+		total += v * v;
+	}
+
+	tone = 2.0 * (re * re + im * im) / BENCH_AUDIO_SAMPLES;
+	return 10.0 * log10(tone / (total - tone + 1e-30));
+}
+
+static int benchmark(void)
+{
+	static const uint32_t rates[2] = { 10000000, 2500000 };
+	static const char* const mode_names[FM_MODE_MAX + 1] = { "wide", "narrow" };
+	fm_params_t params;
+	fm_channel_t* demod;
+	int factors[FM_MAX_STAGES + 1];
+	int taps[FM_MAX_STAGES + 1];
+	uint32_t if_rate;
+	float* iq;
+	int16_t* audio;
+	uint32_t count;
+	uint32_t warmup;
+	uint32_t written;
+	uint32_t n;
+	uint64_t samples;
+	clock_t start;
+	clock_t elapsed;
+	double cost;
+	double sinad;
+	int mode;
+	int r;
+
+	count = (uint32_t) (rates[0] * BENCH_WARMUP) + BENCH_AUDIO_SAMPLES * (rates[0] / 50000);
+	iq = (float*) malloc((size_t) count * 2 * sizeof(float));
+	audio = (int16_t*) malloc((size_t) count * sizeof(int16_t));
+	if (iq == NULL || audio == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		free(iq);
+		free(audio);
+		return EXIT_FAILURE;
+	}
+
+	printf("Mode    MSPS  Offset kHz  IF kHz  ns/sample  Channels/core  SINAD dB\n");
+	for (mode = 0; mode <= FM_MODE_MAX; mode++)
+	{
+		for (r = 0; r < 2; r++)
+		{
+			fm_params_default(&params, mode, rates[r]);
+			params.offset_hz = (int32_t) (rates[r] / 7);
+			demod = fm_channel_open(&params);
+			if (demod == NULL)
+				continue;
+
+			/* Audio quality after the filters settled */
+			warmup = (uint32_t) (rates[r] * BENCH_WARMUP);
+			n = warmup + BENCH_AUDIO_SAMPLES * (rates[r] / params.audio_rate);
+			bench_signal(iq, n, &params);
+			written = fm_channel_process(demod, iq, n, audio);
+			sinad = (written >= BENCH_AUDIO_SAMPLES) ? bench_sinad(audio + written - BENCH_AUDIO_SAMPLES, params.audio_rate) : 0.0;
+
+			samples = 0;
+			start = clock();
+			do
+			{
+				fm_channel_process(demod, iq, BLOCK_SAMPLES, audio);
+				samples += BLOCK_SAMPLES;
+				elapsed = clock() - start;
+			} while (elapsed < BENCH_SECONDS * CLOCKS_PER_SEC);
+			cost = (double) elapsed / CLOCKS_PER_SEC * 1e9 / samples;
+
+			fm_channel_stages(demod, &if_rate, factors, taps);
+			printf("%-6s  %4.1f  %10.1f  %6.1f  %9.2f  %13.1f  %8.1f\n", mode_names[mode], rates[r] / 1e6,
+				params.offset_hz / 1e3, if_rate / 1e3, cost,
+				(cost > 0) ? 1e9 / cost / rates[r] : 0.0, sinad);
+			fflush(stdout);
+			fm_channel_close(demod);
+		}
+	}
+
+	free(iq);
+	free(audio);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t freq_hz[MAX_CHANNELS];
+	const char* prefix = NULL;
+	const char* replay_path = NULL;
+	enum airspy_file_mode replay_mode = AIRSPY_FILE_REALTIME;
+	double center_mhz = 0.0;
+	uint32_t mode = FM_MODE_WIDE;
+	uint32_t bandwidth = 0;
+	uint32_t deviation = 0;
+	uint32_t deemphasis_us = 0;
+	bool deemphasis_set = false;
+	uint32_t audio_rate = 0;
+	uint32_t threads_u32 = 0;
+	uint32_t sample_rate_val = AIRSPY_SAMPLERATE_10MSPS;
+	uint32_t lna_gain = DEFAULT_LNA_GAIN;
+	uint32_t mixer_gain = DEFAULT_MIXER_GAIN;
+	uint32_t vga_gain = DEFAULT_VGA_IF_GAIN;
+	uint32_t seconds = 0;
+	bool verbose = false;
+	bool initialized = false;
+	struct airspy_device* device = NULL;
+	fm_params_t params;
+	fm_output_t* channel;
+	fm_ctx_t* ctx;
+	uint32_t center_hz;
+	uint32_t lowest;
+	uint32_t highest;
+	clock_t cpu_start = 0;
+	double cpu_seconds;
+	char* end;
+	int exit_code = EXIT_SUCCESS;
+	int result;
+	int opt;
+	int i;
+
+	ctx = (fm_ctx_t*) calloc(1, sizeof(fm_ctx_t));
+	if (ctx == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	while ((opt = getopt(argc, argv, "c:o:f:M:w:x:e:r:j:a:i:I:l:m:v:T:dB")) != EOF)
+	{
+		result = 0;
+		switch (opt)
+		{
+		case 'c':
+			ctx->channel_count = parse_channels(optarg, freq_hz, MAX_CHANNELS);
+			result = (ctx->channel_count > 0) ? 0 : -1;
+			break;
+
+		case 'o':
+			prefix = optarg;
+			break;
+
+		case 'f':
+			center_mhz = strtod(optarg, &end);
+			result = (end == optarg || *end != '\0' || center_mhz * FREQ_ONE_MHZ < FREQ_HZ_MIN ||
+				center_mhz * FREQ_ONE_MHZ > FREQ_HZ_MAX) ? -1 : 0;
+			break;
+
+		case 'M':
+			result = (parse_u32(optarg, &mode) != 0 || mode > FM_MODE_MAX) ? -1 : 0;
+			break;
+
+		case 'w':
+			result = (parse_u32(optarg, &bandwidth) != 0 || bandwidth == 0) ? -1 : 0;
+			break;
+
+		case 'x':
+			result = (parse_u32(optarg, &deviation) != 0 || deviation == 0) ? -1 : 0;
+			break;
+
+		case 'e':
+			result = parse_u32(optarg, &deemphasis_us);
+			deemphasis_set = true;
+			break;
+
+		case 'r':
+			result = (parse_u32(optarg, &audio_rate) != 0 || audio_rate == 0) ? -1 : 0;
+			break;
+
+		case 'j':
+			result = (parse_u32(optarg, &threads_u32) != 0 || threads_u32 < 1 || threads_u32 > MAX_THREADS) ? -1 : 0;
+			break;
+
+		case 'a':
+			result = (parse_u32(optarg, &sample_rate_val) != 0 || sample_rate_val > AIRSPY_SAMPLERATE_2_5MSPS) ? -1 : 0;
+			break;
+
+		case 'i':
+		case 'I':
+			replay_path = optarg;
+			replay_mode = (opt == 'I') ? AIRSPY_FILE_FAST : AIRSPY_FILE_REALTIME;
+			break;
+
+		case 'l':
+			result = (parse_u32(optarg, &lna_gain) != 0 || lna_gain > LNA_GAIN_MAX) ? -1 : 0;
+			break;
+
+		case 'm':
+			result = (parse_u32(optarg, &mixer_gain) != 0 || mixer_gain > MIXER_GAIN_MAX) ? -1 : 0;
+			break;
+
+		case 'v':
+			result = (parse_u32(optarg, &vga_gain) != 0 || vga_gain > VGA_GAIN_MAX) ? -1 : 0;
+			break;
+
+		case 'T':
+			result = (parse_u32(optarg, &seconds) != 0 || seconds == 0) ? -1 : 0;
+			break;
+
+		case 'd':
+			verbose = true;
+			break;
+
+		case 'B':
+			free(ctx);
+			return benchmark();
+
+		default:
+			result = -1;
+			break;
+		}
+
+		if (result != 0)
+		{
+			usage();
+			free(ctx);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (ctx->channel_count == 0 || (prefix == NULL && ctx->channel_count > 1))
+	{
+		usage();
+		free(ctx);
+		return EXIT_FAILURE;
+	}
+
+	lowest = highest = freq_hz[0];
+	for (i = 1; i < ctx->channel_count; i++)
+	{
+		if (freq_hz[i] < lowest)
+			lowest = freq_hz[i];
+		if (freq_hz[i] > highest)
+			highest = freq_hz[i];
+	}
+	center_hz = (center_mhz > 0.0) ? (uint32_t) floor(center_mhz * FREQ_ONE_MHZ + 0.5) : lowest + (highest - lowest) / 2;
+
+	/* Demodulators and outputs */
+	for (i = 0; i < ctx->channel_count; i++)
+	{
+		channel = &ctx->channels[i];
+		channel->freq_hz = freq_hz[i];
+		fm_params_default(&params, (int) mode, (sample_rate_val == AIRSPY_SAMPLERATE_2_5MSPS) ? 2500000 : 10000000);
+		params.offset_hz = (int32_t) freq_hz[i] - (int32_t) center_hz;
+		if (bandwidth != 0)
+			params.bandwidth = bandwidth;
+		if (deviation != 0)
+			params.deviation = deviation;
+		if (deemphasis_set)
+			params.deemphasis_us = deemphasis_us;
+		if (audio_rate != 0)
+			params.audio_rate = audio_rate;
+
+		channel->demod = fm_channel_open(&params);
+		if (channel->demod == NULL)
+		{
+			fprintf(stderr, "Channel %.6f MHz does not fit %.6f MHz +/- %.3f MHz, or the audio rate does not divide %u\n",
+				freq_hz[i] / FREQ_ONE_MHZ, center_hz / FREQ_ONE_MHZ, params.sample_rate * 0.45 / FREQ_ONE_MHZ, params.sample_rate);
+			exit_code = EXIT_FAILURE;
+			goto done;
+		}
+		if (verbose)
+			print_stages(channel->demod, freq_hz[i]);
+
+		if (prefix != NULL)
+		{
+			snprintf(channel->path, sizeof(channel->path), "%s_%u.s16", prefix, freq_hz[i]);
+			channel->writer = file_writer_open(channel->path, FILE_WRITER_STDIO, FD_BUFFER_SIZE, 0);
+		}
+		else
+		{
+			strcpy(channel->path, "stdout");
+			channel->writer = file_writer_open_stream(stdout, FD_BUFFER_SIZE);
+		}
+		if (channel->writer == NULL)
+		{
+			fprintf(stderr, "Failed to open file: %s (%s)\n", channel->path, strerror(errno));
+			exit_code = EXIT_FAILURE;
+			goto done;
+		}
+	}
+
+	for (i = 0; i < BLOCK_COUNT; i++)
+	{
+		ctx->blocks[i] = (float*) malloc(BLOCK_SAMPLES * 2 * sizeof(float));
+		if (ctx->blocks[i] == NULL)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit_code = EXIT_FAILURE;
+			goto done;
+		}
+	}
+
+	ctx->limit = (uint64_t) seconds * params.sample_rate;
+	ctx->lossless = (replay_path != NULL && replay_mode == AIRSPY_FILE_FAST);
+	pthread_mutex_init(&ctx->mp, NULL);
+	pthread_cond_init(&ctx->cv, NULL);
+
+	if (threads_u32 == 0)
+		threads_u32 = cpu_count();
+	if (threads_u32 > (uint32_t) ctx->channel_count)
+		threads_u32 = ctx->channel_count;
+	for (ctx->worker_count = 0; ctx->worker_count < (int) threads_u32; ctx->worker_count++)
+	{
+		fm_worker_t* worker = &ctx->workers[ctx->worker_count];
+
+		worker->ctx = ctx;
+		worker->first = ctx->worker_count;
+		worker->audio = (int16_t*) malloc(BLOCK_SAMPLES * sizeof(int16_t));
+		if (worker->audio == NULL || pthread_create(&worker->thread, NULL, worker_threadproc, worker) != 0)
+		{
+			free(worker->audio);
+			fprintf(stderr, "Failed to create thread\n");
+			exit_code = EXIT_FAILURE;
+			goto stop;
+		}
+	}
+
+	result = airspy_init();
+	if (result != AIRSPY_SUCCESS)
+	{
+		fprintf(stderr, "airspy_init() failed: %s (%d)\n", airspy_error_name(result), result);
+		exit_code = EXIT_FAILURE;
+		goto stop;
+	}
+	initialized = true;
+
+	if (replay_path != NULL)
+		result = airspy_open_file(&device, replay_path, replay_mode);
+	else
+		result = airspy_open(&device);
+	if (result != AIRSPY_SUCCESS)
+	{
+		fprintf(stderr, "%s failed: %s (%d)\n", (replay_path != NULL) ? "airspy_open_file()" : "airspy_open()",
+			airspy_error_name(result), result);
+		device = NULL;
+		exit_code = EXIT_FAILURE;
+		goto stop;
+	}
+
+	result = airspy_set_samplerate(device, sample_rate_val);
+	if (result == AIRSPY_SUCCESS)
+		result = airspy_set_sample_type(device, AIRSPY_SAMPLE_FLOAT32_IQ);
+	if (result != AIRSPY_SUCCESS)
+	{
+		fprintf(stderr, "airspy_set_samplerate() failed: %s (%d)\n", airspy_error_name(result), result);
+		exit_code = EXIT_FAILURE;
+		goto stop;
+	}
+
+	airspy_set_vga_gain(device, (uint8_t) vga_gain);
+	airspy_set_mixer_gain(device, (uint8_t) mixer_gain);
+	airspy_set_lna_gain(device, (uint8_t) lna_gain);
+
+#ifdef _MSC_VER
+	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
+#else
+	signal(SIGINT, &sigint_callback_handler);
+	signal(SIGTERM, &sigint_callback_handler);
+#endif
+
+	cpu_start = clock();
+	result = airspy_start_rx(device, rx_callback, ctx);
+	if (result != AIRSPY_SUCCESS)
+	{
+		fprintf(stderr, "airspy_start_rx() failed: %s (%d)\n", airspy_error_name(result), result);
+		exit_code = EXIT_FAILURE;
+		goto stop;
+	}
+
+	result = airspy_set_freq(device, center_hz);
+	if (result != AIRSPY_SUCCESS)
+	{
+		fprintf(stderr, "airspy_set_freq() failed: %s (%d)\n", airspy_error_name(result), result);
+		exit_code = EXIT_FAILURE;
+		goto stop;
+	}
+
+	fprintf(stderr, "%d channel(s) around %.6f MHz, %d thread(s), stop with Ctrl-C\n",
+		ctx->channel_count, center_hz / FREQ_ONE_MHZ, ctx->worker_count);
+	while (airspy_is_streaming(device) == AIRSPY_TRUE && !do_exit)
+	{
+		sleep(1);
+	}
+
+stop:
+	/* The callback may wait for the workers, stop it first, then the workers finish the blocks already pushed */
+	if (device != NULL)
+		airspy_stop_rx(device);
+	pthread_mutex_lock(&ctx->mp);
+	ctx->stop = true;
+	pthread_cond_broadcast(&ctx->cv);
+	pthread_mutex_unlock(&ctx->mp);
+	for (i = 0; i < ctx->worker_count; i++)
+	{
+		pthread_join(ctx->workers[i].thread, NULL);
+		free(ctx->workers[i].audio);
+	}
+
+	if (exit_code == EXIT_SUCCESS && verbose)
+	{
+		cpu_seconds = (double) (clock() - cpu_start) / CLOCKS_PER_SEC;
+		fprintf(stderr, "%.1f s of samples, %.1f s of CPU in all threads (%.2f ns per sample and channel)\n",
+			(double) ctx->samples / params.sample_rate, cpu_seconds,
+			(ctx->samples > 0) ? cpu_seconds * 1e9 / ctx->samples / ctx->channel_count : 0.0);
+	}
+	if (device != NULL)
+		airspy_close(device);
+	if (initialized)
+		airspy_exit();
+
+	if (ctx->skipped > 0)
+		fprintf(stderr, "Samples skipped, demodulation too slow: %llu\n", (unsigned long long) ctx->skipped);
+	if (ctx->dropped > 0)
+		fprintf(stderr, "Samples dropped: %llu\n", (unsigned long long) ctx->dropped);
+
+	pthread_cond_destroy(&ctx->cv);
+	pthread_mutex_destroy(&ctx->mp);
+
+done:
+	for (i = 0; i < ctx->channel_count; i++)
+	{
+		channel = &ctx->channels[i];
+		if (channel->writer != NULL && file_writer_close(channel->writer) != 0 && !channel->failed)
+		{
+			fprintf(stderr, "Failed to write file: %s (%s)\n", channel->path, strerror(errno));
+			channel->failed = true;
+		}
+		if (channel->failed)
+			exit_code = EXIT_FAILURE;
+		fm_channel_close(channel->demod);
+	}
+	for (i = 0; i < BLOCK_COUNT; i++)
+	{
+		free(ctx->blocks[i]);
+	}
+	free(ctx);
+	return exit_code;
+}
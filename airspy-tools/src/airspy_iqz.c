@@ -0,0 +1,270 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include "file_writer.h"
+#include "iqz.h"
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#define strtoull _strtoui64
+#endif
+
+#define FD_BUFFER_SIZE (8*1024)
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: airspy_iqz -i <file.iqz> [-o <file>] [-s start_sample] [-n num_samples] [-d]\n");
+	fprintf(stderr, "Decode a file compressed by airspy_rx -Z to raw samples\n");
+	fprintf(stderr, "-i <file.iqz>: Compressed input file\n");
+	fprintf(stderr, "[-o <file>]: Raw output file (default stdout)\n");
+	fprintf(stderr, "[-s start_sample]: First sample to decode (default 0)\n");
+	fprintf(stderr, "[-n num_samples]: Number of samples to decode (default up to the end)\n");
+	fprintf(stderr, "[-d]: Print the file information\n");
+}
+
+static int parse_u64(const char* s, uint64_t* value)
+{
+	char* end;
+
+	errno = 0;
+	*value = strtoull(s, &end, 10);
+	return (errno != 0 || end == s || *end != '\0') ? -1 : 0;
+}
+
+static int read_at(FILE* f, uint64_t offset, void* data, size_t length)
+{
+	if (fseeko(f, offset, SEEK_SET) != 0)
+		return -1;
+	return (fread(data, 1, length, f) == length) ? 0 : -1;
+}
+
+/* Offset of block number block, from the index or by walking the block headers of an interrupted file */
+static int block_offset(FILE* f, const iqz_file_header_t* header, uint64_t block, uint64_t* offset)
+{
+	uint8_t data[IQZ_BLOCK_HEADER_SIZE];
+	iqz_block_header_t block_header;
+	uint64_t i;
+
+	if (header->index_offset != 0)
+	{
+		if (read_at(f, header->index_offset + block * 8, data, 8) != 0)
+			return -1;
+		*offset = 0;
+		for (i = 0; i < 8; i++)
+			*offset |= (uint64_t) data[i] << (8 * i);
+		return 0;
+	}
+
+	*offset = IQZ_FILE_HEADER_SIZE;
+	for (i = 0; i < block; i++)
+	{
+		if (read_at(f, *offset, data, IQZ_BLOCK_HEADER_SIZE) != 0)
+			return -1;
+		iqz_block_header_unpack(&block_header, data);
+		*offset += IQZ_BLOCK_HEADER_SIZE + block_header.size;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* path_in = NULL;
+	const char* path_out = NULL;
+	uint64_t start_sample = 0;
+	uint64_t num_samples = UINT64_MAX;
+	bool verbose = false;
+	FILE* f;
+	file_writer_t* writer;
+	iqz_file_header_t header;
+	iqz_block_header_t block_header;
+	uint8_t data[IQZ_FILE_HEADER_SIZE];
+	uint8_t* payload;
+	int16_t* values;
+	uint64_t offset;
+	uint64_t skip;
+	uint64_t remaining;
+	uint32_t count;
+	int exit_code = EXIT_SUCCESS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:o:s:n:d")) != EOF)
+	{
+		switch (opt)
+		{
+		case 'i':
+			path_in = optarg;
+			break;
+
+		case 'o':
+			path_out = optarg;
+			break;
+
+		case 's':
+			if (parse_u64(optarg, &start_sample) != 0)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'n':
+			if (parse_u64(optarg, &num_samples) != 0)
+			{
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'd':
+			verbose = true;
+			break;
+
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (path_in == NULL)
+	{
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	f = fopen(path_in, "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "Failed to open file: %s (%s)\n", path_in, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (read_at(f, 0, data, IQZ_FILE_HEADER_SIZE) != 0 || iqz_file_header_unpack(&header, data) != 0)
+	{
+		fprintf(stderr, "Not a valid iqz file: %s\n", path_in);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	if (verbose)
+	{
+		fprintf(stderr, "Sample type: %u, sample rate: %u, channels: %u\n", header.sample_type, header.sample_rate, header.channels);
+		if (header.index_offset != 0)
+			fprintf(stderr, "Samples: %llu\n", (unsigned long long)(header.value_count / header.channels));
+		else
+			fprintf(stderr, "No index, the recording was interrupted\n");
+	}
+
+	if (path_out != NULL)
+		writer = file_writer_open(path_out, FILE_WRITER_STDIO, FD_BUFFER_SIZE, 0);
+	else
+		writer = file_writer_open_stream(stdout, FD_BUFFER_SIZE);
+	if (writer == NULL)
+	{
+		fprintf(stderr, "Failed to open file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	payload = (uint8_t*) malloc(IQZ_BLOCK_MAX_SIZE);
+	values = (int16_t*) malloc(IQZ_BLOCK_VALUES * sizeof(int16_t));
+	if (payload == NULL || values == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit_code = EXIT_FAILURE;
+		goto done;
+	}
+
+	/* Seek to the block holding start_sample, every block but the last one is full */
+	skip = start_sample * header.channels;
+	if (header.index_offset != 0 && skip >= header.value_count)
+	{
+		fprintf(stderr, "start_sample beyond the end of the file\n");
+		exit_code = EXIT_FAILURE;
+		goto done;
+	}
+	if (block_offset(f, &header, skip / header.block_values, &offset) != 0)
+	{
+		fprintf(stderr, "start_sample beyond the end of the file\n");
+		exit_code = EXIT_FAILURE;
+		goto done;
+	}
+	skip %= header.block_values;
+
+	remaining = (num_samples < UINT64_MAX / header.channels) ? num_samples * header.channels : UINT64_MAX;
+	while (remaining > 0)
+	{
+		if (header.index_offset != 0 && offset >= header.index_offset)
+			break;
+		if (read_at(f, offset, data, IQZ_BLOCK_HEADER_SIZE) != 0)
+			break; /* End of an interrupted file */
+		iqz_block_header_unpack(&block_header, data);
+		if (block_header.size > IQZ_BLOCK_MAX_SIZE || block_header.channels != header.channels ||
+			fread(payload, 1, block_header.size, f) != block_header.size ||
+			iqz_decode_block(&block_header, payload, values) != 0)
+		{
+			if (header.index_offset != 0)
+			{
+				fprintf(stderr, "Corrupted block at offset %llu\n", (unsigned long long) offset);
+				exit_code = EXIT_FAILURE;
+			}
+			break;
+		}
+		offset += IQZ_BLOCK_HEADER_SIZE + block_header.size;
+
+		if (skip >= block_header.value_count)
+		{
+			skip -= block_header.value_count;
+			continue;
+		}
+		count = block_header.value_count - (uint32_t) skip;
+		if (count > remaining)
+			count = (uint32_t) remaining;
+		if (file_writer_write(writer, values + skip, count * sizeof(int16_t)) != (int)(count * sizeof(int16_t)))
+		{
+			fprintf(stderr, "Failed to write file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+			exit_code = EXIT_FAILURE;
+			break;
+		}
+		remaining -= count;
+		skip = 0;
+	}
+
+done:
+	if (file_writer_close(writer) != 0 && exit_code == EXIT_SUCCESS)
+	{
+		fprintf(stderr, "Failed to write file: %s (%s)\n", path_out ? path_out : "stdout", strerror(errno));
+		exit_code = EXIT_FAILURE;
+	}
+	free(values);
+	free(payload);
+	fclose(f);
+	return exit_code;
+}
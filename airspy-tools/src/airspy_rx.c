@@ -82,6 +82,13 @@ int gettimeofday(struct timeval *tv, void* ignored)
 #endif
 
 #include <signal.h>
+#include <pthread.h>
+
+#include "file_writer.h"
+#include "ring_recorder.h"
+#include "sigmf_writer.h"
+#include "iqz.h"
+#include "spectrum.h"
 
 #if defined _WIN32
 	#define sleep(a) Sleep( (a*1000) )
@@ -116,6 +123,17 @@ int gettimeofday(struct timeval *tv, void* ignored)
 #define MIXER_GAIN_MAX (15)
 #define LNA_GAIN_MAX (14)
 #define SAMPLES_TO_XFER_MAX_U64 (0x8000000000000000ull) /* Max value */
+#define ROTATE_INDEX_MAX (99999)
+#define RING_SECONDS_MAX (3600)
+#define RING_HEADROOM_SECONDS_MAX (10) /* Recorded beyond the snapshot while it is saved, at most its seconds */
+#define DEFAULT_SPECTRUM_AVERAGES (64)
+#define DEFAULT_SQUELCH_HOLD_MS (200)
+#define DEFAULT_SQUELCH_PREROLL_MS (10)
+#define SQUELCH_PREROLL_MAX_MS (1000)
+#define SQUELCH_HYSTERESIS_DB (3.0f) /* A burst goes on down to this much below the squelch */
+
+#define PATH_FILE_MAX_LEN (FILENAME_MAX)
+#define DATE_TIME_MAX_LEN (32)
 
 /* WAVE or RIFF WAVE file format containing data for AirSpy compatible with SDR# Wav IQ file */
 typedef struct
@@ -125,6 +143,22 @@ typedef struct
 		char riffType[4]; /* 'WAVE'*/
 } t_WAVRIFF_hdr;
 
+/* RF64 (EBU Tech 3306) ds64 chunk, written as JUNK and turned into ds64 when the file exceeds 4GB */
+typedef struct
+{
+	char chunkID[4]; /* 'JUNK' or 'ds64' */
+	uint32_t chunkSize; /* 28 fixed */
+	uint32_t riffSizeLow; /* 64bit sizes split to keep the structure free of padding */
+	uint32_t riffSizeHigh;
+	uint32_t dataSizeLow;
+	uint32_t dataSizeHigh;
+	uint32_t sampleCountLow;
+	uint32_t sampleCountHigh;
+	uint32_t tableLength; /* 0, no other chunk above 4GB */
+} t_DS64Chunk;
+
+#define RF64_SIZE_IN_DS64 (0xFFFFFFFFul) /* 32bit size field value meaning "see ds64" */
+
 #define FormatID "fmt "   /* chunkID for Format Chunk. NOTE: There is a space at the end of this ID. */
 
 typedef struct {
@@ -149,6 +183,7 @@ typedef struct
 typedef struct
 {
 	t_WAVRIFF_hdr hdr;
+	t_DS64Chunk ds64_chunk;
 	t_FormatChunk fmt_chunk;
 	t_DataChunk data_chunk;
 } t_wav_file_hdr;
@@ -161,6 +196,15 @@ t_wav_file_hdr wave_file_hdr =
 		0, /* size to update later */
 		{ 'W', 'A', 'V', 'E' }
 	},
+	/* t_DS64Chunk */
+	{
+		{ 'J', 'U', 'N', 'K' }, /* chunkID, 'ds64' for RF64 */
+		28, /* uint32_t chunkSize; */
+		0, 0, /* riffSize to update later */
+		0, 0, /* dataSize to update later */
+		0, 0, /* sampleCount to update later */
+		0 /* uint32_t tableLength; */
+	},
 	/* t_FormatChunk */
 	{
 		{ 'f', 'm', 't', ' ' }, /* char		chunkID[4];  */
@@ -185,6 +229,16 @@ typedef struct
 		char data[U64TOA_MAX_DIGIT+1];
 } t_u64toa;
 
+typedef struct rx_file
+{
+	file_writer_t* writer;
+	uint64_t sample_count; /* Samples written to this file */
+	sigmf_writer_t* sigmf; /* NULL without -M */
+	iqz_writer_t* iqz; /* NULL without -Z */
+	char path[PATH_FILE_MAX_LEN];
+	struct rx_file* next; /* In rx_file_done */
+} t_rx_file;
+
 receiver_mode_t receiver_mode = RECEIVER_MODE_RX;
 
 unsigned int vga_gain = DEFAULT_VGA_IF_GAIN;
@@ -202,11 +256,27 @@ airspy_read_partid_serialno_t read_partid_serialno;
 
 volatile bool do_exit = false;
 
-FILE* fd = NULL;
+t_rx_file* rx_file = NULL;
+
+/* Rotation thread, opens the next file ahead of rx_callback() and finalizes the files rotated out */
+pthread_t rx_file_thread;
+bool rx_file_thread_started = false;
+pthread_mutex_t rx_file_mp; /* Protects the rx_file_* variables below */
+pthread_cond_t rx_file_cv;
+t_rx_file* rx_file_next = NULL; /* NULL until opened */
+bool rx_file_next_failed = false; /* No next file will be opened */
+t_rx_file* rx_file_done = NULL; /* Oldest first */
+uint64_t rx_file_xfer_left = 0; /* bytes_to_xfer when the last file was rotated out */
+bool rx_file_stop = false;
+bool rx_file_failed = false; /* Finalizing a file failed */
 
 bool verbose = false;
 bool receive = false;
 bool receive_wav = false;
+bool direct_io = false;
+bool sigmf = false;
+bool compress = false;
+uint32_t compress_threads = 0;
 
 struct timeval time_start;
 struct timeval t_start;
@@ -217,6 +287,7 @@ float global_average_rate = 0.0f;
 uint32_t rate_samples = 0;
 uint32_t buffer_count = 0;
 uint32_t sample_count = 0;
+uint64_t dropped_samples = 0;
 
 bool freq = false;
 uint32_t freq_hz;
@@ -237,6 +308,57 @@ uint32_t biast_val;
 bool serial_number = false;
 uint64_t serial_number_val;
 
+const char* replay_path = NULL;
+enum airspy_file_mode replay_mode = AIRSPY_FILE_REALTIME;
+
+bool rotate = false;
+uint32_t rotate_mb = 0;
+uint32_t rotate_seconds = 0;
+uint64_t rotate_bytes = 0;
+uint64_t rotate_samples = 0;
+uint32_t rotate_index = 0;
+const char* rotate_path = NULL;
+
+bool ring_mode = false;
+uint32_t ring_seconds = 0;
+ring_recorder_t* ring = NULL;
+const char* ring_snapshot_path = NULL;
+uint32_t ring_snapshot_index = 0;
+uint64_t ring_snapshot_bytes = 0; /* The last ring_seconds */
+/* Set by SIGUSR1, rx_callback() then starts a snapshot saved by the snapshot thread while the ring goes on */
+volatile bool ring_snapshot_request = false;
+pthread_t ring_snapshot_thread;
+bool ring_snapshot_thread_started = false;
+pthread_mutex_t ring_snapshot_mp; /* Protects the ring_snapshot_* variables below */
+pthread_cond_t ring_snapshot_cv;
+bool ring_snapshot_pending = false;
+uint64_t ring_snapshot_size = 0; /* Bytes of the pending snapshot */
+bool ring_snapshot_stop = false;
+bool ring_snapshot_failed = false;
+
+bool spectrum_mode = false;
+uint32_t spectrum_fft_size = 0;
+uint32_t spectrum_averages = DEFAULT_SPECTRUM_AVERAGES;
+uint32_t spectrum_window = SPECTRUM_WINDOW_HANN;
+const char* spectrum_path = NULL;
+FILE* spectrum_file = NULL;
+spectrum_t* spectrum = NULL;
+
+bool squelch = false;
+float squelch_dbfs = 0.0f;
+uint32_t squelch_hold_ms = DEFAULT_SQUELCH_HOLD_MS;
+uint32_t squelch_preroll_ms = DEFAULT_SQUELCH_PREROLL_MS;
+uint32_t squelch_bursts = 0;
+uint64_t squelch_kept = 0;
+uint64_t squelch_skipped = 0;
+uint64_t next_sample_index = 0; /* Stream index following the last block received */
+/* Tuning of the last samples written, from the transfers */
+bool rx_tuning_known = false;
+uint32_t rx_freq_hz = 0;
+uint8_t rx_lna_gain = AIRSPY_GAIN_UNKNOWN;
+uint8_t rx_mixer_gain = AIRSPY_GAIN_UNKNOWN;
+uint8_t rx_vga_gain = AIRSPY_GAIN_UNKNOWN;
+
 static float
 TimevalDiff(const struct timeval *a, const struct timeval *b)
 {
@@ -345,6 +467,645 @@ char* u64toa(uint64_t val, t_u64toa* str)
 	return res;
 }
 
+/* Smallest unit written to a file, one sample or one block of samples for AIRSPY_SAMPLE_INT8_BFP_IQ */
+static uint32_t frame_size(void)
+{
+	switch (sample_type_val)
+	{
+		case AIRSPY_SAMPLE_INT12_PACKED_IQ:
+			return 3;
+
+		case AIRSPY_SAMPLE_INT8_BFP_IQ:
+			return AIRSPY_INT8_BFP_BLOCK_SIZE;
+
+		default:
+			return wav_nb_byte_per_sample * wav_nb_channels;
+	}
+}
+
+/* Samples in one frame_size() unit */
+static uint32_t frame_samples(void)
+{
+	return (sample_type_val == AIRSPY_SAMPLE_INT8_BFP_IQ) ? AIRSPY_INT8_BFP_BLOCK_LEN : 1;
+}
+
+/* Insert the rotation index before the file extension */
+static void rx_file_name(char* dst, const char* base, uint32_t index)
+{
+	const char* ext;
+	const char* sep;
+
+	ext = strrchr(base, '.');
+	sep = strrchr(base, '/');
+	if (sep == NULL || (strrchr(base, '\\') != NULL && strrchr(base, '\\') > sep))
+		sep = strrchr(base, '\\');
+	if (ext == NULL || (sep != NULL && ext < sep))
+		ext = base + strlen(base);
+
+	snprintf(dst, PATH_FILE_MAX_LEN, "%.*s_%05u%s", (int)(ext - base), base, index, ext);
+}
+
+static const char* sigmf_datatype(void)
+{
+	switch (sample_type_val)
+	{
+		case AIRSPY_SAMPLE_FLOAT32_IQ:
+			return "cf32_le";
+
+		case AIRSPY_SAMPLE_FLOAT32_REAL:
+			return "rf32_le";
+
+		case AIRSPY_SAMPLE_INT16_IQ:
+			return "ci16_le";
+
+		case AIRSPY_SAMPLE_INT16_REAL:
+			return "ri16_le";
+
+		default:
+			return "ru16_le";
+	}
+}
+
+/* Bytes a new file is expected to hold with xfer_left bytes still to receive, 0 if unknown */
+static uint64_t rx_file_reserve(uint64_t xfer_left)
+{
+	uint64_t reserve;
+
+	reserve = 0;
+	if (rotate_bytes > 0)
+		reserve = rotate_bytes;
+	else if (rotate_samples > 0)
+		reserve = rotate_samples / frame_samples() * frame_size();
+	if (limit_num_samples && (reserve == 0 || xfer_left < reserve))
+		reserve = xfer_left;
+
+	if (reserve > 0 && receive_wav && rotate_bytes == 0)
+		reserve += sizeof(t_wav_file_hdr);
+	return reserve;
+}
+
+/* path NULL means stdout, reserve is the size to pre-allocate (0 for none) */
+static t_rx_file* rx_file_open(const char* path, uint64_t reserve)
+{
+	t_rx_file* file;
+	char hw[64];
+
+	file = (t_rx_file*) calloc(1, sizeof(t_rx_file));
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	if (path)
+	{
+		if (direct_io)
+			file->writer = file_writer_open(path, FILE_WRITER_DIRECT, FILE_WRITER_DIRECT_BUFFER_SIZE, FILE_WRITER_DIRECT_QUEUE_DEPTH);
+		else
+			file->writer = file_writer_open(path, FILE_WRITER_STDIO, FD_BUFFER_SIZE, 0);
+		strncpy(file->path, path, PATH_FILE_MAX_LEN - 1);
+	}
+	else
+	{
+		file->writer = file_writer_open_stream(stdout, FD_BUFFER_SIZE);
+		strncpy(file->path, "stdout", PATH_FILE_MAX_LEN - 1);
+	}
+
+	if (file->writer == NULL)
+	{
+		fprintf(stderr, "Failed to open file: %s (%s)\n", file->path, strerror(errno));
+		free(file);
+		return NULL;
+	}
+
+	/* Pre-allocate what the file is expected to hold to avoid fragmentation and metadata updates while streaming */
+	if (path && reserve > 0)
+	{
+		if (file_writer_preallocate(file->writer, reserve) != 0 && verbose)
+			fprintf(stderr, "Pre-allocation of %s failed, continuing without\n", file->path);
+	}
+
+	/* Write Wav header, updated when the file is closed */
+	if (receive_wav)
+	{
+		file_writer_write(file->writer, &wave_file_hdr, sizeof(t_wav_file_hdr));
+	}
+
+	if (compress_threads > 0)
+	{
+		file->iqz = iqz_writer_open(file->writer, sample_type_val, wav_sample_per_sec, wav_nb_channels, compress_threads);
+		if (file->iqz == NULL)
+		{
+			fprintf(stderr, "Failed to start compression for: %s (%s)\n", file->path, strerror(errno));
+			file_writer_close(file->writer);
+			free(file);
+			return NULL;
+		}
+	}
+
+	if (path && sigmf)
+	{
+		snprintf(hw, sizeof(hw), "AirSpy SN 0x%08X%08X", read_partid_serialno.serial_no[2], read_partid_serialno.serial_no[3]);
+		file->sigmf = sigmf_writer_open(path, sigmf_datatype(), wav_sample_per_sec, frame_size(),
+			receive_wav ? sizeof(t_wav_file_hdr) : 0, "airspy_rx v" AIRSPY_RX_VERSION, hw);
+		if (file->sigmf == NULL)
+		{
+			fprintf(stderr, "Failed to open SigMF metadata for: %s (%s)\n", file->path, strerror(errno));
+			file_writer_close(file->writer);
+			free(file);
+			return NULL;
+		}
+	}
+
+	if (verbose)
+	{
+		fprintf(stderr, "Receive file: %s (%s)\n", file->path, file_writer_backend_name(file->writer));
+	}
+
+	return file;
+}
+
+static int rx_file_close(t_rx_file* file)
+{
+	t_wav_file_hdr wav_hdr;
+	uint64_t file_pos;
+	uint64_t riff_size;
+	uint64_t data_size;
+	uint64_t frame_count;
+	int result;
+
+	result = 0;
+	if (file->iqz != NULL && iqz_writer_close(file->iqz) != 0)
+		result = -1;
+
+	if( receive_wav )
+	{
+		/* Get size of file */
+		file_pos = file_writer_tell(file->writer);
+		wav_hdr = wave_file_hdr;
+		riff_size = file_pos - 8;
+		data_size = file_pos - sizeof(t_wav_file_hdr);
+		frame_count = data_size / frame_size();
+		/* Wav Header */
+		if (riff_size > RF64_SIZE_IN_DS64)
+		{
+			/* Too big for RIFF, switch to RF64 with the real sizes in ds64 */
+			memcpy(wav_hdr.hdr.groupID, "RF64", 4);
+			memcpy(wav_hdr.ds64_chunk.chunkID, "ds64", 4);
+			wav_hdr.ds64_chunk.riffSizeLow = (uint32_t) riff_size;
+			wav_hdr.ds64_chunk.riffSizeHigh = (uint32_t)(riff_size >> 32);
+			wav_hdr.ds64_chunk.dataSizeLow = (uint32_t) data_size;
+			wav_hdr.ds64_chunk.dataSizeHigh = (uint32_t)(data_size >> 32);
+			wav_hdr.ds64_chunk.sampleCountLow = (uint32_t) frame_count;
+			wav_hdr.ds64_chunk.sampleCountHigh = (uint32_t)(frame_count >> 32);
+			riff_size = RF64_SIZE_IN_DS64;
+			data_size = RF64_SIZE_IN_DS64;
+		}
+		wav_hdr.hdr.size = (uint32_t) riff_size;
+		/* Wav Format Chunk */
+		wav_hdr.fmt_chunk.wFormatTag = wav_format_tag;
+		wav_hdr.fmt_chunk.wChannels = wav_nb_channels;
+		wav_hdr.fmt_chunk.dwSamplesPerSec = wav_sample_per_sec;
+		wav_hdr.fmt_chunk.dwAvgBytesPerSec = wav_hdr.fmt_chunk.dwSamplesPerSec * wav_nb_byte_per_sample;
+		wav_hdr.fmt_chunk.wBlockAlign = wav_nb_channels * (wav_nb_bits_per_sample / 8);
+		wav_hdr.fmt_chunk.wBitsPerSample = wav_nb_bits_per_sample;
+		/* Wav Data Chunk */
+		wav_hdr.data_chunk.chunkSize = (uint32_t) data_size;
+		/* Overwrite header with updated data */
+		if (file_writer_pwrite(file->writer, &wav_hdr, sizeof(t_wav_file_hdr), 0) != 0)
+			result = -1;
+	}
+
+	if (file_writer_close(file->writer) != 0)
+		result = -1;
+
+	if (file->sigmf != NULL && sigmf_writer_close(file->sigmf) != 0)
+		result = -1;
+
+	if (result != 0)
+		fprintf(stderr, "Failed to write file: %s (%s)\n", file->path, strerror(errno));
+
+	free(file);
+	return result;
+}
+
+/* Bytes which still fit in the current file before it has to be rotated */
+static uint64_t rx_file_room(void)
+{
+	uint64_t used;
+
+	if (rotate_bytes > 0)
+	{
+		used = file_writer_tell(rx_file->writer);
+		return (used < rotate_bytes) ? ((rotate_bytes - used) / frame_size()) * frame_size() : 0;
+	}
+	if (rotate_samples > 0)
+	{
+		return (rx_file->sample_count < rotate_samples) ? (rotate_samples - rx_file->sample_count) / frame_samples() * frame_size() : 0;
+	}
+	return UINT64_MAX;
+}
+
+/* Close and remove a file opened ahead but never written to */
+static void rx_file_discard(t_rx_file* file)
+{
+	char path[PATH_FILE_MAX_LEN];
+	sigmf_writer_t* sigmf;
+
+	sigmf = file->sigmf;
+	file->sigmf = NULL;
+	strcpy(path, file->path);
+	rx_file_close(file);
+	if (sigmf != NULL)
+		sigmf_writer_discard(sigmf);
+	remove(path);
+}
+
+static void* rx_file_threadproc(void* arg)
+{
+	char path_next[PATH_FILE_MAX_LEN];
+	t_rx_file* file;
+	uint64_t reserve;
+	int result;
+
+	(void) arg;
+
+	pthread_mutex_lock(&rx_file_mp);
+	while (true)
+	{
+		/* The next file first, rx_callback() may be waiting for it */
+		if (rx_file_next == NULL && !rx_file_next_failed && !rx_file_stop)
+		{
+			if (rotate_index >= ROTATE_INDEX_MAX)
+			{
+				fprintf(stderr, "Too many rotated files\n");
+				rx_file_next_failed = true;
+				pthread_cond_broadcast(&rx_file_cv);
+				continue;
+			}
+			rotate_index++;
+			rx_file_name(path_next, rotate_path, rotate_index);
+			reserve = rx_file_reserve(rx_file_xfer_left);
+			pthread_mutex_unlock(&rx_file_mp);
+
+			file = rx_file_open(path_next, reserve);
+
+			pthread_mutex_lock(&rx_file_mp);
+			rx_file_next = file;
+			rx_file_next_failed = (file == NULL);
+			pthread_cond_broadcast(&rx_file_cv);
+			continue;
+		}
+
+		if (rx_file_done != NULL)
+		{
+			file = rx_file_done;
+			rx_file_done = file->next;
+			pthread_mutex_unlock(&rx_file_mp);
+
+			result = rx_file_close(file);
+
+			pthread_mutex_lock(&rx_file_mp);
+			if (result != 0)
+				rx_file_failed = true;
+			continue;
+		}
+
+		if (rx_file_stop)
+			break;
+		pthread_cond_wait(&rx_file_cv, &rx_file_mp);
+	}
+	pthread_mutex_unlock(&rx_file_mp);
+
+	return NULL;
+}
+
+static int rx_file_thread_start(void)
+{
+	rx_file_xfer_left = bytes_to_xfer;
+	pthread_mutex_init(&rx_file_mp, NULL);
+	pthread_cond_init(&rx_file_cv, NULL);
+	if (pthread_create(&rx_file_thread, NULL, rx_file_threadproc, NULL) != 0)
+	{
+		pthread_cond_destroy(&rx_file_cv);
+		pthread_mutex_destroy(&rx_file_mp);
+		return -1;
+	}
+	rx_file_thread_started = true;
+	return 0;
+}
+
+/* Once streaming has stopped, finalize the files rotated out. Return 0 on success */
+static int rx_file_thread_stop(void)
+{
+	if (!rx_file_thread_started)
+		return 0;
+
+	pthread_mutex_lock(&rx_file_mp);
+	rx_file_stop = true;
+	pthread_cond_broadcast(&rx_file_cv);
+	pthread_mutex_unlock(&rx_file_mp);
+	pthread_join(rx_file_thread, NULL);
+	pthread_cond_destroy(&rx_file_cv);
+	pthread_mutex_destroy(&rx_file_mp);
+	rx_file_thread_started = false;
+
+	if (rx_file_next != NULL)
+	{
+		rx_file_discard(rx_file_next);
+		rx_file_next = NULL;
+	}
+	return rx_file_failed ? -1 : 0;
+}
+
+/*
+ * Switch to the file opened ahead between two samples so the stream has no gap across files,
+ * the old one is finalized by the rotation thread.
+ */
+static int rx_file_rotate(void)
+{
+	t_rx_file* file;
+	t_rx_file** tail;
+
+	pthread_mutex_lock(&rx_file_mp);
+	/* Only waits when the files are rotated faster than they can be opened */
+	while (rx_file_next == NULL && !rx_file_next_failed)
+	{
+		pthread_cond_wait(&rx_file_cv, &rx_file_mp);
+	}
+	file = rx_file_next;
+	if (file != NULL)
+	{
+		for (tail = &rx_file_done; *tail != NULL; tail = &(*tail)->next)
+			;
+		*tail = rx_file;
+		rx_file_next = NULL;
+		rx_file_xfer_left = bytes_to_xfer;
+		pthread_cond_broadcast(&rx_file_cv);
+	}
+	pthread_mutex_unlock(&rx_file_mp);
+
+	if (file == NULL)
+	{
+		return -1;
+	}
+	rx_file = file;
+	return 0;
+}
+
+/* Start a SigMF capture segment at the next sample written, offset is its position in the transfer */
+static int rx_file_capture(const airspy_transfer_t* transfer, uint32_t offset, uint64_t dropped, uint64_t skipped)
+{
+	sigmf_capture_t capture;
+
+	capture.sample_start = rx_file->sample_count;
+	capture.global_index = transfer->sample_index + offset;
+	/* The transfer timestamp is taken when its last sample is received */
+	capture.timestamp = transfer->timestamp -
+		((uint64_t)(transfer->sample_count - offset) * 1000000000ull) / wav_sample_per_sec;
+	capture.dropped_samples = dropped;
+	capture.skipped_samples = skipped;
+	capture.freq_hz = rx_freq_hz;
+	capture.lna_gain = rx_lna_gain;
+	capture.mixer_gain = rx_mixer_gain;
+	capture.vga_gain = rx_vga_gain;
+
+	return sigmf_writer_capture(rx_file->sigmf, &capture);
+}
+
+static bool rx_tuning_changed(const airspy_transfer_t* transfer)
+{
+	return transfer->freq_hz != rx_freq_hz || transfer->lna_gain != rx_lna_gain ||
+		transfer->mixer_gain != rx_mixer_gain || transfer->vga_gain != rx_vga_gain;
+}
+
+/*
+ * Offset in the transfer of the first sample taken with its frequency and gains, once the last change
+ * has completed, transfer->sample_count if they only apply to a later transfer or did not change.
+ */
+static uint32_t rx_tuning_offset(const airspy_transfer_t* transfer)
+{
+	uint64_t offset;
+
+	if (!rx_tuning_known)
+	{
+		/* Nothing known about the earlier samples */
+		rx_tuning_known = true;
+		rx_freq_hz = transfer->freq_hz;
+		rx_lna_gain = transfer->lna_gain;
+		rx_mixer_gain = transfer->mixer_gain;
+		rx_vga_gain = transfer->vga_gain;
+		return transfer->sample_count;
+	}
+
+	if (!rx_tuning_changed(transfer))
+		return transfer->sample_count;
+
+	offset = (transfer->retune_end > transfer->sample_index) ? transfer->retune_end - transfer->sample_index : 0;
+	if (offset >= transfer->sample_count)
+		return transfer->sample_count;
+	return (uint32_t) offset / frame_samples() * frame_samples();
+}
+
+/* Return 0 on success, -1 on error */
+static int rx_file_write(void* data, uint32_t length, const airspy_transfer_t* transfer)
+{
+	unsigned char* ptr;
+	uint64_t room;
+	uint32_t chunk;
+	uint32_t offset;
+	uint32_t tuning_offset;
+	bool tuning_start;
+
+	tuning_offset = rx_tuning_offset(transfer);
+
+	ptr = (unsigned char*) data;
+	while (length > 0)
+	{
+		room = rx_file_room();
+		if (room == 0)
+		{
+			if (rx_file_rotate() != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		chunk = (room < length) ? (uint32_t) room : length;
+
+		offset = (uint32_t)(ptr - (unsigned char*) data) / frame_size() * frame_samples();
+		tuning_start = (offset == tuning_offset);
+		if (tuning_start)
+		{
+			rx_freq_hz = transfer->freq_hz;
+			rx_lna_gain = transfer->lna_gain;
+			rx_mixer_gain = transfer->mixer_gain;
+			rx_vga_gain = transfer->vga_gain;
+		}
+		else if (offset < tuning_offset && chunk > (tuning_offset - offset) / frame_samples() * frame_size())
+		{
+			/* The samples of the new tuning go to the next segment */
+			chunk = (tuning_offset - offset) / frame_samples() * frame_size();
+		}
+
+		/* New segment for the first sample of a file, after a gap, at each burst of the squelch and at a new tuning */
+		if (rx_file->sigmf != NULL && (rx_file->sample_count == 0 || tuning_start ||
+			(offset == 0 && (transfer->dropped_samples > 0 || (transfer->burst & AIRSPY_BURST_START)))))
+		{
+			if (rx_file_capture(transfer, offset, (offset == 0) ? transfer->dropped_samples : 0,
+				(offset == 0) ? transfer->sample_index - next_sample_index - transfer->dropped_samples : 0) != 0)
+			{
+				return -1;
+			}
+		}
+
+		if (rx_file->iqz != NULL)
+		{
+			if (iqz_writer_write(rx_file->iqz, ptr, chunk) != 0)
+			{
+				return -1;
+			}
+		}
+		else if (file_writer_write(rx_file->writer, ptr, chunk) != (int) chunk)
+		{
+			return -1;
+		}
+		rx_file->sample_count += chunk / frame_size() * frame_samples();
+		ptr += chunk;
+		length -= chunk;
+	}
+
+	return 0;
+}
+
+/* Called from rx_callback(), a snapshot requested starts before this block */
+static int rx_ring_write(void* data, uint32_t length, uint64_t timestamp)
+{
+	if (ring_snapshot_request)
+	{
+		pthread_mutex_lock(&ring_snapshot_mp);
+		if (!ring_snapshot_pending)
+		{
+			ring_snapshot_request = false;
+			ring_snapshot_size = ring_recorder_snapshot_begin(ring, ring_snapshot_bytes);
+			ring_snapshot_pending = true;
+			pthread_cond_signal(&ring_snapshot_cv);
+		}
+		pthread_mutex_unlock(&ring_snapshot_mp);
+	}
+
+	return ring_recorder_write(ring, data, length, timestamp / 1000);
+}
+
+/* Save the size bytes of the snapshot begun, oldest sample first, into the next snapshot file */
+static int rx_ring_snapshot(uint64_t size)
+{
+	char path_snapshot[PATH_FILE_MAX_LEN];
+	t_rx_file* file;
+	t_u64toa ascii_u64_data;
+
+	if (ring_snapshot_index > ROTATE_INDEX_MAX)
+	{
+		fprintf(stderr, "Too many snapshot files\n");
+		ring_recorder_snapshot_dump(ring, NULL);
+		return -1;
+	}
+	rx_file_name(path_snapshot, ring_snapshot_path, ring_snapshot_index);
+	ring_snapshot_index++;
+
+	file = rx_file_open(path_snapshot, size + (receive_wav ? sizeof(t_wav_file_hdr) : 0));
+	if (file == NULL)
+	{
+		ring_recorder_snapshot_dump(ring, NULL);
+		return -1;
+	}
+
+	if (ring_recorder_snapshot_dump(ring, file->writer) != 0)
+	{
+		fprintf(stderr, "Failed to write file: %s (%s)\n", file->path, strerror(errno));
+		rx_file_close(file);
+		return -1;
+	}
+	file->sample_count = size / frame_size() * frame_samples();
+
+	fprintf(stderr, "Snapshot %s: %s samples\n", file->path, u64toa(file->sample_count, &ascii_u64_data));
+	return rx_file_close(file);
+}
+
+static void* ring_snapshot_threadproc(void* arg)
+{
+	uint64_t size;
+	int result;
+
+	(void) arg;
+
+	pthread_mutex_lock(&ring_snapshot_mp);
+	while (true)
+	{
+		if (ring_snapshot_pending)
+		{
+			size = ring_snapshot_size;
+			pthread_mutex_unlock(&ring_snapshot_mp);
+
+			result = rx_ring_snapshot(size);
+
+			pthread_mutex_lock(&ring_snapshot_mp);
+			if (result != 0)
+				ring_snapshot_failed = true;
+			ring_snapshot_pending = false;
+			continue;
+		}
+
+		if (ring_snapshot_stop)
+			break;
+		pthread_cond_wait(&ring_snapshot_cv, &ring_snapshot_mp);
+	}
+	pthread_mutex_unlock(&ring_snapshot_mp);
+
+	return NULL;
+}
+
+static int ring_snapshot_thread_start(void)
+{
+	pthread_mutex_init(&ring_snapshot_mp, NULL);
+	pthread_cond_init(&ring_snapshot_cv, NULL);
+	if (pthread_create(&ring_snapshot_thread, NULL, ring_snapshot_threadproc, NULL) != 0)
+	{
+		pthread_cond_destroy(&ring_snapshot_cv);
+		pthread_mutex_destroy(&ring_snapshot_mp);
+		return -1;
+	}
+	ring_snapshot_thread_started = true;
+	return 0;
+}
+
+/* Once streaming has stopped, finish the pending snapshot and save one still requested. Return 0 on success */
+static int ring_snapshot_thread_stop(void)
+{
+	int result;
+
+	if (!ring_snapshot_thread_started)
+		return 0;
+
+	pthread_mutex_lock(&ring_snapshot_mp);
+	ring_snapshot_stop = true;
+	pthread_cond_broadcast(&ring_snapshot_cv);
+	pthread_mutex_unlock(&ring_snapshot_mp);
+	pthread_join(ring_snapshot_thread, NULL);
+	pthread_cond_destroy(&ring_snapshot_cv);
+	pthread_mutex_destroy(&ring_snapshot_mp);
+	ring_snapshot_thread_started = false;
+
+	result = ring_snapshot_failed ? -1 : 0;
+	if (ring_snapshot_request)
+	{
+		ring_snapshot_request = false;
+		if (rx_ring_snapshot(ring_recorder_snapshot_begin(ring, ring_snapshot_bytes)) != 0)
+			result = -1;
+	}
+	return result;
+}
+
 int rx_callback(airspy_transfer_t* transfer)
 {
 	uint32_t bytes_to_write;
@@ -352,8 +1113,9 @@ int rx_callback(airspy_transfer_t* transfer)
 	ssize_t bytes_written;
 	struct timeval time_now;
 	float time_difference, rate;
+	t_u64toa ascii_u64_data;
 
-	if( fd != NULL )
+	if( (rx_file != NULL) || (ring != NULL) || (spectrum != NULL) )
 	{
 		switch(sample_type_val)
 		{
@@ -382,6 +1144,18 @@ int rx_callback(airspy_transfer_t* transfer)
 				pt_rx_buffer = transfer->samples;
 				break;
 
+			case AIRSPY_SAMPLE_INT12_PACKED_IQ:
+				bytes_to_write = transfer->sample_count * 3;
+				pt_rx_buffer = transfer->samples;
+				break;
+
+			case AIRSPY_SAMPLE_INT8_BFP_IQ:
+				bytes_to_write = (transfer->sample_count / AIRSPY_INT8_BFP_BLOCK_LEN) * AIRSPY_INT8_BFP_BLOCK_SIZE;
+				if (transfer->sample_count % AIRSPY_INT8_BFP_BLOCK_LEN)
+					bytes_to_write += 1 + (transfer->sample_count % AIRSPY_INT8_BFP_BLOCK_LEN) * 2;
+				pt_rx_buffer = transfer->samples;
+				break;
+
 			default:
 				bytes_to_write = 0;
 				pt_rx_buffer = NULL;
@@ -390,6 +1164,23 @@ int rx_callback(airspy_transfer_t* transfer)
 
 		gettimeofday(&time_now, NULL);
 
+		if (transfer->dropped_samples > 0)
+		{
+			dropped_samples += transfer->dropped_samples;
+			if (verbose)
+				fprintf(stderr, "Dropped %u samples before sample %s\n", (uint32_t) transfer->dropped_samples,
+					u64toa(transfer->sample_index, &ascii_u64_data));
+		}
+
+		if (squelch)
+		{
+			/* The samples missing besides the dropped ones were below the squelch */
+			squelch_skipped += transfer->sample_index - next_sample_index - transfer->dropped_samples;
+			squelch_kept += transfer->sample_count;
+			if (transfer->burst & AIRSPY_BURST_START)
+				squelch_bursts++;
+		}
+
 		if (!got_first_packet)
 		{
 			t_start = time_now;
@@ -420,13 +1211,25 @@ int rx_callback(airspy_transfer_t* transfer)
 			bytes_to_xfer -= bytes_to_write;
 		}
 
-		if(pt_rx_buffer != NULL)
+		if (spectrum != NULL)
+			spectrum_push(spectrum, transfer->samples, transfer->sample_count);
+
+		if ((rx_file == NULL) && (ring == NULL))
+		{
+			/* Spectrum monitor only */
+			bytes_written = bytes_to_write;
+		}else if(pt_rx_buffer != NULL)
 		{
-			bytes_written = fwrite(pt_rx_buffer, 1, bytes_to_write, fd);
+			if (ring != NULL)
+				bytes_written = (rx_ring_write(pt_rx_buffer, bytes_to_write, transfer->timestamp) == 0) ? bytes_to_write : -1;
+			else
+				bytes_written = (rx_file_write(pt_rx_buffer, bytes_to_write, transfer) == 0) ? bytes_to_write : -1;
 		}else
 		{
 			bytes_written = 0;
 		}
+		next_sample_index = transfer->sample_index + transfer->sample_count;
+
 		if ( (bytes_written != bytes_to_write) ||
 				 ((limit_num_samples == true) && (bytes_to_xfer == 0))
 				)
@@ -446,12 +1249,34 @@ static void usage(void)
 	fprintf(stderr, "-r <filename>: Receive data into file\n");
 	fprintf(stderr, "-w Receive data into file with WAV header and automatic name\n");
 	fprintf(stderr, " This is for SDR# compatibility and may not work with other software\n");
+	fprintf(stderr, " Files bigger than 4GB are written as RF64\n");
+	fprintf(stderr, "[-D]: Write file with direct I/O bypassing the page cache (io_uring if available)\n");
+	fprintf(stderr, "[-R size_MB]: Rotate to a new pre-allocated file every size_MB MBytes, index appended to file name\n");
+	fprintf(stderr, "[-T seconds]: Rotate to a new pre-allocated file every seconds of samples\n");
+	fprintf(stderr, "[-M]: Write SigMF metadata (.sigmf-meta) and a capture index (.sigmf-index) next to the file\n");
+	fprintf(stderr, "[-F seconds]: Flight recorder, keep the last seconds of samples in <filename>.ring\n");
+	fprintf(stderr, " SIGUSR1 saves them to a new file, index appended to file name\n");
+	fprintf(stderr, "[-Z threads]: Compress losslessly (.iqz, see airspy_iqz) with 1-%d threads, 16bit sample types only\n", IQZ_MAX_THREADS);
+	fprintf(stderr, "[-P fft_size]: Spectrum monitor, averaged power spectrum once per second (FFT size power of 2, %d-%d)\n",
+		SPECTRUM_FFT_SIZE_MIN, SPECTRUM_FFT_SIZE_MAX);
+	fprintf(stderr, " FLOAT32_IQ and INT16_IQ only, without -r/-w no file is written\n");
+	fprintf(stderr, "[-A averages]: FFTs averaged per spectrum, 1-%d (default %d)\n", SPECTRUM_AVERAGES_MAX, DEFAULT_SPECTRUM_AVERAGES);
+	fprintf(stderr, "[-W window]: Spectrum window, 0=rectangular, 1=Hann(default), 2=Blackman-Harris\n");
+	fprintf(stderr, "[-O spectrum_file]: Write each spectrum as an rtl_power CSV line instead of a summary on stderr\n");
+	fprintf(stderr, "[-q squelch_dBFS]: Only write the bursts of blocks with an RMS level at or above squelch_dBFS,\n");
+	fprintf(stderr, " going on down to %.0fdB below, each one a segment of the SigMF index (implies -M)\n", SQUELCH_HYSTERESIS_DB);
+	fprintf(stderr, "[-H hold_ms]: Keep writing hold_ms after the end of a burst (default %d)\n", DEFAULT_SQUELCH_HOLD_MS);
+	fprintf(stderr, "[-E preroll_ms]: Also write the preroll_ms before a burst, 0-%d (default %d)\n",
+		SQUELCH_PREROLL_MAX_MS, DEFAULT_SQUELCH_PREROLL_MS);
 	fprintf(stderr, "[-s serial_number_64bits]: Open device with specified 64bits serial number\n");
+	fprintf(stderr, "[-i raw_file]: Replay a -t 4 (U16_REAL) capture in real time instead of opening a device\n");
+	fprintf(stderr, "[-I raw_file]: Replay a -t 4 (U16_REAL) capture as fast as possible\n");
 	fprintf(stderr, "[-f frequency_MHz]: Set frequency in MHz between [%lu, %lu] (default %luMHz)\n",
 		FREQ_HZ_MIN / FREQ_ONE_MHZ, FREQ_HZ_MAX / FREQ_ONE_MHZ, DEFAULT_FREQ_HZ / FREQ_ONE_MHZ);
 	fprintf(stderr, "[-a sample_rate]: Set sample rate, 0=10MSPS(default), 1=2.5MSPS\n");
 	fprintf(stderr, "[-t sample_type]: Set sample type, \n");
 	fprintf(stderr, " 0=FLOAT32_IQ, 1=FLOAT32_REAL, 2=INT16_IQ(default), 3=INT16_REAL, 4=U16_REAL\n");
+	fprintf(stderr, " 5=INT12_PACKED_IQ, 6=INT8_BFP_IQ (no WAV/SigMF, see airspy.h for the layout)\n");
 	fprintf(stderr, "[-b biast]: Set Bias Tee, 1=enabled, 0=disabled(default)\n");
 	fprintf(stderr, "[-v vga_gain]: Set VGA/IF gain, 0-%d (default %d)\n", VGA_GAIN_MAX, vga_gain);
 	fprintf(stderr, "[-m mixer_gain]: Set Mixer gain, 0-%d (default %d)\n", MIXER_GAIN_MAX, mixer_gain);
@@ -479,15 +1304,19 @@ void sigint_callback_handler(int signum)
 	fprintf(stderr, "Caught signal %d\n", signum);
 	do_exit = true;
 }
-#endif
 
-#define PATH_FILE_MAX_LEN (FILENAME_MAX)
-#define DATE_TIME_MAX_LEN (32)
+void sigusr1_callback_handler(int signum)
+{
+	ring_snapshot_request = true;
+}
+#endif
 
 int main(int argc, char** argv)
 {
 	int opt;
 	char path_file[PATH_FILE_MAX_LEN];
+	char path_file_rotate[PATH_FILE_MAX_LEN];
+	char path_file_ring[PATH_FILE_MAX_LEN];
 	char date_time[DATE_TIME_MAX_LEN];
 	t_u64toa ascii_u64_data1;
 	t_u64toa ascii_u64_data2;
@@ -497,14 +1326,13 @@ int main(int argc, char** argv)
 	struct tm * timeinfo;
 	struct timeval t_end;
 	float time_diff;
-	uint32_t file_pos;
 	int exit_code = EXIT_SUCCESS;
 	uint32_t sample_rate_u32;
 	uint32_t sample_type_u32;
 	double freq_hz_temp;
 	char str[20];
 
-	while( (opt = getopt(argc, argv, "r:ws:f:a:t:b:v:m:l:n:d")) != EOF )
+	while( (opt = getopt(argc, argv, "r:wDMR:T:F:Z:P:A:W:O:q:H:E:i:I:s:f:a:t:b:v:m:l:n:d")) != EOF )
 	{
 		result = AIRSPY_SUCCESS;
 		switch( opt )
@@ -518,6 +1346,74 @@ int main(int argc, char** argv)
 				receive_wav = true;
 			 break;
 
+			case 'D':
+				direct_io = true;
+			break;
+
+			case 'M':
+				sigmf = true;
+			break;
+
+			case 'R':
+				rotate = true;
+				result = parse_u32(optarg, &rotate_mb);
+			break;
+
+			case 'T':
+				rotate = true;
+				result = parse_u32(optarg, &rotate_seconds);
+			break;
+
+			case 'F':
+				ring_mode = true;
+				result = parse_u32(optarg, &ring_seconds);
+			break;
+
+			case 'Z':
+				compress = true;
+				result = parse_u32(optarg, &compress_threads);
+			break;
+
+			case 'P':
+				spectrum_mode = true;
+				result = parse_u32(optarg, &spectrum_fft_size);
+			break;
+
+			case 'A':
+				result = parse_u32(optarg, &spectrum_averages);
+			break;
+
+			case 'W':
+				result = parse_u32(optarg, &spectrum_window);
+			break;
+
+			case 'O':
+				spectrum_path = optarg;
+			break;
+
+			case 'q':
+				squelch = true;
+				squelch_dbfs = (float) strtod(optarg, NULL);
+			break;
+
+			case 'H':
+				result = parse_u32(optarg, &squelch_hold_ms);
+			break;
+
+			case 'E':
+				result = parse_u32(optarg, &squelch_preroll_ms);
+			break;
+
+			case 'i':
+				replay_path = optarg;
+				replay_mode = AIRSPY_FILE_REALTIME;
+			break;
+
+			case 'I':
+				replay_path = optarg;
+				replay_mode = AIRSPY_FILE_FAST;
+			break;
+
 			case 's':
 				serial_number = true;
 				result = parse_u64(optarg, &serial_number_val);
@@ -597,6 +1493,16 @@ int main(int argc, char** argv)
 						wav_nb_byte_per_sample = (wav_nb_bits_per_sample / 8);
 					break;
 
+					case 5:
+						sample_type_val = AIRSPY_SAMPLE_INT12_PACKED_IQ;
+						wav_nb_channels = 2;
+					break;
+
+					case 6:
+						sample_type_val = AIRSPY_SAMPLE_INT8_BFP_IQ;
+						wav_nb_channels = 2;
+					break;
+
 					default:
 						/* Invalid value will display error */
 						sample_type_val = SAMPLE_TYPE_MAX+1;
@@ -643,7 +1549,8 @@ int main(int argc, char** argv)
 		}
 	}
 
-	bytes_to_xfer = samples_to_xfer * wav_nb_byte_per_sample * wav_nb_channels;
+	/* Rounded up to whole blocks for the block formats */
+	bytes_to_xfer = (samples_to_xfer + frame_samples() - 1) / frame_samples() * frame_size();
 
 	if (wav_nb_channels == 1)
 	{
@@ -697,6 +1604,35 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
+	if( squelch )
+	{
+		if( path == NULL ) {
+			fprintf(stderr, "argument error: squelch recording requires -r or -w\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( squelch_dbfs > 0.0f ) {
+			fprintf(stderr, "argument error: squelch_dBFS shall be 0 or less\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( squelch_preroll_ms > SQUELCH_PREROLL_MAX_MS ) {
+			fprintf(stderr, "argument error: squelch preroll_ms shall be between 0 and %d\n", SQUELCH_PREROLL_MAX_MS);
+			usage();
+			return EXIT_FAILURE;
+		}
+		/* The segment index */
+		sigmf = true;
+	}
+
+	if( (sample_type_val == AIRSPY_SAMPLE_INT12_PACKED_IQ) || (sample_type_val == AIRSPY_SAMPLE_INT8_BFP_IQ) ) {
+		if( receive_wav || sigmf ) {
+			fprintf(stderr, "argument error: packed sample types cannot be stored as WAV or SigMF\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
 	if(biast_val > BIAST_MAX) {
 		fprintf(stderr, "argument error: biast_val out of range\n");
 		usage();
@@ -721,6 +1657,113 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
+	if( sigmf && (path == NULL) ) {
+		fprintf(stderr, "argument error: SigMF metadata requires -r or -w\n");
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if( compress )
+	{
+		if( (compress_threads < 1) || (compress_threads > IQZ_MAX_THREADS) ) {
+			fprintf(stderr, "argument error: compression threads shall be between 1 and %d\n", IQZ_MAX_THREADS);
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( path == NULL ) {
+			fprintf(stderr, "argument error: compression requires -r\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( (sample_type_val != AIRSPY_SAMPLE_INT16_IQ) && (sample_type_val != AIRSPY_SAMPLE_INT16_REAL) &&
+			(sample_type_val != AIRSPY_SAMPLE_UINT16_REAL) ) {
+			fprintf(stderr, "argument error: compression requires a 16bit sample type\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( receive_wav || sigmf || ring_mode || (rotate_mb > 0) ) {
+			fprintf(stderr, "argument error: compression cannot be combined with -w, -M, -F or -R\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if( spectrum_mode )
+	{
+		if( (spectrum_fft_size < SPECTRUM_FFT_SIZE_MIN) || (spectrum_fft_size > SPECTRUM_FFT_SIZE_MAX) ||
+			((spectrum_fft_size & (spectrum_fft_size - 1)) != 0) ) {
+			fprintf(stderr, "argument error: spectrum fft_size shall be a power of 2 between %d and %d\n",
+				SPECTRUM_FFT_SIZE_MIN, SPECTRUM_FFT_SIZE_MAX);
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( (spectrum_averages < 1) || (spectrum_averages > SPECTRUM_AVERAGES_MAX) ) {
+			fprintf(stderr, "argument error: spectrum averages shall be between 1 and %d\n", SPECTRUM_AVERAGES_MAX);
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( spectrum_window > SPECTRUM_WINDOW_MAX ) {
+			fprintf(stderr, "argument error: spectrum window out of range\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( (sample_type_val != AIRSPY_SAMPLE_FLOAT32_IQ) && (sample_type_val != AIRSPY_SAMPLE_INT16_IQ) ) {
+			fprintf(stderr, "argument error: spectrum monitor requires FLOAT32_IQ or INT16_IQ\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+	}else if( spectrum_path != NULL ) {
+		fprintf(stderr, "argument error: -O requires -P\n");
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	if( rotate )
+	{
+		if( path == NULL ) {
+			fprintf(stderr, "argument error: file rotation requires -r or -w\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( (rotate_mb == 0) && (rotate_seconds == 0) ) {
+			fprintf(stderr, "argument error: rotation size_MB/seconds shall be greater than 0\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		rotate_bytes = (uint64_t)rotate_mb * FREQ_ONE_MHZ_U64;
+		rotate_samples = (uint64_t)rotate_seconds * wav_sample_per_sec;
+		rotate_samples = (rotate_samples + frame_samples() - 1) / frame_samples() * frame_samples();
+		rotate_path = path;
+		rx_file_name(path_file_rotate, rotate_path, rotate_index);
+		path = path_file_rotate;
+	}
+
+	if( ring_mode )
+	{
+		if( path == NULL ) {
+			fprintf(stderr, "argument error: flight recorder requires -r or -w\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( rotate ) {
+			fprintf(stderr, "argument error: flight recorder and file rotation are exclusive\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( (ring_seconds == 0) || (ring_seconds > RING_SECONDS_MAX) ) {
+			fprintf(stderr, "argument error: flight recorder seconds shall be between 1 and %d\n", RING_SECONDS_MAX);
+			usage();
+			return EXIT_FAILURE;
+		}
+		if( sigmf ) {
+			fprintf(stderr, "argument error: flight recorder and SigMF metadata are exclusive\n");
+			usage();
+			return EXIT_FAILURE;
+		}
+		ring_snapshot_path = path;
+		snprintf(path_file_ring, PATH_FILE_MAX_LEN, "%.*s.ring", PATH_FILE_MAX_LEN - 6, path);
+	}
+
 	if(verbose == true)
 	{
 		uint32_t serial_number_msb_val;
@@ -751,7 +1794,15 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
-	if(serial_number == true)
+	if(replay_path != NULL)
+	{
+		result = airspy_open_file(&device, replay_path, replay_mode);
+		if( result != AIRSPY_SUCCESS ) {
+			fprintf(stderr, "airspy_open_file() failed: %s (%d)\n", airspy_error_name(result), result);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
+	}else if(serial_number == true)
 	{
 		result = airspy_open_sn(&device, serial_number_val);
 		if( result != AIRSPY_SUCCESS ) {
@@ -797,36 +1848,86 @@ int main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
+	if( squelch )
+	{
+		result = airspy_set_burst_gate(device, 2, squelch_dbfs, squelch_dbfs - SQUELCH_HYSTERESIS_DB,
+			squelch_preroll_ms, squelch_hold_ms);
+		if( result != AIRSPY_SUCCESS ) {
+			fprintf(stderr, "airspy_set_burst_gate() failed: %s (%d)\n", airspy_error_name(result), result);
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
+	}
+
 	result = airspy_set_rf_bias(device, biast_val);
 	if( result != AIRSPY_SUCCESS ) {
 		fprintf(stderr, "airspy_set_rf_bias() failed: %s (%d)\n", airspy_error_name(result), result);
 		airspy_close(device);
 		airspy_exit();
 		return EXIT_FAILURE;
-	}
-
-	if (path) fd = fopen(path, "wb");
-	else fd = stdout;
+	}
 
-	if( fd == NULL ) {
-		fprintf(stderr, "Failed to open file: %s\n", path);
-		airspy_close(device);
-		airspy_exit();
-		return EXIT_FAILURE;
+	if ((path == NULL) && direct_io)
+	{
+		fprintf(stderr, "Direct I/O is not supported on stdout, using stdio\n");
+		direct_io = false;
 	}
-	/* Change fd buffer to have bigger one to store data to file */
-	result = setvbuf(fd , NULL , _IOFBF , FD_BUFFER_SIZE);
-	if( result != 0 ) {
-		fprintf(stderr, "setvbuf() failed: %d\n", result);
-		airspy_close(device);
-		airspy_exit();
-		return EXIT_FAILURE;
+
+	if( ring_mode )
+	{
+		ring_snapshot_bytes = (uint64_t)ring_seconds * wav_sample_per_sec / frame_samples() * frame_size();
+		ring = ring_recorder_open(path_file_ring, (uint64_t)(ring_seconds +
+			((ring_seconds < RING_HEADROOM_SECONDS_MAX) ? ring_seconds : RING_HEADROOM_SECONDS_MAX)) *
+			wav_sample_per_sec / frame_samples() * frame_size(), frame_size(), wav_sample_per_sec, sample_type_val);
+		if( ring == NULL ) {
+			fprintf(stderr, "Failed to create flight recorder file: %s (%s)\n", path_file_ring, strerror(errno));
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
+		if( ring_snapshot_thread_start() != 0 ) {
+			fprintf(stderr, "Failed to start the flight recorder snapshot thread\n");
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
+		fprintf(stderr, "Flight recorder file: %s, send SIGUSR1 to save a snapshot\n", path_file_ring);
+	}else if( (path != NULL) || !spectrum_mode )
+	{
+		rx_file = rx_file_open(path, rx_file_reserve(bytes_to_xfer));
+		if( rx_file == NULL ) {
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
+		if( rotate && (rx_file_thread_start() != 0) ) {
+			fprintf(stderr, "Failed to start the file rotation thread\n");
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
 	}
 
-	/* Write Wav header */
-	if( receive_wav )
+	if( spectrum_mode )
 	{
-		fwrite(&wave_file_hdr, 1, sizeof(t_wav_file_hdr), fd);
+		if( spectrum_path != NULL ) {
+			spectrum_file = fopen(spectrum_path, "w");
+			if( spectrum_file == NULL ) {
+				fprintf(stderr, "Failed to open file: %s (%s)\n", spectrum_path, strerror(errno));
+				airspy_close(device);
+				airspy_exit();
+				return EXIT_FAILURE;
+			}
+		}
+		spectrum = spectrum_open(spectrum_fft_size, spectrum_averages, spectrum_window, sample_type_val,
+			wav_sample_per_sec, freq_hz, wav_sample_per_sec, spectrum_file);
+		if( spectrum == NULL ) {
+			fprintf(stderr, "Failed to start the spectrum monitor\n");
+			airspy_close(device);
+			airspy_exit();
+			return EXIT_FAILURE;
+		}
 	}
 
 #ifdef _MSC_VER
@@ -838,6 +1939,9 @@ int main(int argc, char** argv)
 	signal(SIGSEGV, &sigint_callback_handler);
 	signal(SIGTERM, &sigint_callback_handler);
 	signal(SIGABRT, &sigint_callback_handler);
+#ifdef SIGUSR1
+	signal(SIGUSR1, &sigusr1_callback_handler);
+#endif
 #endif
 
 	result = airspy_set_vga_gain(device, vga_gain);
@@ -884,6 +1988,8 @@ int main(int argc, char** argv)
 		sprintf(str, "%2.2f", average_rate_now);
 		average_rate_now = 9.5f;
 		fprintf(stderr, "Streaming at %5s MSPS\n", str);
+		if (ring != NULL)
+			ring_recorder_sync(ring);
 		if ((limit_num_samples == true) && (bytes_to_xfer == 0))
 			do_exit = true;
 		else
@@ -905,6 +2011,10 @@ int main(int argc, char** argv)
 	{
 		fprintf(stderr, "Average speed %2.4f MSPS %s\n", (global_average_rate * 1e-6f / rate_samples), (wav_nb_channels == 2 ? "IQ" : "Real"));
 	}
+	if (dropped_samples > 0)
+	{
+		fprintf(stderr, "Dropped samples: %s\n", u64toa(dropped_samples, &ascii_u64_data1));
+	}
 
 	if(device != NULL)
 	{
@@ -922,30 +2032,47 @@ int main(int argc, char** argv)
 		airspy_exit();
 	}
 
-	if(fd != NULL)
+	/* After the stop, which delivers the pre-roll still delayed */
+	if (squelch)
 	{
-		if( receive_wav )
-		{
-			/* Get size of file */
-			file_pos = ftell(fd);
-			/* Wav Header */
-			wave_file_hdr.hdr.size = file_pos - 8;
-			/* Wav Format Chunk */
-			wave_file_hdr.fmt_chunk.wFormatTag = wav_format_tag;
-			wave_file_hdr.fmt_chunk.wChannels = wav_nb_channels;
-			wave_file_hdr.fmt_chunk.dwSamplesPerSec = wav_sample_per_sec;
-			wave_file_hdr.fmt_chunk.dwAvgBytesPerSec = wave_file_hdr.fmt_chunk.dwSamplesPerSec * wav_nb_byte_per_sample;
-			wave_file_hdr.fmt_chunk.wBlockAlign = wav_nb_channels * (wav_nb_bits_per_sample / 8);
-			wave_file_hdr.fmt_chunk.wBitsPerSample = wav_nb_bits_per_sample;
-			/* Wav Data Chunk */
-			wave_file_hdr.data_chunk.chunkSize = file_pos - sizeof(t_wav_file_hdr);
-			/* Overwrite header with updated data */
-			rewind(fd);
-			fwrite(&wave_file_hdr, 1, sizeof(t_wav_file_hdr), fd);
-		}
-		fclose(fd);
-		fd = NULL;
+		fprintf(stderr, "Squelch: %u burst(s), %s samples written, %s below the squelch\n", squelch_bursts,
+			u64toa(squelch_kept, &ascii_u64_data1), u64toa(squelch_skipped, &ascii_u64_data2));
 	}
+
+	if (rx_file_thread_stop() != 0)
+		exit_code = EXIT_FAILURE;
+
+	if(rx_file != NULL)
+	{
+		if (rx_file_close(rx_file) != 0)
+			exit_code = EXIT_FAILURE;
+		rx_file = NULL;
+	}
+
+	if(ring != NULL)
+	{
+		if (ring_snapshot_thread_stop() != 0)
+			exit_code = EXIT_FAILURE;
+		if (ring_recorder_close(ring) != 0)
+			exit_code = EXIT_FAILURE;
+		ring = NULL;
+	}
+
+	if(spectrum != NULL)
+	{
+		if (spectrum_skipped(spectrum) > 0)
+			fprintf(stderr, "Spectrum frames skipped: %s\n", u64toa(spectrum_skipped(spectrum), &ascii_u64_data1));
+		spectrum_close(spectrum);
+		spectrum = NULL;
+	}
+
+	if(spectrum_file != NULL)
+	{
+		if (fclose(spectrum_file) != 0)
+			exit_code = EXIT_FAILURE;
+		spectrum_file = NULL;
+	}
+
 	fprintf(stderr, "done\n");
 	return exit_code;
 }
@@ -0,0 +1,870 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* O_DIRECT, sync_file_range(), fallocate() */
+#endif
+
+#include "file_writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#ifdef _MSC_VER
+#define fseeko _fseeki64
+#endif
+
+#define FILE_WRITER_ALIGNMENT (4096)
+#define FILE_WRITER_MAX_THREADS (4)
+
+#define SLOT_FREE (0)
+#define SLOT_BUSY (1)
+
+#define BACKEND_STDIO (0)
+#define BACKEND_THREADS (1)
+#define BACKEND_IO_URING (2)
+
+#ifndef _WIN32
+
+typedef struct
+{
+	unsigned char* data;
+	uint64_t offset;
+	uint32_t length;
+	volatile int state;
+#ifdef HAVE_IO_URING
+	struct iovec iov;
+#endif
+} file_writer_slot_t;
+
+#ifdef HAVE_IO_URING
+
+typedef struct
+{
+	int fd;
+	unsigned entries;
+	void* sq_ptr;
+	size_t sq_size;
+	void* cq_ptr;
+	size_t cq_size;
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+	uint32_t in_flight; /* Writes submitted and not reaped yet */
+} file_writer_uring_t;
+
+#endif
+
+#endif
+
+struct file_writer
+{
+	int backend;
+	uint64_t position;
+	uint64_t preallocated;
+	FILE* stream;
+#ifndef _WIN32
+	int fd;
+	int direct;
+	int error;
+	uint32_t buffer_size;
+	uint32_t queue_depth;
+	file_writer_slot_t* slots;
+	uint32_t current;
+	uint32_t fill;
+	uint64_t flushed;
+	/* BACKEND_THREADS */
+	pthread_t threads[FILE_WRITER_MAX_THREADS];
+	int thread_count;
+	pthread_mutex_t mp;
+	pthread_cond_t submit_cv;
+	pthread_cond_t done_cv;
+	uint32_t submitted;
+	uint32_t taken;
+	bool stop;
+#ifdef HAVE_IO_URING
+	file_writer_uring_t ring;
+#endif
+#endif
+};
+
+#ifndef _WIN32
+
+static int get_fd(file_writer_t* writer)
+{
+	return (writer->backend == BACKEND_STDIO) ? fileno(writer->stream) : writer->fd;
+}
+
+/* Give back the preallocated blocks past the end of the data */
+static void release_preallocated(file_writer_t* writer)
+{
+#ifdef __linux__
+	if (writer->preallocated > writer->position)
+	{
+		fallocate(get_fd(writer), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			(off_t) writer->position, (off_t)(writer->preallocated - writer->position));
+	}
+#endif
+	writer->preallocated = 0;
+}
+
+static int write_all(int fd, const unsigned char* data, uint32_t length, uint64_t offset)
+{
+	ssize_t result;
+
+	while (length > 0)
+	{
+		result = pwrite(fd, data, length, (off_t) offset);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += result;
+		offset += result;
+		length -= (uint32_t) result;
+	}
+	return 0;
+}
+
+static void* writer_threadproc(void* arg)
+{
+	file_writer_t* writer = (file_writer_t*) arg;
+	file_writer_slot_t* slot;
+	int result;
+
+	pthread_mutex_lock(&writer->mp);
+	while (true)
+	{
+		while (writer->taken == writer->submitted && !writer->stop)
+		{
+			pthread_cond_wait(&writer->submit_cv, &writer->mp);
+		}
+		if (writer->taken == writer->submitted)
+		{
+			break;
+		}
+		slot = &writer->slots[writer->taken % writer->queue_depth];
+		writer->taken++;
+		pthread_mutex_unlock(&writer->mp);
+
+		result = write_all(writer->fd, slot->data, slot->length, slot->offset);
+#ifdef __linux__
+		if (result == 0 && !writer->direct)
+		{
+			/* No O_DIRECT on this filesystem, at least keep the page cache clean */
+			sync_file_range(writer->fd, (off_t) slot->offset, slot->length,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(writer->fd, (off_t) slot->offset, slot->length, POSIX_FADV_DONTNEED);
+		}
+#endif
+
+		pthread_mutex_lock(&writer->mp);
+		if (result != 0)
+		{
+			writer->error = errno;
+		}
+		slot->state = SLOT_FREE;
+		pthread_cond_broadcast(&writer->done_cv);
+	}
+	pthread_mutex_unlock(&writer->mp);
+
+	return NULL;
+}
+
+#ifdef HAVE_IO_URING
+
+static int uring_setup(file_writer_uring_t* ring, unsigned entries)
+{
+	struct io_uring_params params;
+
+	memset(ring, 0, sizeof(file_writer_uring_t));
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0)
+	{
+		return -1;
+	}
+	ring->entries = params.sq_entries;
+
+	ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		if (ring->sq_ptr != MAP_FAILED)
+			munmap(ring->sq_ptr, ring->sq_size);
+		if (ring->cq_ptr != MAP_FAILED)
+			munmap(ring->cq_ptr, ring->cq_size);
+		if (ring->sqes != MAP_FAILED)
+			munmap(ring->sqes, ring->sqes_size);
+		close(ring->fd);
+		ring->fd = -1;
+		return -1;
+	}
+
+	ring->sq_head = (unsigned*) ((char*) ring->sq_ptr + params.sq_off.head);
+	ring->sq_tail = (unsigned*) ((char*) ring->sq_ptr + params.sq_off.tail);
+	ring->sq_mask = (unsigned*) ((char*) ring->sq_ptr + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) ((char*) ring->sq_ptr + params.sq_off.array);
+	ring->cq_head = (unsigned*) ((char*) ring->cq_ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned*) ((char*) ring->cq_ptr + params.cq_off.tail);
+	ring->cq_mask = (unsigned*) ((char*) ring->cq_ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) ((char*) ring->cq_ptr + params.cq_off.cqes);
+
+	return 0;
+}
+
+static void uring_free(file_writer_uring_t* ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	munmap(ring->cq_ptr, ring->cq_size);
+	munmap(ring->sq_ptr, ring->sq_size);
+	close(ring->fd);
+	ring->fd = -1;
+}
+
+static int uring_submit(file_writer_t* writer, uint32_t slot_index)
+{
+	file_writer_uring_t* ring = &writer->ring;
+	file_writer_slot_t* slot = &writer->slots[slot_index];
+	struct io_uring_sqe* sqe;
+	unsigned tail;
+	unsigned index;
+	int result;
+
+	tail = *ring->sq_tail;
+	index = tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	/* IORING_OP_WRITEV rather than IORING_OP_WRITE, it only needs a 5.1 kernel */
+	slot->iov.iov_base = slot->data;
+	slot->iov.iov_len = slot->length;
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = writer->fd;
+	sqe->off = slot->offset;
+	sqe->addr = (unsigned long) &slot->iov;
+	sqe->len = 1;
+	sqe->user_data = slot_index;
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do
+	{
+		result = (int) syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	} while (result < 0 && errno == EINTR);
+
+	if (result != 1)
+	{
+		return -1;
+	}
+	ring->in_flight++;
+	return 0;
+}
+
+/*
+ * Reap completions, block until at least one is available if wait is set.
+ * Return -1 if the ring cannot be waited on any more, the writes in flight are then never reaped.
+ */
+static int uring_reap(file_writer_t* writer, bool wait)
+{
+	file_writer_uring_t* ring = &writer->ring;
+	struct io_uring_cqe* cqe;
+	file_writer_slot_t* slot;
+	unsigned head;
+	int result;
+
+	if (wait)
+	{
+		do
+		{
+			result = (int) syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		} while (result < 0 && errno == EINTR);
+
+		/* EAGAIN and EBUSY only ask for the completions to be reaped */
+		if (result < 0 && errno != EAGAIN && errno != EBUSY)
+		{
+			writer->error = errno;
+			return -1;
+		}
+	}
+
+	head = *ring->cq_head;
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		slot = &writer->slots[cqe->user_data];
+
+		if (cqe->res < 0)
+		{
+			writer->error = -cqe->res;
+		}
+		else if ((uint32_t) cqe->res != slot->length)
+		{
+			/* Short direct write, finish it synchronously */
+			if (write_all(writer->fd, slot->data + cqe->res, slot->length - cqe->res, slot->offset + cqe->res) != 0)
+			{
+				writer->error = errno;
+			}
+		}
+		slot->state = SLOT_FREE;
+		ring->in_flight--;
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+#endif
+
+static void submit_slot(file_writer_t* writer, uint32_t slot_index)
+{
+	file_writer_slot_t* slot = &writer->slots[slot_index];
+
+	slot->state = SLOT_BUSY;
+
+#ifdef HAVE_IO_URING
+	if (writer->backend == BACKEND_IO_URING)
+	{
+		if (uring_submit(writer, slot_index) != 0)
+		{
+			writer->error = errno;
+			slot->state = SLOT_FREE;
+		}
+		return;
+	}
+#endif
+
+	pthread_mutex_lock(&writer->mp);
+	writer->submitted++;
+	pthread_cond_signal(&writer->submit_cv);
+	pthread_mutex_unlock(&writer->mp);
+}
+
+static void wait_slot(file_writer_t* writer, uint32_t slot_index)
+{
+	file_writer_slot_t* slot = &writer->slots[slot_index];
+
+#ifdef HAVE_IO_URING
+	if (writer->backend == BACKEND_IO_URING)
+	{
+		/* Reaped even after an error, the kernel may still be reading the buffer */
+		while (slot->state != SLOT_FREE)
+		{
+			if (uring_reap(writer, true) != 0)
+			{
+				break;
+			}
+		}
+		return;
+	}
+#endif
+
+	pthread_mutex_lock(&writer->mp);
+	while (slot->state != SLOT_FREE)
+	{
+		pthread_cond_wait(&writer->done_cv, &writer->mp);
+	}
+	pthread_mutex_unlock(&writer->mp);
+}
+
+static void drain_slots(file_writer_t* writer)
+{
+	uint32_t i;
+
+	for (i = 0; i < writer->queue_depth; i++)
+	{
+		if (i != writer->current)
+		{
+			wait_slot(writer, i);
+		}
+	}
+}
+
+static int set_direct(file_writer_t* writer, bool enable)
+{
+#ifdef O_DIRECT
+	int flags;
+
+	if (!writer->direct)
+	{
+		return 0;
+	}
+
+	flags = fcntl(writer->fd, F_GETFL);
+	if (flags < 0)
+	{
+		return -1;
+	}
+	flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+	return fcntl(writer->fd, F_SETFL, flags);
+#else
+	return 0;
+#endif
+}
+
+static void free_slots(file_writer_t* writer)
+{
+	uint32_t i;
+
+	if (writer->slots != NULL)
+	{
+		for (i = 0; i < writer->queue_depth; i++)
+		{
+			free(writer->slots[i].data);
+		}
+		free(writer->slots);
+		writer->slots = NULL;
+	}
+}
+
+static file_writer_t* direct_open(const char* path, uint32_t buffer_size, uint32_t queue_depth)
+{
+	file_writer_t* writer;
+	uint32_t i;
+	int flags;
+	int thread_count;
+
+	if (buffer_size == 0 || (buffer_size % FILE_WRITER_ALIGNMENT) != 0 || queue_depth < 2)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	writer = (file_writer_t*) calloc(1, sizeof(file_writer_t));
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+	writer->buffer_size = buffer_size;
+	writer->queue_depth = queue_depth;
+
+	flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+	writer->fd = open(path, flags | O_DIRECT, 0644);
+	writer->direct = (writer->fd >= 0);
+	if (writer->fd < 0 && errno == EINVAL)
+	{
+		/* Filesystem without O_DIRECT support (e.g. tmpfs) */
+		writer->fd = open(path, flags, 0644);
+	}
+#else
+	writer->fd = open(path, flags, 0644);
+#endif
+	if (writer->fd < 0)
+	{
+		free(writer);
+		return NULL;
+	}
+
+	writer->slots = (file_writer_slot_t*) calloc(queue_depth, sizeof(file_writer_slot_t));
+	if (writer->slots == NULL)
+	{
+		close(writer->fd);
+		free(writer);
+		return NULL;
+	}
+
+	for (i = 0; i < queue_depth; i++)
+	{
+		if (posix_memalign((void**) &writer->slots[i].data, FILE_WRITER_ALIGNMENT, buffer_size) != 0)
+		{
+			free_slots(writer);
+			close(writer->fd);
+			free(writer);
+			errno = ENOMEM;
+			return NULL;
+		}
+		writer->slots[i].state = SLOT_FREE;
+	}
+
+#ifdef HAVE_IO_URING
+	if (writer->direct && uring_setup(&writer->ring, queue_depth) == 0)
+	{
+		writer->backend = BACKEND_IO_URING;
+		return writer;
+	}
+#endif
+
+	/* Portable fallback, a few threads each keeping one pwrite() in flight */
+	writer->backend = BACKEND_THREADS;
+	pthread_mutex_init(&writer->mp, NULL);
+	pthread_cond_init(&writer->submit_cv, NULL);
+	pthread_cond_init(&writer->done_cv, NULL);
+
+	thread_count = (queue_depth - 1) < FILE_WRITER_MAX_THREADS ? (int)(queue_depth - 1) : FILE_WRITER_MAX_THREADS;
+	for (writer->thread_count = 0; writer->thread_count < thread_count; writer->thread_count++)
+	{
+		if (pthread_create(&writer->threads[writer->thread_count], NULL, writer_threadproc, writer) != 0)
+		{
+			break;
+		}
+	}
+
+	if (writer->thread_count == 0)
+	{
+		pthread_cond_destroy(&writer->done_cv);
+		pthread_cond_destroy(&writer->submit_cv);
+		pthread_mutex_destroy(&writer->mp);
+		free_slots(writer);
+		close(writer->fd);
+		free(writer);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return writer;
+}
+
+static int direct_write(file_writer_t* writer, const unsigned char* data, uint32_t length)
+{
+	file_writer_slot_t* slot;
+	uint32_t chunk;
+
+	while (length > 0)
+	{
+		if (writer->error != 0)
+		{
+			return -1;
+		}
+
+		slot = &writer->slots[writer->current];
+		chunk = writer->buffer_size - writer->fill;
+		if (chunk > length)
+		{
+			chunk = length;
+		}
+		memcpy(slot->data + writer->fill, data, chunk);
+		writer->fill += chunk;
+		data += chunk;
+		length -= chunk;
+
+		if (writer->fill == writer->buffer_size)
+		{
+			slot->offset = writer->flushed;
+			slot->length = writer->buffer_size;
+			submit_slot(writer, writer->current);
+
+			writer->flushed += writer->buffer_size;
+			writer->fill = 0;
+			writer->current = (writer->current + 1) % writer->queue_depth;
+			wait_slot(writer, writer->current);
+		}
+	}
+
+	return (writer->error == 0) ? 0 : -1;
+}
+
+static int direct_pwrite(file_writer_t* writer, const unsigned char* data, uint32_t length, uint64_t offset)
+{
+	uint32_t on_disk;
+	int result;
+
+	drain_slots(writer);
+	if (writer->error != 0)
+	{
+		return -1;
+	}
+
+	/* Bytes still sitting in the buffer being filled are patched in memory */
+	result = 0;
+	on_disk = 0;
+	if (offset < writer->flushed)
+	{
+		on_disk = (offset + length <= writer->flushed) ? length : (uint32_t)(writer->flushed - offset);
+		set_direct(writer, false);
+		result = write_all(writer->fd, data, on_disk, offset);
+		set_direct(writer, true);
+	}
+	if (on_disk < length)
+	{
+		memcpy(writer->slots[writer->current].data + (offset + on_disk - writer->flushed), data + on_disk, length - on_disk);
+	}
+
+	return result;
+}
+
+static int direct_close(file_writer_t* writer)
+{
+	int result;
+	int i;
+
+	drain_slots(writer);
+
+	/* The tail is shorter than the direct I/O alignment, write it through the page cache */
+	result = (writer->error == 0) ? 0 : -1;
+	if (writer->fill > 0 && result == 0)
+	{
+		set_direct(writer, false);
+		result = write_all(writer->fd, writer->slots[writer->current].data, writer->fill, writer->flushed);
+	}
+	release_preallocated(writer);
+
+#ifdef HAVE_IO_URING
+	if (writer->backend == BACKEND_IO_URING)
+	{
+		if (writer->ring.in_flight != 0)
+		{
+			/* The ring died with writes in flight, their buffers cannot be given back */
+			close(writer->fd);
+			return -1;
+		}
+		uring_free(&writer->ring);
+	}
+#endif
+
+	if (writer->backend == BACKEND_THREADS)
+	{
+		pthread_mutex_lock(&writer->mp);
+		writer->stop = true;
+		pthread_cond_broadcast(&writer->submit_cv);
+		pthread_mutex_unlock(&writer->mp);
+
+		for (i = 0; i < writer->thread_count; i++)
+		{
+			pthread_join(writer->threads[i], NULL);
+		}
+
+		pthread_cond_destroy(&writer->done_cv);
+		pthread_cond_destroy(&writer->submit_cv);
+		pthread_mutex_destroy(&writer->mp);
+	}
+
+	free_slots(writer);
+
+	if (close(writer->fd) != 0)
+	{
+		result = -1;
+	}
+
+	return result;
+}
+
+#endif
+
+file_writer_t* file_writer_open_stream(FILE* stream, uint32_t buffer_size)
+{
+	file_writer_t* writer;
+
+	writer = (file_writer_t*) calloc(1, sizeof(file_writer_t));
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+
+	/* Change stream buffer to have bigger one to store data to file */
+	if (setvbuf(stream, NULL, _IOFBF, buffer_size) != 0)
+	{
+		free(writer);
+		return NULL;
+	}
+
+	writer->backend = BACKEND_STDIO;
+	writer->stream = stream;
+	return writer;
+}
+
+file_writer_t* file_writer_open(const char* path, int mode, uint32_t buffer_size, uint32_t queue_depth)
+{
+	file_writer_t* writer;
+	FILE* stream;
+
+	if (mode == FILE_WRITER_DIRECT)
+	{
+#ifndef _WIN32
+		return direct_open(path, buffer_size, queue_depth);
+#else
+		errno = EINVAL;
+		return NULL;
+#endif
+	}
+
+	stream = fopen(path, "wb");
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	writer = file_writer_open_stream(stream, buffer_size);
+	if (writer == NULL)
+	{
+		fclose(stream);
+	}
+	return writer;
+}
+
+int file_writer_write(file_writer_t* writer, const void* data, uint32_t length)
+{
+	int result;
+
+	if (writer->backend == BACKEND_STDIO)
+	{
+		result = (fwrite(data, 1, length, writer->stream) == length) ? 0 : -1;
+	}
+	else
+	{
+#ifndef _WIN32
+		result = direct_write(writer, (const unsigned char*) data, length);
+#else
+		result = -1;
+#endif
+	}
+
+	if (result != 0)
+	{
+		return -1;
+	}
+	writer->position += length;
+	return (int) length;
+}
+
+uint64_t file_writer_tell(file_writer_t* writer)
+{
+	return writer->position;
+}
+
+int file_writer_pwrite(file_writer_t* writer, const void* data, uint32_t length, uint64_t offset)
+{
+	int result;
+
+	if (offset + length > writer->position)
+	{
+		return -1;
+	}
+
+	if (writer->backend == BACKEND_STDIO)
+	{
+		if (fflush(writer->stream) != 0 || fseeko(writer->stream, offset, SEEK_SET) != 0)
+		{
+			return -1;
+		}
+		result = (fwrite(data, 1, length, writer->stream) == length) ? 0 : -1;
+		if (fseeko(writer->stream, 0, SEEK_END) != 0)
+		{
+			result = -1;
+		}
+		return result;
+	}
+
+#ifndef _WIN32
+	return direct_pwrite(writer, (const unsigned char*) data, length, offset);
+#else
+	return -1;
+#endif
+}
+
+int file_writer_preallocate(file_writer_t* writer, uint64_t size)
+{
+#ifdef __linux__
+	if (fallocate(get_fd(writer), FALLOC_FL_KEEP_SIZE, 0, (off_t) size) != 0)
+	{
+		return -1;
+	}
+	writer->preallocated = size;
+	return 0;
+#else
+	(void) writer;
+	(void) size;
+	return -1;
+#endif
+}
+
+int file_writer_close(file_writer_t* writer)
+{
+	int result;
+
+	if (writer->backend == BACKEND_STDIO)
+	{
+#ifndef _WIN32
+		if (writer->preallocated > 0 && fflush(writer->stream) == 0)
+		{
+			release_preallocated(writer);
+		}
+#endif
+		result = fclose(writer->stream);
+	}
+	else
+	{
+#ifndef _WIN32
+		result = direct_close(writer);
+#else
+		result = -1;
+#endif
+	}
+
+	free(writer);
+	return result;
+}
+
+const char* file_writer_backend_name(file_writer_t* writer)
+{
+	switch (writer->backend)
+	{
+	case BACKEND_STDIO:
+		return "stdio";
+
+#ifndef _WIN32
+	case BACKEND_THREADS:
+		return writer->direct ? "O_DIRECT, writer threads" : "buffered, writer threads";
+#endif
+
+	case BACKEND_IO_URING:
+		return "O_DIRECT, io_uring";
+
+	default:
+		return "unknown";
+	}
+}
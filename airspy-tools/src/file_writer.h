@@ -0,0 +1,54 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FILE_WRITER_STDIO (0)  /* Buffered stdio stream (default) */
+#define FILE_WRITER_DIRECT (1) /* O_DIRECT with io_uring or writer threads, bypasses the page cache */
+
+#define FILE_WRITER_DIRECT_BUFFER_SIZE (1024*1024)
+#define FILE_WRITER_DIRECT_QUEUE_DEPTH (8)
+
+typedef struct file_writer file_writer_t;
+
+/* buffer_size is the stdio buffer size or the size of each aligned direct I/O buffer,
+   queue_depth is the number of direct I/O buffers which can be in flight at once */
+file_writer_t* file_writer_open(const char* path, int mode, uint32_t buffer_size, uint32_t queue_depth);
+/* Wrap an already opened stream (e.g. stdout), always FILE_WRITER_STDIO */
+file_writer_t* file_writer_open_stream(FILE* stream, uint32_t buffer_size);
+
+/* Return length on success, -1 on error */
+int file_writer_write(file_writer_t* writer, const void* data, uint32_t length);
+/* Number of bytes written since open */
+uint64_t file_writer_tell(file_writer_t* writer);
+/* Overwrite bytes already written (e.g. a file header), return 0 on success */
+int file_writer_pwrite(file_writer_t* writer, const void* data, uint32_t length, uint64_t offset);
+/* Reserve disk space for size bytes without changing the file size, unused space is released on close.
+   Return 0 on success, -1 if the platform or filesystem cannot preallocate */
+int file_writer_preallocate(file_writer_t* writer, uint64_t size);
+/* Flush pending data and close the file, return 0 on success */
+int file_writer_close(file_writer_t* writer);
+
+const char* file_writer_backend_name(file_writer_t* writer);
+
+#endif /* FILE_WRITER_H */
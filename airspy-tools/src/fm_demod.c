@@ -0,0 +1,661 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#include "fm_demod.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FM_SSE
+#endif
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#define FM_PI (3.14159265358979323846)
+#define FM_CHUNK (4096) /* IQ samples per pass */
+#define FM_ATTENUATION (60.0) /* Stopband of the filters, dB */
+#define FM_MAX_STAGE_FACTOR (16)
+#define FM_IF_MARGIN (1.25) /* Minimum IF rate over the channel width */
+#define FM_ADJACENT_STOP (1.5) /* Stopband edge of the channel filter over half the channel width */
+#define FM_STAGE_COPY_COST (4.0)
+#define FM_USABLE_BAND (0.45) /* Fraction of the sample rate usable on each side of the center */
+#define FM_DEFAULT_AUDIO_RATE (50000)
+
+typedef struct
+{
+	int factor;
+	int len; /* Taps, multiple of 4 */
+	bool complex_data;
+	float* taps_re; /* In window order, oldest sample first, each tap twice for complex data */
+	float* taps_im; /* Complex taps, NULL for real ones */
+	float* buffer; /* Samples not consumed yet */
+	int fill;
+	int next; /* First sample of the next output window */
+} fm_stage_t;
+
+struct fm_channel
+{
+	fm_params_t params;
+	uint32_t if_rate;
+	int stage_count;
+	fm_stage_t stages[FM_MAX_STAGES]; /* Channel filter, the mixer folded into the first one */
+	fm_stage_t audio;
+	double rot_re; /* e^-jwn for the newest sample n of the next first stage output */
+	double rot_im;
+	double step_re; /* e^-jw per first stage output */
+	double step_im;
+	float disc_scale; /* Radians per IF sample to audio */
+	float deemph_alpha;
+	float deemph_state;
+	float* ping; /* Between the channel filter stages */
+	float* pong;
+	float* if_samples; /* The previous IF sample then the IF samples of a pass */
+	float* demod;
+	float* audio_out;
+};
+
+void fm_params_default(fm_params_t* params, int mode, uint32_t sample_rate)
+{
+	params->sample_rate = sample_rate;
+	params->offset_hz = 0;
+	params->audio_rate = FM_DEFAULT_AUDIO_RATE;
+	if (mode == FM_MODE_NARROW)
+	{
+		params->bandwidth = 12500;
+		params->deviation = 2500;
+		params->deemphasis_us = 0;
+		params->audio_cutoff = 3500;
+	}
+	else
+	{
+		params->bandwidth = 200000;
+		params->deviation = 75000;
+		params->deemphasis_us = 50;
+		params->audio_cutoff = 15000;
+	}
+}
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/* Taps of a Kaiser lowpass, rounded up to a multiple of 4 */
+static int lowpass_len(double pass, double stop, double rate)
+{
+	int n;
+
+	n = (int) ceil((FM_ATTENUATION - 8.0) / (14.36 * (stop - pass) / rate)) + 1;
+	return (n + 3) & ~3;
+}
+
+/* Stopband edge of a channel filter stage decimating to rate */
+static double channel_stop(double pass, double rate, bool last)
+{
+	/* Everything aliasing onto the channel is in the stopband, the last stage also rejects the adjacent channels */
+	double stop = rate - pass;
+
+	if (last && stop > FM_ADJACENT_STOP * pass)
+		stop = FM_ADJACENT_STOP * pass;
+	return stop;
+}
+
+/*
+ * Cheapest sequence of stage factors decimating by n from rate, in multiplications per input sample.
+ * The first stage has complex taps when shifting, 4 multiplications per tap instead of 2, and each
+ * stage copies its input for about FM_STAGE_COPY_COST multiplications per sample.
+ */
+static double plan_stages(double pass, double sample_rate, double rate, uint32_t n, bool shift, int depth,
+	int* factors, int* count)
+{
+	int best_factors[FM_MAX_STAGES];
+	int sub_factors[FM_MAX_STAGES];
+	double best = HUGE_VAL;
+	double next_rate, cost;
+	int best_count = 0;
+	int sub_count;
+	uint32_t d;
+
+	if (depth == FM_MAX_STAGES)
+		return HUGE_VAL;
+
+	for (d = 2; d <= n; d++)
+	{
+		/* A prime factor above FM_MAX_STAGE_FACTOR is a stage of its own */
+		if (n % d != 0 || (d > FM_MAX_STAGE_FACTOR && d != n))
+			continue;
+
+		next_rate = rate / d;
+		cost = lowpass_len(pass, channel_stop(pass, next_rate, d == n), rate) * ((depth == 0 && shift) ? 4.0 : 2.0)
+			* next_rate / sample_rate + FM_STAGE_COPY_COST * rate / sample_rate;
+		sub_count = 0;
+		if (d < n)
+			cost += plan_stages(pass, sample_rate, next_rate, n / d, shift, depth + 1, sub_factors, &sub_count);
+		if (cost < best)
+		{
+			best = cost;
+			best_factors[0] = (int) d;
+			memcpy(best_factors + 1, sub_factors, sub_count * sizeof(int));
+			best_count = sub_count + 1;
+		}
+	}
+
+	memcpy(factors, best_factors, best_count * sizeof(int));
+	*count = best_count;
+	return best;
+}
+
+/* Kaiser windowed sinc lowpass with unity gain, *len taps rounded up to a multiple of 4 */
+static double* design_lowpass(double pass, double stop, double rate, int* len)
+{
+	double beta = 0.1102 * (FM_ATTENUATION - 8.7);
+	double fc = (pass + stop) / 2.0 / rate;
+	double center, x, sum;
+	double* h;
+	int n, m;
+
+	n = lowpass_len(pass, stop, rate);
+	h = (double*) malloc(n * sizeof(double));
+	if (h == NULL)
+		return NULL;
+
+	center = (n - 1) / 2.0;
+	sum = 0.0;
+	for (m = 0; m < n; m++)
+	{
+		x = m - center;
+		h[m] = (x == 0.0) ? 2.0 * fc : sin(2.0 * FM_PI * fc * x) / (FM_PI * x);
+		h[m] *= bessel_i0(beta * sqrt(1.0 - (x / center) * (x / center))) / bessel_i0(beta);
+		sum += h[m];
+	}
+	for (m = 0; m < n; m++)
+	{
+		h[m] /= sum;
+	}
+
+	*len = n;
+	return h;
+}
+
+/* Decimating lowpass, shifted by omega radians per sample when not 0 */
+static int stage_init(fm_stage_t* st, int factor, double pass, double stop, double rate, bool complex_data, double omega)
+{
+	double* h;
+	int width = complex_data ? 2 : 1;
+	int p, k;
+
+	h = design_lowpass(pass, stop, rate, &st->len);
+	if (h == NULL)
+		return -1;
+
+	st->factor = factor;
+	st->complex_data = complex_data;
+	st->taps_re = (float*) malloc(st->len * width * sizeof(float));
+	st->taps_im = (omega != 0.0) ? (float*) malloc(st->len * width * sizeof(float)) : NULL;
+	st->buffer = (float*) malloc((st->len + FM_CHUNK) * width * sizeof(float));
+	st->fill = 0;
+	st->next = 0;
+	if (st->taps_re == NULL || (omega != 0.0 && st->taps_im == NULL) || st->buffer == NULL)
+	{
+		free(h);
+		return -1;
+	}
+
+	/* Window position p holds the sample k = len - 1 - p before the newest one */
+	for (p = 0; p < st->len; p++)
+	{
+		k = st->len - 1 - p;
+		if (!complex_data)
+		{
+			st->taps_re[p] = (float) h[k];
+		}
+		else
+		{
+			st->taps_re[2 * p] = st->taps_re[2 * p + 1] = (float) (h[k] * cos(omega * k));
+			if (st->taps_im != NULL)
+				st->taps_im[2 * p] = st->taps_im[2 * p + 1] = (float) (h[k] * sin(omega * k));
+		}
+	}
+
+	free(h);
+	return 0;
+}
+
+static void stage_free(fm_stage_t* st)
+{
+	free(st->taps_re);
+	free(st->taps_im);
+	free(st->buffer);
+}
+
+static float dot_real(const float* x, const float* h, int len)
+{
+	float sum;
+	int i = 0;
+#ifdef FM_SSE
+	float t[4];
+	__m128 acc = _mm_setzero_ps();
+
+	for (; i < len; i += 4)
+	{
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+	}
+	_mm_storeu_ps(t, acc);
+	sum = (t[0] + t[1]) + (t[2] + t[3]);
+#else
+	sum = 0.0f;
+	for (; i < len; i++)
+	{
+		sum += x[i] * h[i];
+	}
+#endif
+	return sum;
+}
+
+/* IQ samples with real taps */
+static void dot_complex(const float* x, const float* h, int len, float* out)
+{
+	int i = 0;
+#ifdef FM_SSE
+	float t[4];
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+
+	for (; i < 2 * len; i += 8)
+	{
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+	}
+	_mm_storeu_ps(t, _mm_add_ps(acc0, acc1));
+	out[0] = t[0] + t[2];
+	out[1] = t[1] + t[3];
+#else
+	float re = 0.0f;
+	float im = 0.0f;
+
+	for (; i < 2 * len; i += 2)
+	{
+		re += x[i] * h[i];
+		im += x[i + 1] * h[i];
+	}
+	out[0] = re;
+	out[1] = im;
+#endif
+}
+
+/* IQ samples with complex taps */
+static void dot_complex_taps(const float* x, const float* hr, const float* hi, int len, float* out)
+{
+	int i = 0;
+#ifdef FM_SSE
+	float r[4];
+	float m[4];
+	__m128 v;
+	__m128 acc_r = _mm_setzero_ps();
+	__m128 acc_i = _mm_setzero_ps();
+
+	/* acc_r sums hr * I and hr * Q, acc_i sums hi * I and hi * Q */
+	for (; i < 2 * len; i += 4)
+	{
+		v = _mm_loadu_ps(x + i);
+		acc_r = _mm_add_ps(acc_r, _mm_mul_ps(v, _mm_loadu_ps(hr + i)));
+		acc_i = _mm_add_ps(acc_i, _mm_mul_ps(v, _mm_loadu_ps(hi + i)));
+	}
+	_mm_storeu_ps(r, acc_r);
+	_mm_storeu_ps(m, acc_i);
+	out[0] = (r[0] + r[2]) - (m[1] + m[3]);
+	out[1] = (r[1] + r[3]) + (m[0] + m[2]);
+#else
+	float re = 0.0f;
+	float im = 0.0f;
+
+	for (; i < 2 * len; i += 2)
+	{
+		re += x[i] * hr[i] - x[i + 1] * hi[i];
+		im += x[i + 1] * hr[i] + x[i] * hi[i];
+	}
+	out[0] = re;
+	out[1] = im;
+#endif
+}
+
+/* count samples in, return the outputs written */
+static int stage_process(fm_stage_t* st, const float* in, int count, float* out)
+{
+	int width = st->complex_data ? 2 : 1;
+	const float* x;
+	int n = 0;
+
+	memcpy(st->buffer + st->fill * width, in, count * width * sizeof(float));
+	st->fill += count;
+
+	while (st->next + st->len <= st->fill)
+	{
+		x = st->buffer + st->next * width;
+		if (!st->complex_data)
+			out[n] = dot_real(x, st->taps_re, st->len);
+		else if (st->taps_im == NULL)
+			dot_complex(x, st->taps_re, st->len, out + 2 * n);
+		else
+			dot_complex_taps(x, st->taps_re, st->taps_im, st->len, out + 2 * n);
+		n++;
+		st->next += st->factor;
+	}
+
+	/* Keep the samples from the next window on */
+	if (st->next >= st->fill)
+	{
+		st->next -= st->fill;
+		st->fill = 0;
+	}
+	else
+	{
+		memmove(st->buffer, st->buffer + st->next * width, (st->fill - st->next) * width * sizeof(float));
+		st->fill -= st->next;
+		st->next = 0;
+	}
+	return n;
+}
+
+/* Remaining frequency shift of the first stage outputs */
+static void rotate(fm_channel_t* ch, float* iq, int count)
+{
+	double re, im, t, mag;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		re = iq[2 * i];
+		im = iq[2 * i + 1];
+		iq[2 * i] = (float) (re * ch->rot_re - im * ch->rot_im);
+		iq[2 * i + 1] = (float) (re * ch->rot_im + im * ch->rot_re);
+		t = ch->rot_re * ch->step_re - ch->rot_im * ch->step_im;
+		ch->rot_im = ch->rot_re * ch->step_im + ch->rot_im * ch->step_re;
+		ch->rot_re = t;
+	}
+
+	mag = sqrt(ch->rot_re * ch->rot_re + ch->rot_im * ch->rot_im);
+	ch->rot_re /= mag;
+	ch->rot_im /= mag;
+}
+
+#ifdef FM_SSE
+/* atan2(y, x) within 1e-5 rad */
+static __m128 atan2_ps(__m128 y, __m128 x)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 ax = _mm_andnot_ps(sign, x);
+	__m128 ay = _mm_andnot_ps(sign, y);
+	__m128 a, s, r, mask;
+
+	a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_add_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+	s = _mm_mul_ps(a, a);
+	r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0464964749f), s), _mm_set1_ps(0.15931422f));
+	r = _mm_sub_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.327622764f));
+	r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), a);
+
+	mask = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(mask, _mm_sub_ps(_mm_set1_ps((float) (FM_PI / 2)), r)), _mm_andnot_ps(mask, r));
+	mask = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(mask, _mm_sub_ps(_mm_set1_ps((float) FM_PI), r)), _mm_andnot_ps(mask, r));
+	return _mm_or_ps(r, _mm_and_ps(sign, y));
+}
+#endif
+
+/* Phase step from the previous sample, iq[-2] and iq[-1] hold the one before iq[0] */
+static void discriminate(const float* iq, int count, float scale, float* out)
+{
+	int i = 0;
+#ifdef FM_SSE
+	__m128 a, b, ci, cq, pi, pq;
+	__m128 k = _mm_set1_ps(scale);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		a = _mm_loadu_ps(iq + 2 * i);
+		b = _mm_loadu_ps(iq + 2 * i + 4);
+		ci = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		cq = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		a = _mm_loadu_ps(iq + 2 * i - 2);
+		b = _mm_loadu_ps(iq + 2 * i + 2);
+		pi = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		pq = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+		/* Angle of the current sample times the conjugate of the previous one */
+		a = _mm_add_ps(_mm_mul_ps(ci, pi), _mm_mul_ps(cq, pq));
+		b = _mm_sub_ps(_mm_mul_ps(cq, pi), _mm_mul_ps(ci, pq));
+		_mm_storeu_ps(out + i, _mm_mul_ps(atan2_ps(b, a), k));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		out[i] = scale * (float) atan2(iq[2 * i + 1] * iq[2 * i - 2] - iq[2 * i] * iq[2 * i - 1],
+			iq[2 * i] * iq[2 * i - 2] + iq[2 * i + 1] * iq[2 * i - 1]);
+	}
+}
+
+static void deemphasize(fm_channel_t* ch, float* x, int count)
+{
+	float y = ch->deemph_state;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		y += ch->deemph_alpha * (x[i] - y);
+		x[i] = y;
+	}
+	ch->deemph_state = y;
+}
+
+static void to_pcm(const float* x, int count, int16_t* pcm)
+{
+	float v;
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		v = x[i] * 32767.0f;
+		if (v > 32767.0f)
+			v = 32767.0f;
+		else if (v < -32768.0f)
+			v = -32768.0f;
+		pcm[i] = (int16_t) floor(v + 0.5f);
+	}
+}
+
+fm_channel_t* fm_channel_open(const fm_params_t* params)
+{
+	fm_channel_t* ch;
+	uint32_t decimation;
+	uint32_t audio_factor;
+	uint32_t if_factor;
+	int factors[FM_MAX_STAGES];
+	double rate, next_rate, pass, stop, omega;
+	int i, t;
+
+	if (params->sample_rate == 0 || params->audio_rate == 0 || params->sample_rate % params->audio_rate != 0 ||
+		params->bandwidth == 0 || params->deviation == 0 ||
+		fabs((double) params->offset_hz) + params->bandwidth / 2.0 > FM_USABLE_BAND * params->sample_rate)
+	{
+		return NULL;
+	}
+
+	/* Smallest audio decimation leaving room for the channel at the IF rate */
+	decimation = params->sample_rate / params->audio_rate;
+	for (audio_factor = 1; audio_factor <= decimation / 2; audio_factor++)
+	{
+		if (decimation % audio_factor == 0 && (double) params->audio_rate * audio_factor >= FM_IF_MARGIN * params->bandwidth)
+			break;
+	}
+	if (audio_factor > decimation / 2)
+		return NULL;
+	if_factor = decimation / audio_factor;
+
+	if (plan_stages(params->bandwidth / 2.0, params->sample_rate, params->sample_rate, if_factor, params->offset_hz != 0, 0,
+		factors, &t) == HUGE_VAL)
+	{
+		return NULL;
+	}
+
+	ch = (fm_channel_t*) calloc(1, sizeof(fm_channel_t));
+	if (ch == NULL)
+		return NULL;
+
+	ch->params = *params;
+	ch->if_rate = params->audio_rate * audio_factor;
+	ch->stage_count = t;
+
+	omega = 2.0 * FM_PI * params->offset_hz / params->sample_rate;
+	rate = params->sample_rate;
+	pass = params->bandwidth / 2.0;
+	for (i = 0; i < t; i++)
+	{
+		next_rate = rate / factors[i];
+		stop = channel_stop(pass, next_rate, i == t - 1);
+		if (stage_init(&ch->stages[i], factors[i], pass, stop, rate, true, (i == 0) ? omega : 0.0) != 0)
+		{
+			ch->stage_count = i + 1;
+			fm_channel_close(ch);
+			return NULL;
+		}
+		rate = next_rate;
+	}
+
+	pass = (params->audio_cutoff < 0.4 * params->audio_rate) ? params->audio_cutoff : 0.4 * params->audio_rate;
+	stop = (params->audio_rate - pass < pass + params->audio_rate / 4.0) ? params->audio_rate - pass : pass + params->audio_rate / 4.0;
+	ch->ping = (float*) malloc(2 * (FM_CHUNK + 1) * sizeof(float));
+	ch->pong = (float*) malloc(2 * (FM_CHUNK + 1) * sizeof(float));
+	ch->if_samples = (float*) calloc(2 * (FM_CHUNK + 2), sizeof(float));
+	ch->demod = (float*) malloc((FM_CHUNK + 1) * sizeof(float));
+	ch->audio_out = (float*) malloc((FM_CHUNK + 1) * sizeof(float));
+	if (stage_init(&ch->audio, audio_factor, pass, stop, ch->if_rate, false, 0.0) != 0 ||
+		ch->ping == NULL || ch->pong == NULL || ch->if_samples == NULL || ch->demod == NULL || ch->audio_out == NULL)
+	{
+		fm_channel_close(ch);
+		return NULL;
+	}
+
+	/* The newest sample of the first output is len - 1 */
+	ch->rot_re = cos(-omega * (ch->stages[0].len - 1));
+	ch->rot_im = sin(-omega * (ch->stages[0].len - 1));
+	ch->step_re = cos(-omega * ch->stages[0].factor);
+	ch->step_im = sin(-omega * ch->stages[0].factor);
+
+	ch->disc_scale = (float) (ch->if_rate / (2.0 * FM_PI * params->deviation));
+	ch->deemph_alpha = (params->deemphasis_us > 0) ?
+		(float) (1.0 - exp(-1e6 / ((double) ch->if_rate * params->deemphasis_us))) : 1.0f;
+
+	return ch;
+}
+
+uint32_t fm_channel_process(fm_channel_t* ch, const float* iq, uint32_t count, int16_t* audio)
+{
+	uint32_t written = 0;
+	float* src;
+	float* dst;
+	float* t;
+	int n, m, s;
+
+	while (count > 0)
+	{
+		n = (count < FM_CHUNK) ? (int) count : FM_CHUNK;
+
+		m = stage_process(&ch->stages[0], iq, n, ch->ping);
+		if (ch->stages[0].taps_im != NULL)
+			rotate(ch, ch->ping, m);
+		src = ch->ping;
+		dst = ch->pong;
+		for (s = 1; s < ch->stage_count; s++)
+		{
+			m = stage_process(&ch->stages[s], src, m, dst);
+			t = src;
+			src = dst;
+			dst = t;
+		}
+
+		if (m > 0)
+		{
+			memcpy(ch->if_samples + 2, src, m * 2 * sizeof(float));
+			discriminate(ch->if_samples + 2, m, ch->disc_scale, ch->demod);
+			ch->if_samples[0] = ch->if_samples[2 * m];
+			ch->if_samples[1] = ch->if_samples[2 * m + 1];
+			deemphasize(ch, ch->demod, m);
+			m = stage_process(&ch->audio, ch->demod, m, ch->audio_out);
+			to_pcm(ch->audio_out, m, audio + written);
+			written += m;
+		}
+
+		iq += 2 * n;
+		count -= n;
+	}
+
+	return written;
+}
+
+int fm_channel_stages(fm_channel_t* ch, uint32_t* if_rate, int* factors, int* taps)
+{
+	int i;
+
+	*if_rate = ch->if_rate;
+	for (i = 0; i < ch->stage_count; i++)
+	{
+		factors[i] = ch->stages[i].factor;
+		taps[i] = ch->stages[i].len;
+	}
+	factors[i] = ch->audio.factor;
+	taps[i] = ch->audio.len;
+	return ch->stage_count + 1;
+}
+
+void fm_channel_close(fm_channel_t* ch)
+{
+	int i;
+
+	if (ch == NULL)
+		return;
+
+	for (i = 0; i < ch->stage_count; i++)
+	{
+		stage_free(&ch->stages[i]);
+	}
+	stage_free(&ch->audio);
+	free(ch->ping);
+	free(ch->pong);
+	free(ch->if_samples);
+	free(ch->demod);
+	free(ch->audio_out);
+	free(ch);
+}
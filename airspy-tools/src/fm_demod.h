@@ -0,0 +1,63 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef FM_DEMOD_H
+#define FM_DEMOD_H
+
+#include <stdint.h>
+
+/*
+ * FM demodulation of one channel of an AIRSPY_SAMPLE_FLOAT32_IQ stream.
+ *
+ * The channel filter is a cascade of FIR decimators down to the IF rate, the first one with the
+ * mixer folded into complex taps so that the frequency shift only costs a rotation per output.
+ * The polar discriminator, de-emphasis and audio filter then run at the IF rate, the audio filter
+ * decimating to the audio rate. The audio is 16 bit PCM, full scale at the nominal deviation.
+ */
+
+#define FM_MODE_WIDE (0) /* Broadcast, 200kHz, 75kHz deviation, 50us de-emphasis */
+#define FM_MODE_NARROW (1) /* 12.5kHz, 2.5kHz deviation, no de-emphasis */
+#define FM_MODE_MAX (FM_MODE_NARROW)
+
+#define FM_MAX_STAGES (8)
+
+typedef struct
+{
+	uint32_t sample_rate; /* IQ samples per second */
+	int32_t offset_hz; /* Channel frequency from the center */
+	uint32_t audio_rate; /* Shall divide sample_rate */
+	uint32_t bandwidth; /* Channel width in Hz */
+	uint32_t deviation; /* Hz giving a full scale audio sample */
+	uint32_t deemphasis_us; /* 0 for none */
+	uint32_t audio_cutoff; /* Hz */
+} fm_params_t;
+
+typedef struct fm_channel fm_channel_t;
+
+/* Parameters of mode with 50kHz audio at sample_rate, offset 0 */
+void fm_params_default(fm_params_t* params, int mode, uint32_t sample_rate);
+/* Return NULL if the rates or the channel do not fit */
+fm_channel_t* fm_channel_open(const fm_params_t* params);
+/* count IQ samples, the audio written has at most count * audio_rate / sample_rate + 1 samples. Return the audio samples */
+uint32_t fm_channel_process(fm_channel_t* channel, const float* iq, uint32_t count, int16_t* audio);
+/* IF rate and decimation factor and taps of each stage, the audio filter last. Return the stage count */
+int fm_channel_stages(fm_channel_t* channel, uint32_t* if_rate, int* factors, int* taps);
+void fm_channel_close(fm_channel_t* channel);
+
+#endif /* FM_DEMOD_H */
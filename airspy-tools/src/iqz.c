@@ -0,0 +1,847 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "iqz.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#define PREDICTOR_NONE (0)   /* x[n] */
+#define PREDICTOR_DELTA (1)  /* x[n] - x[n-1] */
+#define PREDICTOR_DELTA2 (2) /* x[n] - 2x[n-1] + x[n-2] */
+#define PREDICTOR_FS4 (3)    /* x[n] + x[n-2], signal around fs/4 (the AirSpy real IF) */
+#define PREDICTOR_COUNT (4)
+
+#define RICE_K_BITS (5)
+#define RICE_K_MAX (18)
+#define RICE_ESCAPE (31)
+#define ESCAPE_BITS (19) /* Largest zigzag residual of a 16bit signal is below 2^19 */
+
+#define JOB_FREE (0)
+#define JOB_QUEUED (1)
+#define JOB_DONE (2)
+
+#define JOBS_PER_THREAD (2)
+
+/* Bit I/O, MSB first */
+
+typedef struct
+{
+	uint8_t* p;
+	uint64_t acc;
+	int bits;
+} bit_writer_t;
+
+typedef struct
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	uint64_t acc; /* Next bits MSB aligned, unused bits are 0 */
+	int bits;
+	bool overrun;
+} bit_reader_t;
+
+static void put_bits(bit_writer_t* bw, uint32_t value, int n)
+{
+	bw->acc = (bw->acc << n) | value;
+	bw->bits += n;
+	while (bw->bits >= 8)
+	{
+		bw->bits -= 8;
+		*bw->p++ = (uint8_t)(bw->acc >> bw->bits);
+	}
+}
+
+static void put_zeros(bit_writer_t* bw, uint32_t n)
+{
+	while (n > 24)
+	{
+		put_bits(bw, 0, 24);
+		n -= 24;
+	}
+	put_bits(bw, 0, (int) n);
+}
+
+static void flush_bits(bit_writer_t* bw)
+{
+	if (bw->bits > 0)
+	{
+		put_bits(bw, 0, 8 - bw->bits);
+	}
+}
+
+static void refill(bit_reader_t* br)
+{
+	while (br->bits <= 56)
+	{
+		if (br->p < br->end)
+		{
+			br->acc |= (uint64_t)(*br->p++) << (56 - br->bits);
+		}
+		else if (br->bits <= 0)
+		{
+			br->overrun = true;
+			return;
+		}
+		else
+		{
+			return;
+		}
+		br->bits += 8;
+	}
+}
+
+static uint32_t get_bits(bit_reader_t* br, int n)
+{
+	uint32_t value;
+
+	if (n == 0)
+		return 0;
+	if (br->bits < n)
+	{
+		refill(br);
+		if (br->bits < n)
+		{
+			br->overrun = true;
+			return 0;
+		}
+	}
+	value = (uint32_t)(br->acc >> (64 - n));
+	br->acc <<= n;
+	br->bits -= n;
+	return value;
+}
+
+static int leading_zeros(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+	while ((x & 0x8000000000000000ull) == 0)
+	{
+		x <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/* Count of 0 bits before the next 1 */
+static uint32_t get_unary(bit_reader_t* br)
+{
+	uint32_t q;
+	int lz;
+
+	q = 0;
+	refill(br);
+	while (br->acc == 0)
+	{
+		if (br->overrun || br->bits <= 0)
+		{
+			br->overrun = true;
+			return 0;
+		}
+		q += br->bits;
+		br->bits = 0;
+		refill(br);
+	}
+	lz = leading_zeros(br->acc);
+	br->acc = (br->acc << lz) << 1; /* lz + 1 may be 64 */
+	br->bits -= lz + 1;
+	return q + lz;
+}
+
+/* Little endian serialization */
+
+static void put_u16(uint8_t* p, uint16_t v)
+{
+	p[0] = (uint8_t) v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t v)
+{
+	put_u16(p, (uint16_t) v);
+	put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put_u64(uint8_t* p, uint64_t v)
+{
+	put_u32(p, (uint32_t) v);
+	put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+	return get_u16(p) | ((uint32_t) get_u16(p + 2) << 16);
+}
+
+static uint64_t get_u64(const uint8_t* p)
+{
+	return get_u32(p) | ((uint64_t) get_u32(p + 4) << 32);
+}
+
+void iqz_file_header_pack(const iqz_file_header_t* header, uint8_t* dest)
+{
+	memcpy(dest, header->magic, 8);
+	put_u32(dest + 8, header->version);
+	put_u32(dest + 12, header->sample_type);
+	put_u32(dest + 16, header->sample_rate);
+	put_u32(dest + 20, header->channels);
+	put_u32(dest + 24, header->block_values);
+	put_u32(dest + 28, header->reserved);
+	put_u64(dest + 32, header->index_offset);
+	put_u64(dest + 40, header->value_count);
+}
+
+int iqz_file_header_unpack(iqz_file_header_t* header, const uint8_t* src)
+{
+	memcpy(header->magic, src, 8);
+	header->version = get_u32(src + 8);
+	header->sample_type = get_u32(src + 12);
+	header->sample_rate = get_u32(src + 16);
+	header->channels = get_u32(src + 20);
+	header->block_values = get_u32(src + 24);
+	header->reserved = get_u32(src + 28);
+	header->index_offset = get_u64(src + 32);
+	header->value_count = get_u64(src + 40);
+
+	if (memcmp(header->magic, IQZ_MAGIC, 8) != 0 || header->version != IQZ_VERSION ||
+		header->channels < 1 || header->channels > 2 || header->block_values == 0 ||
+		header->block_values > IQZ_BLOCK_VALUES)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+void iqz_block_header_pack(const iqz_block_header_t* header, uint8_t* dest)
+{
+	put_u32(dest, header->size);
+	put_u32(dest + 4, header->value_count);
+	dest[8] = header->predictor;
+	dest[9] = header->channels;
+	put_u16(dest + 10, header->shift);
+}
+
+void iqz_block_header_unpack(iqz_block_header_t* header, const uint8_t* src)
+{
+	header->size = get_u32(src);
+	header->value_count = get_u32(src + 4);
+	header->predictor = src[8];
+	header->channels = src[9];
+	header->shift = get_u16(src + 10);
+}
+
+/* Block coding */
+
+static uint32_t zigzag(int32_t r)
+{
+	return ((uint32_t) r << 1) ^ (uint32_t)(r >> 31);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+	return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+static int32_t predict(int predictor, const int16_t* x, uint32_t c)
+{
+	switch (predictor)
+	{
+	case PREDICTOR_DELTA:
+		return x[-(int) c];
+	case PREDICTOR_DELTA2:
+		return 2 * x[-(int) c] - x[-2 * (int) c];
+	case PREDICTOR_FS4:
+		return -x[-2 * (int) c];
+	default:
+		return 0;
+	}
+}
+
+static int select_predictor(const int16_t* src, uint32_t count, uint32_t c)
+{
+	uint64_t cost[PREDICTOR_COUNT];
+	int32_t x, x1, x2;
+	uint32_t i;
+	int p;
+	int best;
+
+	memset(cost, 0, sizeof(cost));
+	for (i = 2 * c; i < count; i++)
+	{
+		x = src[i];
+		x1 = src[i - c];
+		x2 = src[i - 2 * c];
+		cost[PREDICTOR_NONE] += (uint32_t) abs(x);
+		cost[PREDICTOR_DELTA] += (uint32_t) abs(x - x1);
+		cost[PREDICTOR_DELTA2] += (uint32_t) abs(x - 2 * x1 + x2);
+		cost[PREDICTOR_FS4] += (uint32_t) abs(x + x2);
+	}
+
+	best = PREDICTOR_NONE;
+	for (p = 1; p < PREDICTOR_COUNT; p++)
+	{
+		if (cost[p] < cost[best])
+			best = p;
+	}
+	return best;
+}
+
+/* Rice parameter with the smallest coded size, RICE_ESCAPE if raw values are smaller */
+static int select_rice_k(const uint32_t* u, uint32_t n, uint64_t sum)
+{
+	uint64_t mean;
+	uint64_t size;
+	uint64_t best_size;
+	uint32_t i;
+	int k;
+	int k0;
+	int best;
+
+	mean = sum / n;
+	k0 = 0;
+	while (k0 < RICE_K_MAX && (2ull << k0) <= mean)
+	{
+		k0++;
+	}
+
+	best = RICE_ESCAPE;
+	best_size = (uint64_t) n * ESCAPE_BITS;
+	for (k = (k0 > 0) ? k0 - 1 : 0; k <= k0 + 1 && k <= RICE_K_MAX; k++)
+	{
+		size = (uint64_t) n * (k + 1);
+		for (i = 0; i < n; i++)
+		{
+			size += u[i] >> k;
+		}
+		if (size < best_size)
+		{
+			best_size = size;
+			best = k;
+		}
+	}
+	return best;
+}
+
+/* Trailing zero bits common to count values, 0 if they are all 0 */
+static int common_shift(const int16_t* src, uint32_t count)
+{
+	uint16_t bits;
+	uint32_t i;
+	int shift;
+
+	bits = 0;
+	for (i = 0; i < count; i++)
+	{
+		bits |= (uint16_t) src[i];
+	}
+	if (bits == 0)
+	{
+		return 0;
+	}
+
+	shift = 0;
+	while ((bits & 1) == 0)
+	{
+		bits >>= 1;
+		shift++;
+	}
+	return shift;
+}
+
+uint32_t iqz_encode_block(const int16_t* src, uint32_t count, uint32_t channels, uint8_t* dest)
+{
+	iqz_block_header_t header;
+	bit_writer_t bw;
+	int16_t shifted[IQZ_BLOCK_VALUES];
+	uint32_t u[IQZ_PARTITION_VALUES];
+	uint64_t sum;
+	uint32_t warmup;
+	uint32_t i;
+	uint32_t j;
+	uint32_t n;
+	int predictor;
+	int shift;
+	int k;
+
+	shift = common_shift(src, count);
+	if (shift > 0)
+	{
+		/* Exact division, the bits shifted out are 0 */
+		for (i = 0; i < count; i++)
+		{
+			shifted[i] = (int16_t)(src[i] / (1 << shift));
+		}
+		src = shifted;
+	}
+
+	warmup = (2 * channels < count) ? 2 * channels : count;
+	predictor = select_predictor(src, count, channels);
+
+	bw.p = dest + IQZ_BLOCK_HEADER_SIZE;
+	bw.acc = 0;
+	bw.bits = 0;
+
+	for (i = 0; i < warmup; i++)
+	{
+		put_bits(&bw, (uint16_t) src[i], 16);
+	}
+
+	for (i = warmup; i < count; i += n)
+	{
+		n = (count - i < IQZ_PARTITION_VALUES) ? count - i : IQZ_PARTITION_VALUES;
+
+		sum = 0;
+		for (j = 0; j < n; j++)
+		{
+			u[j] = zigzag(src[i + j] - predict(predictor, &src[i + j], channels));
+			sum += u[j];
+		}
+
+		k = select_rice_k(u, n, sum);
+		put_bits(&bw, (uint32_t) k, RICE_K_BITS);
+		if (k == RICE_ESCAPE)
+		{
+			for (j = 0; j < n; j++)
+			{
+				put_bits(&bw, u[j], ESCAPE_BITS);
+			}
+		}
+		else
+		{
+			for (j = 0; j < n; j++)
+			{
+				put_zeros(&bw, u[j] >> k);
+				put_bits(&bw, 1, 1);
+				if (k > 0)
+					put_bits(&bw, u[j] & ((1u << k) - 1), k);
+			}
+		}
+	}
+	flush_bits(&bw);
+
+	header.size = (uint32_t)(bw.p - (dest + IQZ_BLOCK_HEADER_SIZE));
+	header.value_count = count;
+	header.predictor = (uint8_t) predictor;
+	header.channels = (uint8_t) channels;
+	header.shift = (uint16_t) shift;
+	iqz_block_header_pack(&header, dest);
+
+	return IQZ_BLOCK_HEADER_SIZE + header.size;
+}
+
+int iqz_decode_block(const iqz_block_header_t* header, const uint8_t* payload, int16_t* dest)
+{
+	bit_reader_t br;
+	uint32_t count;
+	uint32_t channels;
+	uint32_t warmup;
+	uint32_t i;
+	uint32_t j;
+	uint32_t n;
+	uint32_t q;
+	int predictor;
+	int k;
+
+	count = header->value_count;
+	channels = header->channels;
+	predictor = header->predictor;
+	if (channels < 1 || channels > 2 || predictor >= PREDICTOR_COUNT || count > IQZ_BLOCK_VALUES || header->shift > 15)
+	{
+		return -1;
+	}
+
+	br.p = payload;
+	br.end = payload + header->size;
+	br.acc = 0;
+	br.bits = 0;
+	br.overrun = false;
+
+	warmup = (2 * channels < count) ? 2 * channels : count;
+	for (i = 0; i < warmup; i++)
+	{
+		dest[i] = (int16_t) get_bits(&br, 16);
+	}
+
+	for (i = warmup; i < count; i += n)
+	{
+		n = (count - i < IQZ_PARTITION_VALUES) ? count - i : IQZ_PARTITION_VALUES;
+
+		k = (int) get_bits(&br, RICE_K_BITS);
+		if (k == RICE_ESCAPE)
+		{
+			for (j = 0; j < n; j++)
+			{
+				dest[i + j] = (int16_t)(predict(predictor, &dest[i + j], channels) + unzigzag(get_bits(&br, ESCAPE_BITS)));
+			}
+		}
+		else if (k <= RICE_K_MAX)
+		{
+			for (j = 0; j < n; j++)
+			{
+				q = get_unary(&br);
+				dest[i + j] = (int16_t)(predict(predictor, &dest[i + j], channels) + unzigzag((q << k) | get_bits(&br, k)));
+			}
+		}
+		else
+		{
+			return -1;
+		}
+
+		if (br.overrun)
+		{
+			return -1;
+		}
+	}
+
+	if (header->shift > 0)
+	{
+		for (i = 0; i < count; i++)
+		{
+			dest[i] = (int16_t)((uint16_t) dest[i] << header->shift);
+		}
+	}
+
+	return br.overrun ? -1 : 0;
+}
+
+/* Multi-threaded writer, blocks are coded by the workers and written in order by the caller */
+
+typedef struct
+{
+	int16_t* values;
+	uint32_t count;
+	uint8_t* coded;
+	uint32_t coded_size;
+	volatile int state;
+} iqz_job_t;
+
+struct iqz_writer
+{
+	file_writer_t* writer;
+	iqz_file_header_t header;
+	iqz_job_t jobs[IQZ_MAX_THREADS * JOBS_PER_THREAD];
+	uint32_t job_count;
+	uint64_t submitted; /* Jobs handed to the workers */
+	uint64_t taken; /* Jobs picked up by a worker */
+	uint64_t written; /* Jobs written to the file */
+	uint64_t* index;
+	uint64_t index_max;
+	int error;
+	pthread_t threads[IQZ_MAX_THREADS];
+	int thread_count;
+	pthread_mutex_t mp;
+	pthread_cond_t work_cv;
+	pthread_cond_t done_cv;
+	bool stop;
+};
+
+static void* iqz_threadproc(void* arg)
+{
+	iqz_writer_t* iqz = (iqz_writer_t*) arg;
+	iqz_job_t* job;
+
+	pthread_mutex_lock(&iqz->mp);
+	while (true)
+	{
+		while (iqz->taken == iqz->submitted && !iqz->stop)
+		{
+			pthread_cond_wait(&iqz->work_cv, &iqz->mp);
+		}
+		if (iqz->taken == iqz->submitted)
+		{
+			break;
+		}
+		job = &iqz->jobs[iqz->taken % iqz->job_count];
+		iqz->taken++;
+		pthread_mutex_unlock(&iqz->mp);
+
+		job->coded_size = iqz_encode_block(job->values, job->count, iqz->header.channels, job->coded);
+
+		pthread_mutex_lock(&iqz->mp);
+		job->state = JOB_DONE;
+		pthread_cond_broadcast(&iqz->done_cv);
+	}
+	pthread_mutex_unlock(&iqz->mp);
+
+	return NULL;
+}
+
+static int write_job(iqz_writer_t* iqz, iqz_job_t* job)
+{
+	uint64_t* index;
+
+	if (iqz->written == iqz->index_max)
+	{
+		index = (uint64_t*) realloc(iqz->index, (size_t)(iqz->index_max * 2) * sizeof(uint64_t));
+		if (index == NULL)
+		{
+			return -1;
+		}
+		iqz->index = index;
+		iqz->index_max *= 2;
+	}
+	iqz->index[iqz->written] = file_writer_tell(iqz->writer);
+
+	if (file_writer_write(iqz->writer, job->coded, job->coded_size) != (int) job->coded_size)
+	{
+		return -1;
+	}
+	iqz->header.value_count += job->count;
+	return 0;
+}
+
+/* Write the coded jobs in order, waiting for the workers until at least wait_count jobs are written */
+static int write_done_jobs(iqz_writer_t* iqz, uint64_t wait_count)
+{
+	iqz_job_t* job;
+
+	while (iqz->written < iqz->submitted)
+	{
+		job = &iqz->jobs[iqz->written % iqz->job_count];
+		pthread_mutex_lock(&iqz->mp);
+		while (job->state != JOB_DONE && iqz->written < wait_count)
+		{
+			pthread_cond_wait(&iqz->done_cv, &iqz->mp);
+		}
+		pthread_mutex_unlock(&iqz->mp);
+		if (job->state != JOB_DONE)
+		{
+			break;
+		}
+
+		if (iqz->error == 0 && write_job(iqz, job) != 0)
+		{
+			iqz->error = -1;
+		}
+		job->count = 0;
+		job->state = JOB_FREE;
+		iqz->written++;
+	}
+
+	return iqz->error;
+}
+
+static void submit_job(iqz_writer_t* iqz)
+{
+	pthread_mutex_lock(&iqz->mp);
+	iqz->jobs[iqz->submitted % iqz->job_count].state = JOB_QUEUED;
+	iqz->submitted++;
+	pthread_cond_signal(&iqz->work_cv);
+	pthread_mutex_unlock(&iqz->mp);
+}
+
+static void free_jobs(iqz_writer_t* iqz)
+{
+	uint32_t i;
+
+	for (i = 0; i < iqz->job_count; i++)
+	{
+		free(iqz->jobs[i].values);
+		free(iqz->jobs[i].coded);
+	}
+}
+
+iqz_writer_t* iqz_writer_open(file_writer_t* writer, uint32_t sample_type, uint32_t sample_rate,
+	uint32_t channels, int threads)
+{
+	iqz_writer_t* iqz;
+	uint8_t header[IQZ_FILE_HEADER_SIZE];
+	uint32_t i;
+
+	if (threads < 1 || threads > IQZ_MAX_THREADS || channels < 1 || channels > 2)
+	{
+		return NULL;
+	}
+
+	iqz = (iqz_writer_t*) calloc(1, sizeof(iqz_writer_t));
+	if (iqz == NULL)
+	{
+		return NULL;
+	}
+	iqz->writer = writer;
+	memcpy(iqz->header.magic, IQZ_MAGIC, 8);
+	iqz->header.version = IQZ_VERSION;
+	iqz->header.sample_type = sample_type;
+	iqz->header.sample_rate = sample_rate;
+	iqz->header.channels = channels;
+	iqz->header.block_values = IQZ_BLOCK_VALUES;
+
+	/* Enough jobs in flight for each worker to have the next block ready */
+	iqz->job_count = threads * JOBS_PER_THREAD;
+	for (i = 0; i < iqz->job_count; i++)
+	{
+		iqz->jobs[i].values = (int16_t*) malloc(IQZ_BLOCK_VALUES * sizeof(int16_t));
+		iqz->jobs[i].coded = (uint8_t*) malloc(IQZ_BLOCK_HEADER_SIZE + IQZ_BLOCK_MAX_SIZE);
+		if (iqz->jobs[i].values == NULL || iqz->jobs[i].coded == NULL)
+		{
+			free_jobs(iqz);
+			free(iqz);
+			return NULL;
+		}
+	}
+
+	iqz->index_max = 1024;
+	iqz->index = (uint64_t*) malloc((size_t) iqz->index_max * sizeof(uint64_t));
+	if (iqz->index == NULL)
+	{
+		free_jobs(iqz);
+		free(iqz);
+		return NULL;
+	}
+
+	/* index_offset stays 0 until iqz_writer_close() */
+	iqz_file_header_pack(&iqz->header, header);
+	if (file_writer_write(writer, header, IQZ_FILE_HEADER_SIZE) != IQZ_FILE_HEADER_SIZE)
+	{
+		free(iqz->index);
+		free_jobs(iqz);
+		free(iqz);
+		return NULL;
+	}
+
+	pthread_mutex_init(&iqz->mp, NULL);
+	pthread_cond_init(&iqz->work_cv, NULL);
+	pthread_cond_init(&iqz->done_cv, NULL);
+	for (iqz->thread_count = 0; iqz->thread_count < threads; iqz->thread_count++)
+	{
+		if (pthread_create(&iqz->threads[iqz->thread_count], NULL, iqz_threadproc, iqz) != 0)
+		{
+			break;
+		}
+	}
+	if (iqz->thread_count == 0)
+	{
+		pthread_cond_destroy(&iqz->done_cv);
+		pthread_cond_destroy(&iqz->work_cv);
+		pthread_mutex_destroy(&iqz->mp);
+		free(iqz->index);
+		free_jobs(iqz);
+		free(iqz);
+		return NULL;
+	}
+
+	return iqz;
+}
+
+int iqz_writer_write(iqz_writer_t* iqz, const void* data, uint32_t length)
+{
+	const int16_t* src;
+	iqz_job_t* job;
+	uint32_t count;
+	uint32_t chunk;
+
+	src = (const int16_t*) data;
+	count = length / sizeof(int16_t);
+	while (count > 0)
+	{
+		job = &iqz->jobs[iqz->submitted % iqz->job_count];
+		if (job->state != JOB_FREE)
+		{
+			/* All jobs in flight, wait for the oldest one */
+			if (write_done_jobs(iqz, iqz->written + 1) != 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		chunk = IQZ_BLOCK_VALUES - job->count;
+		if (chunk > count)
+			chunk = count;
+		memcpy(job->values + job->count, src, chunk * sizeof(int16_t));
+		job->count += chunk;
+		src += chunk;
+		count -= chunk;
+
+		if (job->count == IQZ_BLOCK_VALUES)
+		{
+			submit_job(iqz);
+		}
+	}
+
+	/* Write what is already coded without waiting */
+	return write_done_jobs(iqz, 0);
+}
+
+int iqz_writer_close(iqz_writer_t* iqz)
+{
+	uint8_t header[IQZ_FILE_HEADER_SIZE];
+	uint8_t offset[8];
+	uint64_t i;
+	iqz_job_t* job;
+	int result;
+	int t;
+
+	job = &iqz->jobs[iqz->submitted % iqz->job_count];
+	if (job->state == JOB_FREE && job->count > 0)
+	{
+		submit_job(iqz);
+	}
+	result = write_done_jobs(iqz, iqz->submitted);
+
+	pthread_mutex_lock(&iqz->mp);
+	iqz->stop = true;
+	pthread_cond_broadcast(&iqz->work_cv);
+	pthread_mutex_unlock(&iqz->mp);
+	for (t = 0; t < iqz->thread_count; t++)
+	{
+		pthread_join(iqz->threads[t], NULL);
+	}
+	pthread_cond_destroy(&iqz->done_cv);
+	pthread_cond_destroy(&iqz->work_cv);
+	pthread_mutex_destroy(&iqz->mp);
+
+	if (result == 0)
+	{
+		iqz->header.index_offset = file_writer_tell(iqz->writer);
+		for (i = 0; i < iqz->written && result == 0; i++)
+		{
+			put_u64(offset, iqz->index[i]);
+			if (file_writer_write(iqz->writer, offset, sizeof(offset)) != sizeof(offset))
+				result = -1;
+		}
+	}
+
+	if (result == 0)
+	{
+		iqz_file_header_pack(&iqz->header, header);
+		result = file_writer_pwrite(iqz->writer, header, IQZ_FILE_HEADER_SIZE, 0);
+	}
+
+	free(iqz->index);
+	free_jobs(iqz);
+	free(iqz);
+	return result;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef IQZ_H
+#define IQZ_H
+
+#include <stdint.h>
+
+#include "file_writer.h"
+
+/*
+ * Lossless compressed int16 sample files (.iqz).
+ *
+ * Samples are cut in blocks of IQZ_BLOCK_VALUES int16 values, each block is
+ * coded on its own so blocks can be compressed in parallel and decoded
+ * from any block boundary: the trailing zero bits common to the values of
+ * the block are left out (the 12bit ADC samples are shifted left by 4 in
+ * the 16bit sample types), then a fixed predictor chosen per block (delta,
+ * second order or fs/4 rotation, per channel), then Rice codes with one
+ * parameter per IQZ_PARTITION_VALUES residuals.
+ *
+ * File: iqz_file_header_t, blocks (iqz_block_header_t + payload), then the
+ * index, one little endian uint64 file offset per block. index_offset is 0
+ * if the recording was interrupted, the blocks can then still be walked
+ * through their headers.
+ * All fields are little endian.
+ */
+
+#define IQZ_MAGIC "AIRSPYZ1"
+#define IQZ_VERSION (2)
+
+#define IQZ_BLOCK_VALUES (32768)
+#define IQZ_PARTITION_VALUES (256)
+/* Worst case coded size of a block payload */
+#define IQZ_BLOCK_MAX_SIZE (IQZ_BLOCK_VALUES * 20 / 8 + IQZ_BLOCK_VALUES / IQZ_PARTITION_VALUES + 64)
+
+#define IQZ_FILE_HEADER_SIZE (48)
+#define IQZ_BLOCK_HEADER_SIZE (12)
+
+#define IQZ_MAX_THREADS (8)
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t sample_type; /* enum airspy_sample_type */
+	uint32_t sample_rate;
+	uint32_t channels; /* 2 for IQ, 1 for real */
+	uint32_t block_values;
+	uint32_t reserved;
+	uint64_t index_offset; /* 0 until the file is closed */
+	uint64_t value_count; /* int16 values in the file */
+} iqz_file_header_t;
+
+typedef struct
+{
+	uint32_t size; /* Payload bytes following the block header */
+	uint32_t value_count;
+	uint8_t predictor;
+	uint8_t channels;
+	uint16_t shift; /* Trailing zero bits of every value, not coded */
+} iqz_block_header_t;
+
+/* Serialization of the headers, independent of the host byte order and structure padding */
+void iqz_file_header_pack(const iqz_file_header_t* header, uint8_t* dest);
+int iqz_file_header_unpack(iqz_file_header_t* header, const uint8_t* src); /* 0 if valid */
+void iqz_block_header_pack(const iqz_block_header_t* header, uint8_t* dest);
+void iqz_block_header_unpack(iqz_block_header_t* header, const uint8_t* src);
+
+/* Code count values (count <= IQZ_BLOCK_VALUES) into dest (IQZ_BLOCK_HEADER_SIZE + IQZ_BLOCK_MAX_SIZE bytes),
+   return the total size including the block header */
+uint32_t iqz_encode_block(const int16_t* src, uint32_t count, uint32_t channels, uint8_t* dest);
+/* Decode the payload of a block, dest holds header->value_count values. Return 0 on success */
+int iqz_decode_block(const iqz_block_header_t* header, const uint8_t* payload, int16_t* dest);
+
+typedef struct iqz_writer iqz_writer_t;
+
+/* Compress into writer (positioned at its start) using threads worker threads */
+iqz_writer_t* iqz_writer_open(file_writer_t* writer, uint32_t sample_type, uint32_t sample_rate,
+	uint32_t channels, int threads);
+/* length in bytes, multiple of 2. Return 0 on success */
+int iqz_writer_write(iqz_writer_t* iqz, const void* data, uint32_t length);
+/* Flush, write the index and the final header, the file_writer is left open. Return 0 on success */
+int iqz_writer_close(iqz_writer_t* iqz);
+
+#endif /* IQZ_H */
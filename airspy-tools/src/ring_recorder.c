@@ -0,0 +1,397 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "ring_recorder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#define RING_RECORDER_DUMP_CHUNK (16*1024*1024)
+
+#if defined(__GNUC__)
+#define memory_barrier() __sync_synchronize()
+#elif defined(_WIN32)
+#define memory_barrier() MemoryBarrier()
+#else
+#define memory_barrier()
+#endif
+
+struct ring_recorder
+{
+	unsigned char* map;
+	uint64_t map_size;
+	ring_recorder_header_t* header;
+	unsigned char* samples;
+	pthread_mutex_t mp; /* Protects the snapshot fields */
+	int snapshot; /* Set while a snapshot is being saved */
+	uint64_t snapshot_end; /* Offsets in the stream of bytes written, the samples at ring offset % capacity */
+	uint64_t snapshot_done; /* Saved up to there, the writes may go up to capacity beyond */
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+/* Create path with map_size bytes allocated and map it, return 0 on success */
+static int map_file(ring_recorder_t* ring, const char* path)
+{
+	LARGE_INTEGER size;
+
+	ring->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (ring->file == INVALID_HANDLE_VALUE)
+	{
+		errno = EACCES;
+		return -1;
+	}
+
+	/* Setting the end of file allocates every cluster now, a full disk would fail a page-in in the rx callback */
+	size.QuadPart = (LONGLONG) ring->map_size;
+	if (!SetFilePointerEx(ring->file, size, NULL, FILE_BEGIN) || !SetEndOfFile(ring->file))
+	{
+		CloseHandle(ring->file);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	ring->mapping = CreateFileMappingA(ring->file, NULL, PAGE_READWRITE, (DWORD)(ring->map_size >> 32),
+		(DWORD) ring->map_size, NULL);
+	if (ring->mapping == NULL)
+	{
+		CloseHandle(ring->file);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	ring->map = (unsigned char*) MapViewOfFile(ring->mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T) ring->map_size);
+	if (ring->map == NULL)
+	{
+		CloseHandle(ring->mapping);
+		CloseHandle(ring->file);
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+int ring_recorder_sync(ring_recorder_t* ring)
+{
+	/* Only starts the writeback of the view, FlushFileBuffers() would wait for it */
+	return FlushViewOfFile(ring->map, 0) ? 0 : -1;
+}
+
+/* Flush and unmap, return 0 on success */
+static int unmap_file(ring_recorder_t* ring)
+{
+	int result;
+
+	result = 0;
+	if (!FlushViewOfFile(ring->map, 0) || !FlushFileBuffers(ring->file))
+		result = -1;
+	if (!UnmapViewOfFile(ring->map))
+		result = -1;
+	if (!CloseHandle(ring->mapping))
+		result = -1;
+	if (!CloseHandle(ring->file))
+		result = -1;
+	return result;
+}
+
+#else
+
+/* Create path with map_size bytes allocated and map it, return 0 on success */
+static int map_file(ring_recorder_t* ring, const char* path)
+{
+	void* map;
+
+	ring->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (ring->fd < 0)
+	{
+		return -1;
+	}
+
+	/* Allocate every block now, a page fault on a full disk would be a SIGBUS in the rx callback */
+	if (ftruncate(ring->fd, (off_t) ring->map_size) != 0 ||
+		posix_fallocate(ring->fd, 0, (off_t) ring->map_size) != 0)
+	{
+		close(ring->fd);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	map = mmap(NULL, (size_t) ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	if (map == MAP_FAILED)
+	{
+		close(ring->fd);
+		return -1;
+	}
+	ring->map = (unsigned char*) map;
+	return 0;
+}
+
+int ring_recorder_sync(ring_recorder_t* ring)
+{
+	return msync(ring->map, (size_t) ring->map_size, MS_ASYNC);
+}
+
+/* Flush and unmap, return 0 on success */
+static int unmap_file(ring_recorder_t* ring)
+{
+	int result;
+
+	result = 0;
+	if (msync(ring->map, (size_t) ring->map_size, MS_SYNC) != 0)
+		result = -1;
+	if (munmap(ring->map, (size_t) ring->map_size) != 0)
+		result = -1;
+	if (close(ring->fd) != 0)
+		result = -1;
+	return result;
+}
+
+#endif
+
+/* Readers of a live or crashed file retry while sequence is odd or has changed */
+static void header_update_begin(ring_recorder_header_t* header)
+{
+	header->sequence++;
+	memory_barrier();
+}
+
+static void header_update_end(ring_recorder_header_t* header)
+{
+	memory_barrier();
+	header->sequence++;
+}
+
+ring_recorder_t* ring_recorder_open(const char* path, uint64_t capacity, uint32_t frame_size,
+	uint32_t sample_rate, uint32_t sample_type)
+{
+	ring_recorder_t* ring;
+	ring_recorder_header_t* header;
+
+	if (frame_size == 0 || capacity < frame_size)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	capacity -= capacity % frame_size;
+
+	ring = (ring_recorder_t*) calloc(1, sizeof(ring_recorder_t));
+	if (ring == NULL)
+	{
+		return NULL;
+	}
+	ring->map_size = RING_RECORDER_HEADER_SIZE + capacity;
+
+	if ((uint64_t)(size_t) ring->map_size != ring->map_size)
+	{
+		free(ring);
+		errno = EFBIG;
+		return NULL;
+	}
+
+	if (map_file(ring, path) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	ring->header = (ring_recorder_header_t*) ring->map;
+	pthread_mutex_init(&ring->mp, NULL);
+	ring->samples = ring->map + RING_RECORDER_HEADER_SIZE;
+
+	header = ring->header;
+	memset(header, 0, RING_RECORDER_HEADER_SIZE);
+	header->version = RING_RECORDER_VERSION;
+	header->header_size = RING_RECORDER_HEADER_SIZE;
+	header->sample_rate = sample_rate;
+	header->sample_type = sample_type;
+	header->frame_size = frame_size;
+	header->capacity = capacity;
+	memory_barrier();
+	/* Magic last, a file interrupted during creation is not mistaken for a valid one */
+	memcpy(header->magic, RING_RECORDER_MAGIC, sizeof(header->magic));
+
+	return ring;
+}
+
+int ring_recorder_write(ring_recorder_t* ring, const void* data, uint32_t length, uint64_t time_us)
+{
+	ring_recorder_header_t* header;
+	const unsigned char* src;
+	uint64_t pos;
+	uint64_t chunk;
+	uint64_t samples;
+	uint32_t remaining;
+	int blocked;
+
+	header = ring->header;
+
+	pthread_mutex_lock(&ring->mp);
+	blocked = ring->snapshot &&
+		(header->sample_total * header->frame_size + length > ring->snapshot_done + header->capacity);
+	pthread_mutex_unlock(&ring->mp);
+	if (blocked)
+	{
+		ring_recorder_skip(ring, length);
+		return 0;
+	}
+
+	/* Only the last capacity bytes of a block bigger than the ring are kept */
+	src = (const unsigned char*) data;
+	remaining = length;
+	pos = header->write_pos;
+	if (remaining > header->capacity)
+	{
+		pos = (pos + (remaining - header->capacity)) % header->capacity;
+		src += remaining - header->capacity;
+		remaining = (uint32_t) header->capacity;
+	}
+
+	/* Samples first, then the header describing them */
+	while (remaining > 0)
+	{
+		chunk = header->capacity - pos;
+		if (chunk > remaining)
+			chunk = remaining;
+		memcpy(ring->samples + pos, src, (size_t) chunk);
+		src += chunk;
+		remaining -= (uint32_t) chunk;
+		pos += chunk;
+		if (pos == header->capacity)
+			pos = 0;
+	}
+
+	samples = length / header->frame_size;
+
+	header_update_begin(header);
+	if (header->sample_total == 0)
+	{
+		header->start_time_us = time_us;
+	}
+	header->time_index[header->time_index_pos].sample_index = header->sample_total;
+	header->time_index[header->time_index_pos].time_us = time_us;
+	header->time_index_pos = (header->time_index_pos + 1) % RING_RECORDER_TIME_INDEX_LEN;
+	header->write_pos = pos;
+	header->sample_total += samples;
+	header_update_end(header);
+
+	return 0;
+}
+
+void ring_recorder_skip(ring_recorder_t* ring, uint32_t length)
+{
+	header_update_begin(ring->header);
+	ring->header->sample_dropped += length / ring->header->frame_size;
+	header_update_end(ring->header);
+}
+
+uint64_t ring_recorder_size(ring_recorder_t* ring)
+{
+	uint64_t written;
+
+	written = ring->header->sample_total * ring->header->frame_size;
+	return (written < ring->header->capacity) ? written : ring->header->capacity;
+}
+
+uint64_t ring_recorder_snapshot_begin(ring_recorder_t* ring, uint64_t size)
+{
+	uint64_t held;
+
+	held = ring_recorder_size(ring);
+	if (size > held)
+		size = held;
+	size -= size % ring->header->frame_size;
+
+	pthread_mutex_lock(&ring->mp);
+	ring->snapshot = 1;
+	ring->snapshot_end = ring->header->sample_total * ring->header->frame_size;
+	ring->snapshot_done = ring->snapshot_end - size;
+	pthread_mutex_unlock(&ring->mp);
+
+	return size;
+}
+
+int ring_recorder_snapshot_dump(ring_recorder_t* ring, file_writer_t* writer)
+{
+	uint64_t pos;
+	uint64_t end;
+	uint64_t offset;
+	uint64_t chunk;
+	int result;
+
+	pthread_mutex_lock(&ring->mp);
+	pos = ring->snapshot_done;
+	end = ring->snapshot_end;
+	pthread_mutex_unlock(&ring->mp);
+
+	result = 0;
+	while (writer != NULL && pos < end)
+	{
+		offset = pos % ring->header->capacity;
+		chunk = ring->header->capacity - offset;
+		if (chunk > end - pos)
+			chunk = end - pos;
+		if (chunk > RING_RECORDER_DUMP_CHUNK)
+			chunk = RING_RECORDER_DUMP_CHUNK;
+		if (file_writer_write(writer, ring->samples + offset, (uint32_t) chunk) != (int) chunk)
+		{
+			result = -1;
+			break;
+		}
+		pos += chunk;
+
+		/* Give the space back to the writes as it is saved */
+		pthread_mutex_lock(&ring->mp);
+		ring->snapshot_done = pos;
+		pthread_mutex_unlock(&ring->mp);
+	}
+
+	pthread_mutex_lock(&ring->mp);
+	ring->snapshot = 0;
+	pthread_mutex_unlock(&ring->mp);
+
+	return result;
+}
+
+int ring_recorder_close(ring_recorder_t* ring)
+{
+	int result;
+
+	result = unmap_file(ring);
+	pthread_mutex_destroy(&ring->mp);
+	free(ring);
+	return result;
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef RING_RECORDER_H
+#define RING_RECORDER_H
+
+#include <stdint.h>
+
+#include "file_writer.h"
+
+/*
+ * Fixed size circular capture file, memory mapped so the samples and the
+ * header survive a crash of the process (the kernel writes the pages back).
+ *
+ * File layout: ring_recorder_header_t padded to RING_RECORDER_HEADER_SIZE,
+ * then capacity bytes of samples. The oldest sample is at write_pos when
+ * the ring has wrapped (sample_total * frame_size >= capacity), else at 0.
+ *
+ * A snapshot of the latest samples is saved from another thread while the
+ * writes go on in the rest of the ring. Only when the snapshot falls so far
+ * behind that a write would overwrite samples not saved yet is that block
+ * skipped (sample_dropped) instead.
+ */
+
+#define RING_RECORDER_MAGIC "AIRSPYRG"
+#define RING_RECORDER_VERSION (1)
+#define RING_RECORDER_HEADER_SIZE (4096)
+#define RING_RECORDER_TIME_INDEX_LEN (128)
+
+typedef struct
+{
+	uint64_t sample_index; /* Sample number of the first sample of the block */
+	uint64_t time_us; /* Host time of the block in microseconds since the epoch */
+} ring_recorder_time_t;
+
+typedef struct
+{
+	char magic[8]; /* RING_RECORDER_MAGIC, no terminating zero */
+	uint32_t version;
+	uint32_t header_size; /* Offset of the samples in the file */
+	uint32_t sample_rate; /* Samples per second */
+	uint32_t sample_type; /* enum airspy_sample_type */
+	uint32_t frame_size; /* Bytes per sample */
+	uint32_t sequence; /* Odd while the fields below are being updated */
+	uint64_t capacity; /* Bytes of samples, multiple of frame_size */
+	uint64_t write_pos; /* Offset in the samples of the next write */
+	uint64_t sample_total; /* Samples written since the start */
+	uint64_t sample_dropped; /* Samples not written (snapshot behind) */
+	uint64_t start_time_us; /* Host time of the first sample */
+	uint32_t time_index_pos; /* Next entry of time_index to be written */
+	uint32_t reserved;
+	ring_recorder_time_t time_index[RING_RECORDER_TIME_INDEX_LEN]; /* Latest blocks, circular */
+} ring_recorder_header_t;
+
+typedef struct ring_recorder ring_recorder_t;
+
+/* Create (or overwrite) path and map it, capacity is rounded down to a multiple of frame_size */
+ring_recorder_t* ring_recorder_open(const char* path, uint64_t capacity, uint32_t frame_size,
+	uint32_t sample_rate, uint32_t sample_type);
+
+/* Append length bytes received at time_us, overwriting the oldest samples not in a snapshot. Return 0 on success */
+int ring_recorder_write(ring_recorder_t* ring, const void* data, uint32_t length, uint64_t time_us);
+/* Account for length bytes which were received but not stored */
+void ring_recorder_skip(ring_recorder_t* ring, uint32_t length);
+
+/* Bytes of samples currently held, at most capacity */
+uint64_t ring_recorder_size(ring_recorder_t* ring);
+/* Start a snapshot of the latest size bytes, at most ring_recorder_size(), from the writer thread. Return its bytes */
+uint64_t ring_recorder_snapshot_begin(ring_recorder_t* ring, uint64_t size);
+/* Write the snapshot oldest first, writer NULL to abandon it, and end it. May run concurrently with
+   ring_recorder_write(). Return 0 on success */
+int ring_recorder_snapshot_dump(ring_recorder_t* ring, file_writer_t* writer);
+
+/* Start writeback of the dirty pages without waiting, return 0 on success */
+int ring_recorder_sync(ring_recorder_t* ring);
+/* Flush and unmap, return 0 on success */
+int ring_recorder_close(ring_recorder_t* ring);
+
+#endif /* RING_RECORDER_H */
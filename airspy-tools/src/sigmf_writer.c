@@ -0,0 +1,488 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "sigmf_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+#define SIGMF_PATH_MAX_LEN (FILENAME_MAX)
+#define SIGMF_COMMENT_MAX_LEN (128)
+#define SIGMF_TEXT_MAX_LEN (128)
+
+#define SIGMF_DATA_EXT ".sigmf-data"
+#define SIGMF_META_INTERVAL (1) /* Seconds between two rewrites of the metadata */
+#define SIGMF_COPY_CHUNK (64*1024)
+
+/* JSON objects of the captures or the annotations, appended to a scratch file */
+typedef struct
+{
+	char path[SIGMF_PATH_MAX_LEN + 16];
+	FILE* file;
+	uint32_t count;
+	long size; /* Bytes flushed to the file */
+} sigmf_list_t;
+
+struct sigmf_writer
+{
+	char meta_path[SIGMF_PATH_MAX_LEN];
+	char index_path[SIGMF_PATH_MAX_LEN];
+	char dataset[SIGMF_PATH_MAX_LEN]; /* Empty when the data file follows the SigMF naming */
+	char datatype[16];
+	char recorder[SIGMF_TEXT_MAX_LEN];
+	char hw[SIGMF_TEXT_MAX_LEN];
+	uint32_t sample_rate;
+	uint32_t frame_size;
+	uint32_t header_bytes;
+	FILE* index;
+	sigmf_capture_t last_capture;
+	sigmf_list_t captures;
+	sigmf_list_t annotations;
+	/* Metadata thread, the fields above are protected by mp once it runs */
+	pthread_t thread;
+	pthread_mutex_t mp;
+	pthread_cond_t cv;
+	int dirty; /* Captures or annotations added since the last rewrite */
+	int stop;
+};
+
+static int list_open(sigmf_list_t* list, const char* meta_path, const char* name)
+{
+	snprintf(list->path, sizeof(list->path), "%s.%s.tmp", meta_path, name);
+	list->file = fopen(list->path, "w+b");
+	list->count = 0;
+	list->size = 0;
+	return (list->file != NULL) ? 0 : -1;
+}
+
+static void list_close(sigmf_list_t* list)
+{
+	fclose(list->file);
+	remove(list->path);
+}
+
+/* Make the objects appended readable by write_meta(), return 0 on success */
+static int list_flush(sigmf_list_t* list)
+{
+	if (fflush(list->file) != 0)
+	{
+		return -1;
+	}
+	list->size = ftell(list->file);
+	return (list->size >= 0) ? 0 : -1;
+}
+
+/* Copy the first size bytes of the list into f, the list may be appended to meanwhile */
+static int list_copy(const sigmf_list_t* list, long size, FILE* f)
+{
+	char buffer[SIGMF_COPY_CHUNK];
+	FILE* src;
+	size_t chunk;
+	int result;
+
+	if (size == 0)
+	{
+		return 0;
+	}
+	src = fopen(list->path, "rb");
+	if (src == NULL)
+	{
+		return -1;
+	}
+
+	result = 0;
+	while (size > 0)
+	{
+		chunk = (size < SIGMF_COPY_CHUNK) ? (size_t) size : SIGMF_COPY_CHUNK;
+		if (fread(buffer, 1, chunk, src) != chunk || fwrite(buffer, 1, chunk, f) != chunk)
+		{
+			result = -1;
+			break;
+		}
+		size -= (long) chunk;
+	}
+	fclose(src);
+	return result;
+}
+
+static void write_string(FILE* f, const char* s)
+{
+	fputc('"', f);
+	for (; *s != '\0'; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		if ((unsigned char) *s >= 0x20)
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+/* ISO 8601 UTC with nanoseconds as required by core:datetime */
+static void format_datetime(char* dst, size_t len, uint64_t timestamp)
+{
+	time_t seconds;
+	struct tm* tm;
+	size_t n;
+
+	seconds = (time_t)(timestamp / 1000000000ull);
+	tm = gmtime(&seconds);
+	if (tm == NULL)
+	{
+		dst[0] = '\0';
+		return;
+	}
+	n = strftime(dst, len, "%Y-%m-%dT%H:%M:%S", tm);
+	snprintf(dst + n, len - n, ".%09uZ", (uint32_t)(timestamp % 1000000000ull));
+}
+
+static const char* capture_event(sigmf_writer_t* writer, const sigmf_capture_t* capture)
+{
+	if (writer->captures.count == 0)
+		return "start";
+	if (capture->dropped_samples > 0)
+		return "gap";
+	if (capture->skipped_samples > 0)
+		return "burst";
+	if (writer->last_capture.freq_hz != capture->freq_hz)
+		return "retune";
+	return "gain";
+}
+
+/* Append the JSON object of a capture, return 0 on success */
+static int append_capture(sigmf_writer_t* writer, const sigmf_capture_t* capture)
+{
+	char datetime[64];
+	FILE* f;
+
+	f = writer->captures.file;
+	fprintf(f, "%s\n\t\t{\n", (writer->captures.count == 0) ? "" : ",");
+	fprintf(f, "\t\t\t\"core:sample_start\": %llu,\n", (unsigned long long) capture->sample_start);
+	fprintf(f, "\t\t\t\"core:global_index\": %llu,\n", (unsigned long long) capture->global_index);
+	if (writer->captures.count == 0 && writer->header_bytes > 0)
+	{
+		fprintf(f, "\t\t\t\"core:header_bytes\": %u,\n", writer->header_bytes);
+	}
+	if (capture->timestamp != 0)
+	{
+		format_datetime(datetime, sizeof(datetime), capture->timestamp);
+		fprintf(f, "\t\t\t\"core:datetime\": \"%s\",\n", datetime);
+	}
+	fprintf(f, "\t\t\t\"core:frequency\": %u,\n", capture->freq_hz);
+	fprintf(f, "\t\t\t\"airspy:lna_gain\": %u,\n", capture->lna_gain);
+	fprintf(f, "\t\t\t\"airspy:mixer_gain\": %u,\n", capture->mixer_gain);
+	fprintf(f, "\t\t\t\"airspy:vga_gain\": %u\n", capture->vga_gain);
+	fprintf(f, "\t\t}");
+	writer->captures.count++;
+
+	return ferror(f) ? -1 : 0;
+}
+
+/* Append the JSON object of an annotation, return 0 on success */
+static int append_annotation(sigmf_writer_t* writer, uint64_t sample_start, uint64_t sample_count, const char* comment)
+{
+	FILE* f;
+
+	f = writer->annotations.file;
+	fprintf(f, "%s\n\t\t{\n", (writer->annotations.count == 0) ? "" : ",");
+	fprintf(f, "\t\t\t\"core:sample_start\": %llu,\n", (unsigned long long) sample_start);
+	if (sample_count > 0)
+	{
+		fprintf(f, "\t\t\t\"core:sample_count\": %llu,\n", (unsigned long long) sample_count);
+	}
+	fprintf(f, "\t\t\t\"core:comment\": ");
+	write_string(f, comment);
+	fprintf(f, "\n\t\t}");
+	writer->annotations.count++;
+
+	return ferror(f) ? -1 : 0;
+}
+
+/* Rewrite the metadata with the first captures_size and annotations_size bytes of the lists */
+static int write_meta(sigmf_writer_t* writer, long captures_size, long annotations_size)
+{
+	char tmp_path[SIGMF_PATH_MAX_LEN + 4];
+	FILE* f;
+	int result;
+
+	/* Written aside then renamed, a crash never leaves a truncated file */
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", writer->meta_path);
+	f = fopen(tmp_path, "w");
+	if (f == NULL)
+	{
+		return -1;
+	}
+
+	fprintf(f, "{\n\t\"global\": {\n");
+	fprintf(f, "\t\t\"core:datatype\": \"%s\",\n", writer->datatype);
+	fprintf(f, "\t\t\"core:sample_rate\": %u,\n", writer->sample_rate);
+	fprintf(f, "\t\t\"core:version\": \"%s\",\n", SIGMF_VERSION);
+	fprintf(f, "\t\t\"core:num_channels\": 1,\n");
+	if (writer->dataset[0] != '\0')
+	{
+		fprintf(f, "\t\t\"core:dataset\": ");
+		write_string(f, writer->dataset);
+		fprintf(f, ",\n");
+	}
+	fprintf(f, "\t\t\"core:recorder\": ");
+	write_string(f, writer->recorder);
+	fprintf(f, ",\n\t\t\"core:hw\": ");
+	write_string(f, writer->hw);
+	fprintf(f, ",\n\t\t\"core:extensions\": [ { \"name\": \"airspy\", \"version\": \"1.0.0\", \"optional\": true } ]\n");
+	fprintf(f, "\t},\n\t\"captures\": [");
+	result = list_copy(&writer->captures, captures_size, f);
+	fprintf(f, "\n\t],\n\t\"annotations\": [");
+	if (list_copy(&writer->annotations, annotations_size, f) != 0)
+		result = -1;
+	fprintf(f, "\n\t]\n}\n");
+
+	if (ferror(f))
+		result = -1;
+	if (fclose(f) != 0)
+		result = -1;
+	if (result != 0)
+	{
+		remove(tmp_path);
+		return -1;
+	}
+
+#ifdef _WIN32
+	remove(writer->meta_path);
+#endif
+	return (rename(tmp_path, writer->meta_path) == 0) ? 0 : -1;
+}
+
+/* Rewrite the metadata when captures or annotations were added, at most once per interval */
+static void* meta_threadproc(void* arg)
+{
+	sigmf_writer_t* writer = (sigmf_writer_t*) arg;
+	struct timespec deadline;
+	long captures_size;
+	long annotations_size;
+
+	pthread_mutex_lock(&writer->mp);
+	while (!writer->stop)
+	{
+		if (!writer->dirty)
+		{
+			pthread_cond_wait(&writer->cv, &writer->mp);
+			continue;
+		}
+
+		writer->dirty = 0;
+		if (list_flush(&writer->captures) == 0 && list_flush(&writer->annotations) == 0)
+		{
+			captures_size = writer->captures.size;
+			annotations_size = writer->annotations.size;
+			pthread_mutex_unlock(&writer->mp);
+			write_meta(writer, captures_size, annotations_size);
+			pthread_mutex_lock(&writer->mp);
+		}
+
+		deadline.tv_sec = time(NULL) + SIGMF_META_INTERVAL;
+		deadline.tv_nsec = 0;
+		while (!writer->stop && pthread_cond_timedwait(&writer->cv, &writer->mp, &deadline) == 0)
+		{
+		}
+	}
+	pthread_mutex_unlock(&writer->mp);
+
+	return NULL;
+}
+
+static void stop_meta_thread(sigmf_writer_t* writer)
+{
+	pthread_mutex_lock(&writer->mp);
+	writer->stop = 1;
+	pthread_cond_signal(&writer->cv);
+	pthread_mutex_unlock(&writer->mp);
+	pthread_join(writer->thread, NULL);
+
+	pthread_cond_destroy(&writer->cv);
+	pthread_mutex_destroy(&writer->mp);
+}
+
+sigmf_writer_t* sigmf_writer_open(const char* data_path, const char* datatype, uint32_t sample_rate,
+	uint32_t frame_size, uint32_t header_bytes, const char* recorder, const char* hw)
+{
+	sigmf_writer_t* writer;
+	const char* name;
+	const char* sep;
+	const char* ext;
+	int base_len;
+
+	writer = (sigmf_writer_t*) calloc(1, sizeof(sigmf_writer_t));
+	if (writer == NULL)
+	{
+		return NULL;
+	}
+
+	name = strrchr(data_path, '/');
+	sep = strrchr(data_path, '\\');
+	if (name == NULL || (sep != NULL && sep > name))
+		name = sep;
+	name = (name == NULL) ? data_path : name + 1;
+	ext = strrchr(name, '.');
+	if (ext == NULL)
+		ext = name + strlen(name);
+	base_len = (int)(ext - data_path);
+
+	snprintf(writer->meta_path, SIGMF_PATH_MAX_LEN, "%.*s.sigmf-meta", base_len, data_path);
+	snprintf(writer->index_path, SIGMF_PATH_MAX_LEN, "%.*s.sigmf-index", base_len, data_path);
+	if (strcmp(ext, SIGMF_DATA_EXT) != 0)
+	{
+		strncpy(writer->dataset, name, SIGMF_PATH_MAX_LEN - 1);
+	}
+	strncpy(writer->datatype, datatype, sizeof(writer->datatype) - 1);
+	strncpy(writer->recorder, recorder, SIGMF_TEXT_MAX_LEN - 1);
+	strncpy(writer->hw, hw, SIGMF_TEXT_MAX_LEN - 1);
+	writer->sample_rate = sample_rate;
+	writer->frame_size = frame_size;
+	writer->header_bytes = header_bytes;
+
+	writer->index = fopen(writer->index_path, "w");
+	if (writer->index == NULL)
+	{
+		free(writer);
+		return NULL;
+	}
+	fprintf(writer->index, "sample_start,global_index,byte_offset,timestamp_ns,event,frequency_hz,dropped_samples\n");
+
+	if (list_open(&writer->captures, writer->meta_path, "captures") != 0)
+	{
+		goto fail_index;
+	}
+	if (list_open(&writer->annotations, writer->meta_path, "annotations") != 0)
+	{
+		goto fail_captures;
+	}
+	if (fflush(writer->index) != 0 || write_meta(writer, 0, 0) != 0)
+	{
+		goto fail_annotations;
+	}
+
+	pthread_mutex_init(&writer->mp, NULL);
+	pthread_cond_init(&writer->cv, NULL);
+	if (pthread_create(&writer->thread, NULL, meta_threadproc, writer) != 0)
+	{
+		pthread_cond_destroy(&writer->cv);
+		pthread_mutex_destroy(&writer->mp);
+		remove(writer->meta_path);
+		goto fail_annotations;
+	}
+
+	return writer;
+
+fail_annotations:
+	list_close(&writer->annotations);
+fail_captures:
+	list_close(&writer->captures);
+fail_index:
+	fclose(writer->index);
+	remove(writer->index_path);
+	free(writer);
+	return NULL;
+}
+
+int sigmf_writer_capture(sigmf_writer_t* writer, const sigmf_capture_t* capture)
+{
+	int result;
+
+	fprintf(writer->index, "%llu,%llu,%llu,%llu,%s,%u,%llu\n",
+		(unsigned long long) capture->sample_start,
+		(unsigned long long) capture->global_index,
+		(unsigned long long)(writer->header_bytes + capture->sample_start * writer->frame_size),
+		(unsigned long long) capture->timestamp,
+		capture_event(writer, capture),
+		capture->freq_hz,
+		(unsigned long long) capture->dropped_samples);
+
+	pthread_mutex_lock(&writer->mp);
+	result = append_capture(writer, capture);
+	writer->last_capture = *capture;
+	writer->dirty = 1;
+	pthread_cond_signal(&writer->cv);
+	pthread_mutex_unlock(&writer->mp);
+
+	if (capture->dropped_samples > 0)
+	{
+		char comment[SIGMF_COMMENT_MAX_LEN];
+
+		snprintf(comment, sizeof(comment), "%llu samples dropped", (unsigned long long) capture->dropped_samples);
+		if (sigmf_writer_annotation(writer, capture->sample_start, 0, comment) != 0)
+			result = -1;
+	}
+
+	if (fflush(writer->index) != 0)
+		result = -1;
+	return result;
+}
+
+int sigmf_writer_annotation(sigmf_writer_t* writer, uint64_t sample_start, uint64_t sample_count, const char* comment)
+{
+	int result;
+
+	pthread_mutex_lock(&writer->mp);
+	result = append_annotation(writer, sample_start, sample_count, comment);
+	writer->dirty = 1;
+	pthread_cond_signal(&writer->cv);
+	pthread_mutex_unlock(&writer->mp);
+
+	return result;
+}
+
+int sigmf_writer_close(sigmf_writer_t* writer)
+{
+	int result;
+
+	stop_meta_thread(writer);
+
+	result = -1;
+	if (list_flush(&writer->captures) == 0 && list_flush(&writer->annotations) == 0)
+	{
+		result = write_meta(writer, writer->captures.size, writer->annotations.size);
+	}
+	if (fclose(writer->index) != 0)
+		result = -1;
+
+	list_close(&writer->captures);
+	list_close(&writer->annotations);
+	free(writer);
+	return result;
+}
+
+void sigmf_writer_discard(sigmf_writer_t* writer)
+{
+	stop_meta_thread(writer);
+
+	fclose(writer->index);
+	remove(writer->index_path);
+	remove(writer->meta_path);
+
+	list_close(&writer->captures);
+	list_close(&writer->annotations);
+	free(writer);
+}
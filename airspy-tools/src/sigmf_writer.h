@@ -0,0 +1,70 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SIGMF_WRITER_H
+#define SIGMF_WRITER_H
+
+#include <stdint.h>
+
+/*
+ * SigMF sidecar for a recording: <name>.sigmf-meta next to the data file,
+ * plus <name>.sigmf-index, a CSV line per capture segment appended and
+ * flushed as soon as the segment starts:
+ *   sample_start,global_index,byte_offset,timestamp_ns,event,frequency_hz,dropped_samples
+ * event is one of start, gap, burst, retune or gain, burst when samples below
+ * a squelch were left out just before.
+ *
+ * The captures and annotations are kept on disk next to the index, not in
+ * memory. The .sigmf-meta file is written at open, then rewritten atomically
+ * by a thread of the writer at most once per second while they are added,
+ * and at close.
+ */
+
+#define SIGMF_VERSION "1.0.0"
+
+typedef struct
+{
+	uint64_t sample_start; /* Sample offset in the data file */
+	uint64_t global_index; /* Sample index in the receiver stream */
+	uint64_t timestamp; /* Host time of sample_start in ns since 1970-01-01 UTC, 0 if unknown */
+	uint64_t dropped_samples; /* Samples lost just before sample_start */
+	uint64_t skipped_samples; /* Samples below the squelch left out just before sample_start */
+	uint32_t freq_hz;
+	uint8_t lna_gain;
+	uint8_t mixer_gain;
+	uint8_t vga_gain;
+} sigmf_capture_t;
+
+typedef struct sigmf_writer sigmf_writer_t;
+
+/* data_path is the recording the sidecar describes, header_bytes the size of its file header (e.g. WAV) */
+sigmf_writer_t* sigmf_writer_open(const char* data_path, const char* datatype, uint32_t sample_rate,
+	uint32_t frame_size, uint32_t header_bytes, const char* recorder, const char* hw);
+
+/* Start a new capture segment, return 0 on success */
+int sigmf_writer_capture(sigmf_writer_t* writer, const sigmf_capture_t* capture);
+/* Add an annotation, sample_count 0 for a point in time. Return 0 on success */
+int sigmf_writer_annotation(sigmf_writer_t* writer, uint64_t sample_start, uint64_t sample_count, const char* comment);
+
+/* Write the final metadata and free the writer, return 0 on success */
+int sigmf_writer_close(sigmf_writer_t* writer);
+/* Free the writer and remove its files, for a recording which was never written */
+void sigmf_writer_discard(sigmf_writer_t* writer);
+
+#endif /* SIGMF_WRITER_H */
@@ -0,0 +1,491 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "spectrum.h"
+
+#include <airspy.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SPECTRUM_SSE
+#endif
+
+#ifndef bool
+typedef int bool;
+#define true 1
+#define false 0
+#endif
+
+#define SPECTRUM_PI (3.14159265358979323846)
+/* Frames buffered between the callback and the FFT thread, enough for two transfers of IQ samples */
+#define SPECTRUM_BUFFER_SAMPLES (131072)
+#define SPECTRUM_FRAMES_MIN (4)
+
+struct spectrum
+{
+	uint32_t fft_size;
+	uint32_t averages;
+	uint32_t sample_type;
+	uint32_t sample_rate;
+	uint64_t center_freq;
+	uint64_t report_samples;
+	FILE* output;
+
+	/* FFT */
+	float* window;
+	float window_gain; /* Sum of the window, amplitude of a full scale tone */
+	uint32_t* bitrev;
+	float* twiddle_re; /* Stage of half size h at [h, 2h[ */
+	float* twiddle_im;
+	float* re;
+	float* im;
+	float* power;
+	float* sorted;
+
+	/* Interleaved IQ frames, written by the callback, read by the FFT thread */
+	float** frames;
+	uint64_t* frame_period;
+	uint32_t frame_count;
+	volatile uint64_t pushed;
+	volatile uint64_t processed;
+
+	/* Callback side */
+	uint32_t fill; /* Samples of the current frame */
+	bool capturing; /* A buffer was free when the current frame started */
+	uint32_t taken; /* Frames of the current period */
+	uint64_t period;
+	uint64_t period_pos;
+	volatile uint64_t skipped;
+
+	/* FFT thread side */
+	uint32_t accumulated;
+	uint64_t accumulated_period;
+
+	pthread_t thread;
+	pthread_mutex_t mp;
+	pthread_cond_t cv;
+	bool running;
+	bool stop;
+};
+
+static void fft_init(spectrum_t* s)
+{
+	uint32_t i, j, h, bits;
+
+	for (bits = 0; (1u << bits) < s->fft_size; bits++)
+		;
+	for (i = 0; i < s->fft_size; i++)
+	{
+		for (j = 0, h = 0; h < bits; h++)
+			j |= ((i >> h) & 1) << (bits - 1 - h);
+		s->bitrev[i] = j;
+	}
+
+	for (h = 1; h < s->fft_size; h <<= 1)
+	{
+		for (j = 0; j < h; j++)
+		{
+			s->twiddle_re[h + j] = (float) cos(-SPECTRUM_PI * j / h);
+			s->twiddle_im[h + j] = (float) sin(-SPECTRUM_PI * j / h);
+		}
+	}
+
+	s->window_gain = 0;
+	for (i = 0; i < s->fft_size; i++)
+	{
+		s->window_gain += s->window[i];
+	}
+}
+
+static void window_init(float* window, uint32_t size, int type)
+{
+	uint32_t i;
+	double x;
+
+	for (i = 0; i < size; i++)
+	{
+		x = 2.0 * SPECTRUM_PI * i / size;
+		switch (type)
+		{
+		case SPECTRUM_WINDOW_HANN:
+			window[i] = (float) (0.5 - 0.5 * cos(x));
+			break;
+
+		case SPECTRUM_WINDOW_BLACKMAN_HARRIS:
+			window[i] = (float) (0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x));
+			break;
+
+		default:
+			window[i] = 1.0f;
+			break;
+		}
+	}
+}
+
+/* In place radix 2 FFT of s->re/s->im, already in bit reversed order */
+static void fft_process(spectrum_t* s)
+{
+	float* re = s->re;
+	float* im = s->im;
+	const float* wr;
+	const float* wi;
+	float tr, ti;
+	uint32_t n = s->fft_size;
+	uint32_t h, k, j;
+#ifdef SPECTRUM_SSE
+	__m128 ar, ai, br, bi, cr, ci, vr, vi;
+#endif
+
+	for (h = 1; h < n; h <<= 1)
+	{
+		wr = s->twiddle_re + h;
+		wi = s->twiddle_im + h;
+		for (k = 0; k < n; k += 2 * h)
+		{
+			j = 0;
+#ifdef SPECTRUM_SSE
+			/* Four butterflies at once from the stage of half size 4 */
+			for (; j + 4 <= h; j += 4)
+			{
+				ar = _mm_loadu_ps(re + k + j);
+				ai = _mm_loadu_ps(im + k + j);
+				br = _mm_loadu_ps(re + k + h + j);
+				bi = _mm_loadu_ps(im + k + h + j);
+				vr = _mm_loadu_ps(wr + j);
+				vi = _mm_loadu_ps(wi + j);
+				cr = _mm_sub_ps(_mm_mul_ps(br, vr), _mm_mul_ps(bi, vi));
+				ci = _mm_add_ps(_mm_mul_ps(br, vi), _mm_mul_ps(bi, vr));
+				_mm_storeu_ps(re + k + j, _mm_add_ps(ar, cr));
+				_mm_storeu_ps(im + k + j, _mm_add_ps(ai, ci));
+				_mm_storeu_ps(re + k + h + j, _mm_sub_ps(ar, cr));
+				_mm_storeu_ps(im + k + h + j, _mm_sub_ps(ai, ci));
+			}
+#endif
+			for (; j < h; j++)
+			{
+				tr = re[k + h + j] * wr[j] - im[k + h + j] * wi[j];
+				ti = re[k + h + j] * wi[j] + im[k + h + j] * wr[j];
+				re[k + h + j] = re[k + j] - tr;
+				im[k + h + j] = im[k + j] - ti;
+				re[k + j] += tr;
+				im[k + j] += ti;
+			}
+		}
+	}
+}
+
+static int compare_float(const void* a, const void* b)
+{
+	float x = *(const float*) a;
+	float y = *(const float*) b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(spectrum_t* s)
+{
+	uint32_t n = s->fft_size;
+	uint32_t i, bin, peak;
+	double scale;
+	double step;
+	double low;
+	time_t now;
+	struct tm* tm_now;
+	char date_time[32];
+
+	/* dBFS per bin, negative frequencies first */
+	scale = 1.0 / ((double) s->accumulated * s->window_gain * s->window_gain);
+	peak = 0;
+	for (i = 0; i < n; i++)
+	{
+		bin = (i + n / 2) & (n - 1);
+		s->sorted[i] = (float) (10.0 * log10(s->power[bin] * scale + 1e-20));
+		if (s->sorted[i] > s->sorted[peak])
+			peak = i;
+	}
+
+	step = (double) s->sample_rate / n;
+	low = (double) s->center_freq - s->sample_rate / 2.0;
+
+	if (s->output != NULL)
+	{
+		time(&now);
+		tm_now = localtime(&now);
+		strftime(date_time, sizeof(date_time), "%Y-%m-%d, %H:%M:%S", tm_now);
+		fprintf(s->output, "%s, %.0f, %.0f, %.2f, %u", date_time, low, low + step * n, step, s->accumulated * n);
+		for (i = 0; i < n; i++)
+			fprintf(s->output, ", %.2f", s->sorted[i]);
+		fprintf(s->output, "\n");
+		fflush(s->output);
+	}
+	else
+	{
+		fprintf(stderr, "Spectrum: peak %.6f MHz %.1f dBFS, ", (low + step * peak) * 1e-6, s->sorted[peak]);
+		qsort(s->sorted, n, sizeof(float), compare_float);
+		fprintf(stderr, "floor %.1f dBFS (%u averages)\n", s->sorted[n / 2], s->accumulated);
+	}
+
+	memset(s->power, 0, n * sizeof(float));
+	s->accumulated = 0;
+}
+
+static void process_frame(spectrum_t* s, const float* frame)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->fft_size; i++)
+	{
+		s->re[s->bitrev[i]] = frame[2 * i] * s->window[i];
+		s->im[s->bitrev[i]] = frame[2 * i + 1] * s->window[i];
+	}
+
+	fft_process(s);
+
+	for (i = 0; i < s->fft_size; i++)
+	{
+		s->power[i] += s->re[i] * s->re[i] + s->im[i] * s->im[i];
+	}
+}
+
+static void* spectrum_threadproc(void* arg)
+{
+	spectrum_t* s = (spectrum_t*) arg;
+	uint32_t slot;
+
+	pthread_mutex_lock(&s->mp);
+	while (true)
+	{
+		while (s->processed == s->pushed && !s->stop)
+		{
+			pthread_cond_wait(&s->cv, &s->mp);
+		}
+		if (s->processed == s->pushed)
+		{
+			break;
+		}
+		pthread_mutex_unlock(&s->mp);
+
+		slot = s->processed % s->frame_count;
+		/* Frames were skipped, report what the previous period got */
+		if (s->accumulated > 0 && s->frame_period[slot] != s->accumulated_period)
+			report(s);
+		process_frame(s, s->frames[slot]);
+		s->accumulated_period = s->frame_period[slot];
+		s->accumulated++;
+		if (s->accumulated == s->averages)
+			report(s);
+
+		pthread_mutex_lock(&s->mp);
+		s->processed++;
+	}
+	pthread_mutex_unlock(&s->mp);
+
+	return NULL;
+}
+
+spectrum_t* spectrum_open(uint32_t fft_size, uint32_t averages, int window, uint32_t sample_type,
+	uint32_t sample_rate, uint64_t center_freq, uint64_t report_samples, FILE* output)
+{
+	spectrum_t* s;
+	uint32_t i;
+	bool ok;
+
+	if (fft_size < SPECTRUM_FFT_SIZE_MIN || fft_size > SPECTRUM_FFT_SIZE_MAX || (fft_size & (fft_size - 1)) != 0 ||
+		averages < 1 || averages > SPECTRUM_AVERAGES_MAX || window < 0 || window > SPECTRUM_WINDOW_MAX ||
+		(sample_type != AIRSPY_SAMPLE_FLOAT32_IQ && sample_type != AIRSPY_SAMPLE_INT16_IQ))
+	{
+		return NULL;
+	}
+
+	s = (spectrum_t*) calloc(1, sizeof(spectrum_t));
+	if (s == NULL)
+	{
+		return NULL;
+	}
+
+	s->fft_size = fft_size;
+	s->averages = averages;
+	s->sample_type = sample_type;
+	s->sample_rate = sample_rate;
+	s->center_freq = center_freq;
+	s->report_samples = (report_samples > (uint64_t) fft_size * averages) ? report_samples : (uint64_t) fft_size * averages;
+	s->output = output;
+
+	s->window = (float*) calloc(fft_size, sizeof(float));
+	s->bitrev = (uint32_t*) calloc(fft_size, sizeof(uint32_t));
+	s->twiddle_re = (float*) calloc(fft_size, sizeof(float));
+	s->twiddle_im = (float*) calloc(fft_size, sizeof(float));
+	s->re = (float*) calloc(fft_size, sizeof(float));
+	s->im = (float*) calloc(fft_size, sizeof(float));
+	s->power = (float*) calloc(fft_size, sizeof(float));
+	s->sorted = (float*) calloc(fft_size, sizeof(float));
+	s->frame_count = SPECTRUM_BUFFER_SAMPLES / fft_size;
+	if (s->frame_count < SPECTRUM_FRAMES_MIN)
+		s->frame_count = SPECTRUM_FRAMES_MIN;
+	s->frames = (float**) calloc(s->frame_count, sizeof(float*));
+	s->frame_period = (uint64_t*) calloc(s->frame_count, sizeof(uint64_t));
+	ok = s->window && s->bitrev && s->twiddle_re && s->twiddle_im && s->re && s->im && s->power && s->sorted &&
+		s->frames && s->frame_period;
+	for (i = 0; ok && i < s->frame_count; i++)
+	{
+		s->frames[i] = (float*) calloc(fft_size * 2, sizeof(float));
+		ok = ok && s->frames[i] != NULL;
+	}
+	if (!ok)
+	{
+		spectrum_close(s);
+		return NULL;
+	}
+
+	window_init(s->window, fft_size, window);
+	fft_init(s);
+
+	pthread_mutex_init(&s->mp, NULL);
+	pthread_cond_init(&s->cv, NULL);
+	if (pthread_create(&s->thread, NULL, spectrum_threadproc, s) != 0)
+	{
+		pthread_cond_destroy(&s->cv);
+		pthread_mutex_destroy(&s->mp);
+		spectrum_close(s);
+		return NULL;
+	}
+	s->running = true;
+
+	return s;
+}
+
+static void copy_samples(spectrum_t* s, float* dst, const void* samples, uint32_t offset, uint32_t count)
+{
+	const int16_t* src_i;
+	uint32_t i;
+
+	if (s->sample_type == AIRSPY_SAMPLE_FLOAT32_IQ)
+	{
+		memcpy(dst, (const float*) samples + offset * 2, count * 2 * sizeof(float));
+	}
+	else
+	{
+		src_i = (const int16_t*) samples + offset * 2;
+		for (i = 0; i < count * 2; i++)
+			dst[i] = src_i[i] * (1.0f / 32768.0f);
+	}
+}
+
+void spectrum_push(spectrum_t* s, const void* samples, uint32_t sample_count)
+{
+	uint32_t offset = 0;
+	uint32_t n;
+	uint64_t left;
+
+	while (offset < sample_count)
+	{
+		left = s->report_samples - s->period_pos;
+		n = sample_count - offset;
+		if (n > left)
+			n = (uint32_t) left;
+
+		if (s->taken < s->averages)
+		{
+			if (s->fill == 0)
+				s->capturing = (s->pushed - s->processed < s->frame_count);
+			if (n > s->fft_size - s->fill)
+				n = s->fft_size - s->fill;
+			if (s->capturing)
+				copy_samples(s, s->frames[s->pushed % s->frame_count] + s->fill * 2, samples, offset, n);
+			s->fill += n;
+			if (s->fill == s->fft_size)
+			{
+				if (s->capturing)
+				{
+					s->frame_period[s->pushed % s->frame_count] = s->period;
+					pthread_mutex_lock(&s->mp);
+					s->pushed++;
+					pthread_cond_signal(&s->cv);
+					pthread_mutex_unlock(&s->mp);
+				}
+				else
+				{
+					s->skipped++;
+				}
+				s->fill = 0;
+				s->taken++;
+			}
+		}
+
+		offset += n;
+		s->period_pos += n;
+		if (s->period_pos == s->report_samples)
+		{
+			s->period++;
+			s->period_pos = 0;
+			s->taken = 0;
+			s->fill = 0;
+		}
+	}
+}
+
+uint64_t spectrum_skipped(spectrum_t* s)
+{
+	return s->skipped;
+}
+
+void spectrum_close(spectrum_t* s)
+{
+	uint32_t i;
+
+	if (s == NULL)
+	{
+		return;
+	}
+
+	if (s->running)
+	{
+		pthread_mutex_lock(&s->mp);
+		s->stop = true;
+		pthread_cond_signal(&s->cv);
+		pthread_mutex_unlock(&s->mp);
+		pthread_join(s->thread, NULL);
+		pthread_cond_destroy(&s->cv);
+		pthread_mutex_destroy(&s->mp);
+		if (s->accumulated > 0)
+			report(s);
+	}
+
+	for (i = 0; s->frames != NULL && i < s->frame_count; i++)
+	{
+		free(s->frames[i]);
+	}
+	free(s->frames);
+	free(s->frame_period);
+	free(s->sorted);
+	free(s->power);
+	free(s->im);
+	free(s->re);
+	free(s->twiddle_im);
+	free(s->twiddle_re);
+	free(s->bitrev);
+	free(s->window);
+	free(s);
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of AirSpy (based on HackRF project).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Averaged power spectrum of the IQ stream, computed on its own thread.
+ *
+ * spectrum_push() only copies the samples of the frames still needed for
+ * the current report, it never waits for the FFT thread: frames arriving
+ * while all buffers are busy are skipped. Every report_samples samples, the
+ * average of up to averages windowed FFTs is written as one rtl_power style
+ * CSV line (date, time, Hz low, Hz high, Hz step, samples, dBFS per bin) or,
+ * without an output file, summarized on stderr.
+ */
+
+#define SPECTRUM_FFT_SIZE_MIN (16)
+#define SPECTRUM_FFT_SIZE_MAX (65536)
+#define SPECTRUM_AVERAGES_MAX (10000)
+
+#define SPECTRUM_WINDOW_RECT (0)
+#define SPECTRUM_WINDOW_HANN (1)
+#define SPECTRUM_WINDOW_BLACKMAN_HARRIS (2)
+#define SPECTRUM_WINDOW_MAX (SPECTRUM_WINDOW_BLACKMAN_HARRIS)
+
+typedef struct spectrum spectrum_t;
+
+/* fft_size power of 2, sample_type AIRSPY_SAMPLE_FLOAT32_IQ or AIRSPY_SAMPLE_INT16_IQ,
+   output NULL to print a summary on stderr. Return NULL on error */
+spectrum_t* spectrum_open(uint32_t fft_size, uint32_t averages, int window, uint32_t sample_type,
+	uint32_t sample_rate, uint64_t center_freq, uint64_t report_samples, FILE* output);
+/* Called from the receive callback */
+void spectrum_push(spectrum_t* spectrum, const void* samples, uint32_t sample_count);
+/* Frames skipped because the FFT thread was late */
+uint64_t spectrum_skipped(spectrum_t* spectrum);
+/* Stop the thread and free, the output stream is left open */
+void spectrum_close(spectrum_t* spectrum);
+
+#endif /* SPECTRUM_H */
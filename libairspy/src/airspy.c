@@ -25,14 +25,25 @@ ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSI
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 #include <libusb.h>
 #include <pthread.h>
 
 #include "airspy.h"
 #include "iqconverter_float.h"
 #include "iqconverter_int16.h"
+#include "iqpacker.h"
+#include "fir_filter.h"
+#include "resampler.h"
+#include "cic_decimator.h"
 #include "filters.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#endif
+
 #ifndef bool
 typedef int bool;
 #define true 1
@@ -60,12 +71,40 @@ typedef int bool;
 #define USB_PRODUCT_ID (2)
 #define STR_DESCRIPTOR_SIZE (250)
 
+#define GATE_OFF (0)
+#define GATE_MARK (1)
+#define GATE_DROP (2)
+#define GATE_PREROLL_MAX_MS (1000)
+
+#define HOST_AGC_VGA_START (5) /* VGA gain the host AGC starts from when none was set */
+
 typedef struct {
 	uint32_t freq_hz;
 } set_freq_params_t;
 
+/* Captured with each raw buffer in the USB callback */
+typedef struct {
+	uint64_t sample_index;
+	uint64_t timestamp;
+	uint64_t dropped_samples;
+} raw_buffer_info_t;
+
+/* Block held back in the pre-roll delay line of the burst gate */
+typedef struct {
+	airspy_transfer_t transfer;
+	void* samples; /* Copy of the block, transfer.samples points here */
+	uint32_t adc_histogram[AIRSPY_ADC_HISTOGRAM_BINS]; /* transfer.adc_histogram points here if not NULL */
+} gate_block_t;
+
 typedef struct airspy_device
 {
+	FILE* replay_file; /* NULL for a USB device */
+	bool replay_fast;
+	volatile bool replay_done;
+	volatile uint64_t replay_converted; /* Raw buffers converted, counted by the conversion thread */
+	uint32_t raw_sample_rate; /* Raw samples per second */
+	uint8_t* replay_buffer;
+	pthread_cond_t replay_cv;
 	libusb_context* usb_context;
 	libusb_device_handle* usb_device;
 	struct libusb_transfer** transfers;
@@ -74,22 +113,76 @@ typedef struct airspy_device
 	volatile bool stop_requested;
 	pthread_t transfer_thread;
 	pthread_t conversion_thread;
+	pthread_t control_thread; /* Issues the retunes of the sweep and the VGA steps of the host AGC */
 	pthread_cond_t conversion_cv;
+	pthread_cond_t control_cv;
 	pthread_mutex_t conversion_mp;
 	uint32_t transfer_count;
 	uint32_t buffer_size;
-	uint32_t total_dropped_samples;	
+	uint64_t total_dropped_samples;
+	volatile uint64_t received_sample_index;
+	uint64_t pending_dropped_samples;
 	uint16_t *received_samples_queue[RAW_BUFFER_COUNT];
+	raw_buffer_info_t received_samples_info[RAW_BUFFER_COUNT];
 	volatile int received_samples_queue_head;
 	volatile int received_samples_queue_tail;
 	volatile bool converter_is_waiting;
 	void *output_buffer;
 	iqconveter_float_t *cnv_f;
 	iqconveter_int16_t *cnv_i;
+	fir_filter_t *fir; /* User FIR on the float output, NULL if none */
+	uint32_t resample_rate; /* Output sample rate, 0 for none */
+	resampler_t *resampler; /* Created by airspy_start_rx() */
+	uint32_t cic_factor; /* Decimation of the INT16_IQ output, 0 for none */
+	cic_decimator_t *cic; /* Created by airspy_start_rx() */
 	void* ctx;
 	enum airspy_sample_type sample_type;
+	uint32_t freq_hz; /* Last frequency set, 0 if never set */
+	uint32_t* sweep_freqs; /* NULL when not sweeping */
+	uint32_t sweep_count;
+	uint32_t sweep_settle_samples;
+	uint32_t sweep_dwell_samples;
+	uint32_t sweep_step;
+	uint64_t sweep_start; /* Output sample index where the dwell of sweep_step begins */
+	uint32_t sweep_freq_request; /* Frequency of a sweep step not applied yet, 0 if none */
+	bool sweep_pending; /* sweep_start waits for the retune of sweep_step */
+	uint64_t retune_begin; /* Raw sample indexes of the last retune, see airspy_transfer_t */
+	uint64_t retune_end;
+	uint8_t lna_gain;
+	uint8_t mixer_gain;
+	uint8_t vga_gain;
+	uint8_t agc_vga_request; /* VGA gain of a host AGC step not applied yet, AIRSPY_GAIN_UNKNOWN if none */
+	uint8_t agc; /* AIRSPY_AGC_* flags */
+	float host_agc_low; /* RMS range of the host AGC */
+	float host_agc_high;
+	uint8_t gate_mode; /* GATE_OFF, GATE_MARK or GATE_DROP */
+	float gate_open_rms; /* RMS levels starting and sustaining a burst */
+	float gate_close_rms;
+	uint32_t gate_preroll_ms;
+	uint32_t gate_hold_ms;
+	uint64_t gate_hold_samples; /* Raw samples, set by airspy_start_rx() */
+	uint64_t gate_hold_until; /* Raw sample index where the hold of the last loud block ends */
+	bool gate_active; /* Last block measured was part of a burst */
+	bool gate_last_active; /* Last block passed on was part of a burst */
+	gate_block_t* gate_blocks; /* Pre-roll delay line, NULL if none */
+	uint8_t* gate_buffer;
+	uint32_t gate_block_count;
+	uint32_t gate_block_head; /* Oldest block */
+	uint32_t gate_block_fill;
+	bool adc_histogram_enabled;
+	uint32_t adc_histogram[AIRSPY_ADC_HISTOGRAM_BINS]; /* Of the last block converted */
 } airspy_device_t;
 
+typedef struct airspy_converter
+{
+	enum airspy_sample_type sample_type;
+	iqconveter_float_t *cnv_f;
+	iqconveter_int16_t *cnv_i;
+	int16_t *work; /* INT16_IQ samples before packing */
+	int work_count;
+	airspy_block_stats_t stats; /* Of the last block */
+} airspy_converter_t;
+
 static const uint16_t airspy_usb_vid = 0x1d50;
 static const uint16_t airspy_usb_pid = 0x60a1;
 
@@ -122,9 +215,28 @@ static int cancel_transfers(airspy_device_t* device)
 	}
 }
 
-static int free_transfers(airspy_device_t* device)
+static void free_sample_buffers(airspy_device_t* device)
 {
 	int i;
+
+	if (device->output_buffer != NULL)
+	{
+		free(device->output_buffer);
+		device->output_buffer = NULL;
+	}
+
+	for (i = 0; i < RAW_BUFFER_COUNT; i++)
+	{
+		if (device->received_samples_queue[i] != NULL)
+		{
+			free(device->received_samples_queue[i]);
+			device->received_samples_queue[i] = NULL;
+		}
+	}
+}
+
+static int free_transfers(airspy_device_t* device)
+{
 	uint32_t transfer_index;
 
 	if (device->transfers != NULL)
@@ -141,20 +253,34 @@ static int free_transfers(airspy_device_t* device)
 		free(device->transfers);
 		device->transfers = NULL;
 
-		if (device->output_buffer != NULL)
-		{
-			free(device->output_buffer);
-			device->output_buffer = NULL;
-		}
+		free_sample_buffers(device);
+	}
+
+	return AIRSPY_SUCCESS;
+}
+
+static int allocate_sample_buffers(airspy_device_t* const device)
+{
+	int i;
+	size_t sample_count;
 
-		for (i = 0; i < RAW_BUFFER_COUNT; i++)
+	for (i = 0; i < RAW_BUFFER_COUNT; i++)
+	{
+		device->received_samples_queue[i] = (uint16_t *)malloc(device->buffer_size);
+		if (device->received_samples_queue[i] == NULL)
 		{
-			if (device->received_samples_queue[i] != NULL)
-			{
-				free(device->received_samples_queue[i]);
-				device->received_samples_queue[i] = NULL;
-			}
+			return AIRSPY_ERROR_NO_MEM;
 		}
+
+		memset(device->received_samples_queue[i], 0, device->buffer_size);
+	}
+
+	sample_count = device->buffer_size / 2;
+
+	device->output_buffer = (float *) malloc(sample_count * sizeof(float));
+	if (device->output_buffer == NULL)
+	{
+		return AIRSPY_ERROR_NO_MEM;
 	}
 
 	return AIRSPY_SUCCESS;
@@ -162,27 +288,11 @@ static int free_transfers(airspy_device_t* device)
 
 static int allocate_transfers(airspy_device_t* const device)
 {
-	int i;
-	size_t sample_count;
 	uint32_t transfer_index;
 
 	if( device->transfers == NULL )
 	{
-		for (i = 0; i < RAW_BUFFER_COUNT; i++)
-		{
-			device->received_samples_queue[i] = (uint16_t *)malloc(device->buffer_size);
-			if (device->received_samples_queue[i] == NULL)
-			{
-				return AIRSPY_ERROR_NO_MEM;
-			}
-
-			memset(device->received_samples_queue[i], 0, device->buffer_size);
-		}
-
-		sample_count = device->buffer_size / 2;
-		
-		device->output_buffer = (float *) malloc(sample_count * sizeof(float));
-		if (device->output_buffer == NULL)
+		if (allocate_sample_buffers(device) != AIRSPY_SUCCESS)
 		{
 			return AIRSPY_ERROR_NO_MEM;
 		}
@@ -249,219 +359,1324 @@ static int prepare_transfers(airspy_device_t* device, const uint_fast8_t endpoin
 	}
 }
 
-static void convert_samples_int16(uint16_t *src, int16_t *dest, int count)
+/* Vendor request emulated for a replay device: reads return zeros and writes are accepted */
+static int replay_control_transfer(airspy_device_t* device, uint8_t request_type, uint8_t request,
+	uint16_t index, unsigned char* data, uint16_t length)
 {
-	int i;
-	for (i = 0; i < count; i++)
+	if (request == AIRSPY_SET_SAMPLERATE)
+	{
+		device->raw_sample_rate = (index == AIRSPY_SAMPLERATE_2_5MSPS) ? 5000000 : 20000000;
+	}
+
+	if ((request_type & LIBUSB_ENDPOINT_IN) && (data != NULL))
+	{
+		memset(data, 0, length);
+		if (request == AIRSPY_VERSION_STRING_READ)
+		{
+			strncpy((char*) data, "AirSpy file replay", length);
+		}
+	}
+
+	return length;
+}
+
+/* Requests changing the received signal */
+static bool is_retune_request(uint8_t request)
+{
+	switch (request)
 	{
-		dest[i] = ((src[i] & 0xFFF) - 2048) << SAMPLE_SHIFT;
+	case AIRSPY_R820T_WRITE:
+	case AIRSPY_SET_FREQ:
+	case AIRSPY_SET_LNA_GAIN:
+	case AIRSPY_SET_MIXER_GAIN:
+	case AIRSPY_SET_VGA_GAIN:
+	case AIRSPY_SET_LNA_AGC:
+	case AIRSPY_SET_MIXER_AGC:
+	case AIRSPY_SET_RF_BIAS_CMD:
+		return true;
+
+	default:
+		return false;
 	}
 }
 
-static void convert_samples_float(uint16_t *src, float *dest, int count)
+/* Vendor request to the device, the samples around requests changing the signal are recorded while streaming */
+static int airspy_control_transfer(airspy_device_t* device, uint8_t request_type, uint8_t request,
+	uint16_t value, uint16_t index, unsigned char* data, uint16_t length, unsigned int timeout)
 {
-	int i;
-	for (i = 0; i < count; i++)
+	uint64_t begin;
+	int result;
+
+	begin = device->received_sample_index;
+
+	if (device->replay_file == NULL)
+	{
+		result = libusb_control_transfer(device->usb_device, request_type, request, value, index, data, length, timeout);
+	}
+	else
+	{
+		result = replay_control_transfer(device, request_type, request, index, data, length);
+	}
+
+	if (device->streaming && result >= 0 && is_retune_request(request))
 	{
-		dest[i] = ((src[i] & 0xFFF) - 2048) * SAMPLE_SCALE;
+		pthread_mutex_lock(&device->conversion_mp);
+		device->retune_begin = begin;
+		/* The transfer being filled may still hold samples taken before the completion */
+		device->retune_end = device->received_sample_index + device->buffer_size / 2;
+		pthread_mutex_unlock(&device->conversion_mp);
 	}
+
+	return result;
 }
 
-static void* conversion_threadproc(void *arg)
+/* Wall clock time in ns, comparable between receivers on hosts synchronized with NTP/PTP */
+static uint64_t get_timestamp(void)
 {
-	int sample_count;
-	uint16_t* input_samples;
-	airspy_device_t* device = (airspy_device_t*)arg;
-	airspy_transfer_t transfer;
+#ifdef _WIN32
+	FILETIME ft;
+	uint64_t t;
+
+	GetSystemTimeAsFileTime(&ft);
+	t = ((uint64_t) ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return (t - 116444736000000000ULL) * 100;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
 
+static void sleep_ns(uint64_t duration)
+{
 #ifdef _WIN32
+	Sleep((DWORD)(duration / 1000000));
+#else
+	struct timespec ts;
 
-	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+	ts.tv_sec = (time_t)(duration / 1000000000ULL);
+	ts.tv_nsec = (long)(duration % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/*
+ * Conversion of count raw samples into dest_i or dest_f if not NULL, measuring them as real samples on the
+ * same pass, the codes at the ADC limits counted. histogram if not NULL gets the counts of the codes per bin.
+ */
+static void convert_samples_raw(uint16_t *src, int16_t *dest_i, float *dest_f, int count, airspy_block_stats_t* stats,
+	uint32_t* histogram)
+{
+	int i;
+	int k;
+	int32_t x;
+	int32_t max;
+	int32_t min;
+	int64_t sum;
+	int64_t sum_sq;
+	uint32_t clipped;
+	/* Interleaved sub-histograms, consecutive samples rarely wait on the same counter */
+	uint32_t bins[4][AIRSPY_ADC_HISTOGRAM_BINS];
+
+#ifdef CONVERT_SSE2
+
+	/* Eight samples per vector, the 16 and 32 bit counts are flushed before they can overflow */
+	__m128i mask = _mm_set1_epi16(0xFFF);
+	__m128i offset = _mm_set1_epi16(2048);
+	__m128i code_min = _mm_set1_epi16(-2048);
+	__m128i code_max = _mm_set1_epi16(2047);
+	__m128i ones = _mm_set1_epi16(1);
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	__m128i acc_sq = _mm_setzero_si128();
+	__m128i acc_clip = _mm_setzero_si128();
+	__m128i vmax = _mm_setzero_si128();
+	__m128i vmin = _mm_setzero_si128();
+	__m128i r, v, s;
+	__m128 scale = _mm_set1_ps(SAMPLE_SCALE);
+	int32_t tmp32[4];
+	int64_t tmp64[2];
+	int16_t tmp16[8];
+	int j;
 
 #endif
 
-	while (device->streaming && !device->stop_requested)
+	max = 0;
+	min = 0;
+	sum = 0;
+	sum_sq = 0;
+	clipped = 0;
+	if (histogram != NULL)
 	{
-		if (device->received_samples_queue_head == device->received_samples_queue_tail)
+		memset(bins, 0, sizeof(bins));
+	}
+	i = 0;
+
+#ifdef CONVERT_SSE2
+
+	while (i + 8 <= count)
+	{
+		for (j = 0; j < 16384 && i + 8 <= count; j++, i += 8)
 		{
-			pthread_mutex_lock(&device->conversion_mp);
-			device->converter_is_waiting = true;
-			while (device->received_samples_queue_head == device->received_samples_queue_tail &&
-				!device->stop_requested && device->streaming)
+			r = _mm_and_si128(_mm_loadu_si128((const __m128i *) (src + i)), mask);
+			v = _mm_sub_epi16(r, offset);
+			if (dest_i != NULL)
 			{
-				pthread_cond_wait(&device->conversion_cv, &device->conversion_mp);
+				_mm_storeu_si128((__m128i *) (dest_i + i), _mm_slli_epi16(v, SAMPLE_SHIFT));
+			}
+			else if (dest_f != NULL)
+			{
+				_mm_storeu_ps(dest_f + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale));
+				_mm_storeu_ps(dest_f + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale));
 			}
-			device->converter_is_waiting = false;
-			pthread_mutex_unlock(&device->conversion_mp);
 
-			if (device->stop_requested || !device->streaming)
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(v, ones));
+			s = _mm_madd_epi16(v, v);
+			acc_sq = _mm_add_epi64(acc_sq, _mm_add_epi64(_mm_unpacklo_epi32(s, zero), _mm_unpackhi_epi32(s, zero)));
+			vmax = _mm_max_epi16(vmax, v);
+			vmin = _mm_min_epi16(vmin, v);
+			acc_clip = _mm_sub_epi16(acc_clip, _mm_or_si128(_mm_cmpeq_epi16(v, code_min), _mm_cmpeq_epi16(v, code_max)));
+
+			if (histogram != NULL)
 			{
-				continue;
+				_mm_storeu_si128((__m128i *) tmp16, _mm_srli_epi16(r, 6));
+				for (k = 0; k < 8; k++)
+				{
+					bins[k & 3][tmp16[k]]++;
+				}
 			}
 		}
 
-		input_samples = device->received_samples_queue[device->received_samples_queue_tail];
-		sample_count = device->buffer_size / 2;
+		_mm_storeu_si128((__m128i *) tmp32, acc);
+		sum += (int64_t) tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+		_mm_storeu_si128((__m128i *) tmp32, _mm_madd_epi16(acc_clip, ones));
+		clipped += tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+		acc = _mm_setzero_si128();
+		acc_clip = _mm_setzero_si128();
+	}
+
+	_mm_storeu_si128((__m128i *) tmp64, acc_sq);
+	sum_sq = tmp64[0] + tmp64[1];
+	_mm_storeu_si128((__m128i *) tmp16, vmax);
+	for (j = 0; j < 8; j++)
+		max = tmp16[j] > max ? tmp16[j] : max;
+	_mm_storeu_si128((__m128i *) tmp16, vmin);
+	for (j = 0; j < 8; j++)
+		min = tmp16[j] < min ? tmp16[j] : min;
+
+#endif
 
-		switch (device->sample_type)
+	for (; i < count; i++)
+	{
+		x = (src[i] & 0xFFF) - 2048;
+		sum += x;
+		sum_sq += x * x;
+		max = x > max ? x : max;
+		min = x < min ? x : min;
+		if (x == -2048 || x == 2047)
+			clipped++;
+		if (histogram != NULL)
+			bins[i & 3][(x + 2048) >> 6]++;
+		if (dest_i != NULL)
+			dest_i[i] = x << SAMPLE_SHIFT;
+		else if (dest_f != NULL)
+			dest_f[i] = x * SAMPLE_SCALE;
+	}
+
+	if (histogram != NULL)
+	{
+		for (k = 0; k < AIRSPY_ADC_HISTOGRAM_BINS; k++)
 		{
-		case AIRSPY_SAMPLE_FLOAT32_IQ:
-			convert_samples_float(input_samples, (float *)device->output_buffer, sample_count);
-			iqconverter_float_process(device->cnv_f, (float *) device->output_buffer, sample_count);
-			sample_count /= 2;
-			transfer.samples = device->output_buffer;
-			break;
+			histogram[k] = bins[0][k] + bins[1][k] + bins[2][k] + bins[3][k];
+		}
+	}
 
-		case AIRSPY_SAMPLE_FLOAT32_REAL:
-			convert_samples_float(input_samples, (float *)device->output_buffer, sample_count);
-			transfer.samples = device->output_buffer;
-			break;
+	memset(stats, 0, sizeof(airspy_block_stats_t));
+	stats->clipped = clipped;
+	if (count > 0)
+	{
+		stats->mean_i = (float) sum / (2048.0f * count);
+		stats->rms_i = sqrtf((float) sum_sq / count) / 2048.0f;
+		stats->peak_i = (float) (max > -min ? max : -min) / 2048.0f;
+	}
+}
 
-		case AIRSPY_SAMPLE_INT16_IQ:
-			convert_samples_int16(input_samples, (int16_t *)device->output_buffer, sample_count);
-			iqconverter_int16_process(device->cnv_i, (int16_t *) device->output_buffer, sample_count);
-			sample_count /= 2;
-			transfer.samples = device->output_buffer;
-			break;
+static void float_stats(const iqconveter_float_t* cnv, airspy_block_stats_t* stats)
+{
+	stats->mean_i = cnv->mean_i;
+	stats->mean_q = cnv->mean_q;
+	stats->rms_i = cnv->rms_i;
+	stats->rms_q = cnv->rms_q;
+	stats->peak_i = cnv->peak_i;
+	stats->peak_q = cnv->peak_q;
+}
 
-		case AIRSPY_SAMPLE_INT16_REAL:
-			convert_samples_int16(input_samples, (int16_t *)device->output_buffer, sample_count);
-			transfer.samples = device->output_buffer;
-			break;
+static void int16_stats(const iqconveter_int16_t* cnv, airspy_block_stats_t* stats)
+{
+	stats->mean_i = cnv->mean_i;
+	stats->mean_q = cnv->mean_q;
+	stats->rms_i = cnv->rms_i;
+	stats->rms_q = cnv->rms_q;
+	stats->peak_i = cnv->peak_i;
+	stats->peak_q = cnv->peak_q;
+}
 
-		case AIRSPY_SAMPLE_UINT16_REAL:
-			transfer.samples = input_samples;
-			break;
+/*
+ * Convert count raw samples to sample_type. output holds count floats for the float types, count int16
+ * otherwise, packed holds the packed types. Set *samples to the converted data and *stats to its levels,
+ * fill histogram if not NULL. Return the output sample count.
+ */
+static int convert_samples(enum airspy_sample_type sample_type, iqconveter_float_t* cnv_f, iqconveter_int16_t* cnv_i,
+	uint16_t* input_samples, int sample_count, void* output, uint8_t* packed, void** samples, airspy_block_stats_t* stats,
+	uint32_t* histogram)
+{
+	switch (sample_type)
+	{
+	case AIRSPY_SAMPLE_FLOAT32_IQ:
+		convert_samples_raw(input_samples, NULL, (float *) output, sample_count, stats, histogram);
+		iqconverter_float_process(cnv_f, (float *) output, sample_count);
+		float_stats(cnv_f, stats);
+		sample_count /= 2;
+		*samples = output;
+		break;
+
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+		convert_samples_raw(input_samples, NULL, (float *) output, sample_count, stats, histogram);
+		*samples = output;
+		break;
+
+	case AIRSPY_SAMPLE_INT16_IQ:
+		convert_samples_raw(input_samples, (int16_t *) output, NULL, sample_count, stats, histogram);
+		iqconverter_int16_process(cnv_i, (int16_t *) output, sample_count);
+		int16_stats(cnv_i, stats);
+		sample_count /= 2;
+		*samples = output;
+		break;
+
+	case AIRSPY_SAMPLE_INT16_REAL:
+		convert_samples_raw(input_samples, (int16_t *) output, NULL, sample_count, stats, histogram);
+		*samples = output;
+		break;
+
+	case AIRSPY_SAMPLE_UINT16_REAL:
+		convert_samples_raw(input_samples, NULL, NULL, sample_count, stats, histogram);
+		*samples = input_samples;
+		break;
+
+	case AIRSPY_SAMPLE_INT12_PACKED_IQ:
+	case AIRSPY_SAMPLE_INT8_BFP_IQ:
+		/* INT16_IQ conversion then packed */
+		convert_samples_raw(input_samples, (int16_t *) output, NULL, sample_count, stats, histogram);
+		iqconverter_int16_process(cnv_i, (int16_t *) output, sample_count);
+		int16_stats(cnv_i, stats);
+		sample_count /= 2;
+		if (sample_type == AIRSPY_SAMPLE_INT12_PACKED_IQ)
+			iqpacker_int12((int16_t *) output, packed, sample_count);
+		else
+			iqpacker_int8_bfp((int16_t *) output, packed, sample_count);
+		*samples = packed;
+		break;
+
+	case AIRSPY_SAMPLE_END:
+		// Just to shut GCC's moaning
+		break;
+	}
 
-		case AIRSPY_SAMPLE_END:
-			// Just to shut GCC's moaning
-			break;
-		}
+	return sample_count;
+}
 
-		transfer.device = device;
-		transfer.ctx = device->ctx;
-		transfer.sample_count = sample_count;
-		transfer.sample_type = device->sample_type;
+static const float* const hb_kernels_float[AIRSPY_CONVERTER_END] =
+{
+	HB_KERNEL_FLOAT_15, HB_KERNEL_FLOAT_31, HB_KERNEL_FLOAT, HB_KERNEL_FLOAT_95
+};
+
+static const int16_t* const hb_kernels_int16[AIRSPY_CONVERTER_END] =
+{
+	HB_KERNEL_INT16_15, HB_KERNEL_INT16_31, HB_KERNEL_INT16, HB_KERNEL_INT16_95
+};
 
-		if (device->callback(&transfer) != 0)
+static const int hb_kernel_lens[AIRSPY_CONVERTER_END] =
+{
+	HB_KERNEL_FLOAT_15_LEN, HB_KERNEL_FLOAT_31_LEN, HB_KERNEL_FLOAT_LEN, HB_KERNEL_FLOAT_95_LEN
+};
+
+/* Create both IQ converters with the kernel of profile, none of them unless both are created */
+static int create_converters(enum airspy_converter_profile profile, iqconveter_float_t** cnv_f, iqconveter_int16_t** cnv_i)
+{
+	*cnv_f = iqconverter_float_create(hb_kernels_float[profile], hb_kernel_lens[profile]);
+	*cnv_i = iqconverter_int16_create(hb_kernels_int16[profile], hb_kernel_lens[profile]);
+	if (*cnv_f == NULL || *cnv_i == NULL)
+	{
+		if (*cnv_f != NULL)
 		{
-			device->stop_requested = true;
+			iqconverter_float_free(*cnv_f);
 		}
-
-		device->received_samples_queue_tail = (device->received_samples_queue_tail + 1) & (RAW_BUFFER_COUNT - 1);
+		if (*cnv_i != NULL)
+		{
+			iqconverter_int16_free(*cnv_i);
+		}
+		*cnv_f = NULL;
+		*cnv_i = NULL;
+		return AIRSPY_ERROR_NO_MEM;
 	}
-
-	return NULL;
+	return AIRSPY_SUCCESS;
 }
 
-static void airspy_libusb_transfer_callback(struct libusb_transfer* usb_transfer)
+/* Replace the IQ converters with ones using the kernel of profile, keeping the float post processing settings */
+static int replace_converters(enum airspy_converter_profile profile, iqconveter_float_t** cnv_f, iqconveter_int16_t** cnv_i)
 {
-	uint16_t *temp;
-	airspy_device_t* device = (airspy_device_t*) usb_transfer->user_data;
+	iqconveter_float_t* new_f;
+	iqconveter_int16_t* new_i;
 
-	if (!device->streaming || device->stop_requested)
+	if (profile < 0 || profile >= AIRSPY_CONVERTER_END)
 	{
-		return;
+		return AIRSPY_ERROR_INVALID_PARAM;
 	}
 
-	if (usb_transfer->status == LIBUSB_TRANSFER_COMPLETED)
+	if (create_converters(profile, &new_f, &new_i) != AIRSPY_SUCCESS)
 	{
-		if (device->received_samples_queue_head != device->received_samples_queue_tail || device->converter_is_waiting)
-		{
-			temp = device->received_samples_queue[device->received_samples_queue_head];
-			device->received_samples_queue[device->received_samples_queue_head] = (uint16_t *) usb_transfer->buffer;
-			usb_transfer->buffer = (uint8_t *) temp;
-			device->received_samples_queue_head = (device->received_samples_queue_head + 1) & (RAW_BUFFER_COUNT - 1);
+		/* Keep the current converters */
+		return AIRSPY_ERROR_NO_MEM;
+	}
 
-			if (device->converter_is_waiting)
-			{
-				pthread_mutex_lock(&device->conversion_mp);
-				pthread_cond_signal(&device->conversion_cv);
-				pthread_mutex_unlock(&device->conversion_mp);
-			}
-		}
+	iqconverter_float_set_normalization(new_f, (*cnv_f)->norm_target);
+	iqconverter_float_set_iq_correction(new_f, (*cnv_f)->iq_correct);
+
+	iqconverter_float_free(*cnv_f);
+	iqconverter_int16_free(*cnv_i);
+	*cnv_f = new_f;
+	*cnv_i = new_i;
+	return AIRSPY_SUCCESS;
+}
+
+/* RMS of count int16 or float values, 1.0 is full scale */
+static float block_rms(enum airspy_sample_type sample_type, const void* samples, int count)
+{
+	const float* f = (const float *) samples;
+	const int16_t* s = (const int16_t *) samples;
+	const uint16_t* u = (const uint16_t *) samples;
+	float sum = 0.0f;
+	int i;
+
+	if (count == 0)
+	{
+		return 0.0f;
 	}
 
-	if (libusb_submit_transfer(usb_transfer) != 0)
+	switch (sample_type)
 	{
-		device->streaming = false;
+	case AIRSPY_SAMPLE_FLOAT32_IQ:
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+		for (i = 0; i < count; i++)
+			sum += f[i] * f[i];
+		break;
+
+	case AIRSPY_SAMPLE_UINT16_REAL:
+		for (i = 0; i < count; i++)
+			sum += (float) (((int) u[i] - 2048) * ((int) u[i] - 2048));
+		sum *= 1.0f / (2048.0f * 2048.0f);
+		break;
+
+	default:
+		for (i = 0; i < count; i++)
+			sum += (float) s[i] * s[i];
+		sum *= 1.0f / (32768.0f * 32768.0f);
+		break;
 	}
+
+	return sqrtf(sum / count);
 }
 
-static void* transfer_threadproc(void* arg)
+/* RMS of the I and Q values measured by the conversion, as block_rms() of the converted block */
+static float stats_rms(enum airspy_sample_type sample_type, const airspy_block_stats_t* stats)
 {
-	airspy_device_t* device = (airspy_device_t*)arg;
-	int error;
-	struct timeval timeout = { 0, 500000 };
+	switch (sample_type)
+	{
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+	case AIRSPY_SAMPLE_INT16_REAL:
+	case AIRSPY_SAMPLE_UINT16_REAL:
+		return stats->rms_i;
 
-#ifdef _WIN32
+	default:
+		return sqrtf((stats->rms_i * stats->rms_i + stats->rms_q * stats->rms_q) * 0.5f);
+	}
+}
 
-	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+/* One VGA step toward the host AGC range, or down on clipping, once the samples of the previous step are in.
+   The step is left to control_threadproc(), a control transfer would stall the conversion */
+static void host_agc_update(airspy_device_t* device, uint64_t block_raw_index, float rms, uint32_t clipped)
+{
+	pthread_mutex_lock(&device->conversion_mp);
+	if (device->agc_vga_request == AIRSPY_GAIN_UNKNOWN && block_raw_index >= device->retune_end &&
+		device->vga_gain != AIRSPY_GAIN_UNKNOWN)
+	{
+		if ((rms > device->host_agc_high || clipped > 0) && device->vga_gain > 0)
+		{
+			device->agc_vga_request = device->vga_gain - 1;
+		}
+		else if (rms < device->host_agc_low && device->vga_gain < 15)
+		{
+			device->agc_vga_request = device->vga_gain + 1;
+		}
 
-#endif
+		if (device->agc_vga_request != AIRSPY_GAIN_UNKNOWN)
+		{
+			pthread_cond_signal(&device->control_cv);
+		}
+	}
+	pthread_mutex_unlock(&device->conversion_mp);
+}
 
-	while (device->streaming && !device->stop_requested)
+static void* control_threadproc(void* arg)
+{
+	airspy_device_t* device = (airspy_device_t*)arg;
+	uint32_t freq_hz;
+	uint8_t value;
+
+	pthread_mutex_lock(&device->conversion_mp);
+	while (!device->stop_requested)
 	{
-		error = libusb_handle_events_timeout_completed(device->usb_context, &timeout, NULL);
-		if (error < 0)
+		if (device->sweep_freq_request != 0)
 		{
-			if (error != LIBUSB_ERROR_INTERRUPTED)
-			device->streaming = false;
+			freq_hz = device->sweep_freq_request;
+			pthread_mutex_unlock(&device->conversion_mp);
+			airspy_set_freq(device, freq_hz);
+			pthread_mutex_lock(&device->conversion_mp);
+			device->sweep_freq_request = 0;
+		}
+		else if (device->agc_vga_request != AIRSPY_GAIN_UNKNOWN)
+		{
+			value = device->agc_vga_request;
+			pthread_mutex_unlock(&device->conversion_mp);
+			/* Sets retune_end before the request is cleared, no further step until its samples are in */
+			airspy_set_vga_gain(device, value);
+			pthread_mutex_lock(&device->conversion_mp);
+			device->agc_vga_request = AIRSPY_GAIN_UNKNOWN;
+		}
+		else
+		{
+			pthread_cond_wait(&device->control_cv, &device->conversion_mp);
 		}
 	}
+	pthread_mutex_unlock(&device->conversion_mp);
 
 	return NULL;
 }
 
-static int kill_io_threads(airspy_device_t* device)
+/* Bytes taken by the first sample_count samples of a converted block */
+static size_t block_bytes(enum airspy_sample_type sample_type, uint64_t sample_count)
 {
-	if (device->streaming)
+	switch (sample_type)
 	{
-		device->stop_requested = true;
-		cancel_transfers(device);
+	case AIRSPY_SAMPLE_FLOAT32_IQ:
+		return (size_t) sample_count * 2 * sizeof(float);
 
-		pthread_cond_signal(&device->conversion_cv);
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+		return (size_t) sample_count * sizeof(float);
 
-		pthread_join(device->transfer_thread, NULL);
-		pthread_join(device->conversion_thread, NULL);
+	case AIRSPY_SAMPLE_INT16_IQ:
+		return (size_t) sample_count * 2 * sizeof(int16_t);
 
-		device->stop_requested = false;
-		device->streaming = false;
+	case AIRSPY_SAMPLE_INT12_PACKED_IQ:
+		return (size_t) sample_count * 3;
+
+	case AIRSPY_SAMPLE_INT8_BFP_IQ:
+		return (size_t) (sample_count / AIRSPY_INT8_BFP_BLOCK_LEN) * AIRSPY_INT8_BFP_BLOCK_SIZE;
+
+	default:
+		return (size_t) sample_count * sizeof(int16_t);
 	}
+}
 
-	return AIRSPY_SUCCESS;
+/* Sweep sample counts are whole blocks for the block formats */
+static uint64_t sweep_align(airspy_device_t* device, uint64_t sample_count)
+{
+	if (device->sample_type == AIRSPY_SAMPLE_INT8_BFP_IQ)
+	{
+		sample_count = (sample_count + AIRSPY_INT8_BFP_BLOCK_LEN - 1) / AIRSPY_INT8_BFP_BLOCK_LEN * AIRSPY_INT8_BFP_BLOCK_LEN;
+	}
+	return sample_count;
 }
 
-static int create_io_threads(airspy_device_t* device, airspy_sample_block_cb_fn callback)
+/* Output sample index of the raw sample raw_index, the first one at or after it with round_up */
+static uint64_t output_index(airspy_device_t* device, uint64_t raw_index, int decimation, bool round_up)
 {
-	int result;
-	pthread_attr_t attr;
+	uint64_t index;
 
-	if (!device->streaming && !device->stop_requested)
+	index = round_up ? (raw_index + decimation - 1) / decimation : raw_index / decimation;
+	if (device->resampler != NULL)
 	{
-		device->callback = callback;
-		device->streaming = true;
-
-		result = prepare_transfers(device, LIBUSB_ENDPOINT_IN | 1, (libusb_transfer_cb_fn) airspy_libusb_transfer_callback);
-		if (result != AIRSPY_SUCCESS)
+		index = resampler_output_index(device->resampler, index);
+	}
+	if (device->cic != NULL)
+	{
+		index = cic_decimator_output_index(device->cic, index);
+	}
+	return index;
+}
+
+/* Move to the next step once the dwell of the current step is complete, the retune is left to control_threadproc() */
+static void sweep_next(airspy_device_t* device, uint64_t dwell_end)
+{
+	uint32_t freq_hz;
+
+	device->sweep_step = (device->sweep_step + 1) % device->sweep_count;
+	device->sweep_start = dwell_end;
+	freq_hz = device->sweep_freqs[device->sweep_step];
+
+	pthread_mutex_lock(&device->conversion_mp);
+	if (freq_hz != device->freq_hz)
+	{
+		device->sweep_freq_request = freq_hz;
+		device->sweep_pending = true;
+		pthread_cond_signal(&device->control_cv);
+	}
+	pthread_mutex_unlock(&device->conversion_mp);
+}
+
+/* Start the dwell of sweep_step once its retune is in effect, return false while it is not */
+static bool sweep_retuned(airspy_device_t* device, airspy_transfer_t* transfer, int decimation)
+{
+	uint64_t start;
+	bool retuned;
+
+	pthread_mutex_lock(&device->conversion_mp);
+	if (device->sweep_freq_request != 0)
+	{
+		pthread_mutex_unlock(&device->conversion_mp);
+		return false;
+	}
+	retuned = device->freq_hz == device->sweep_freqs[device->sweep_step];
+	transfer->retune_begin = output_index(device, device->retune_begin, decimation, false);
+	transfer->retune_end = output_index(device, device->retune_end, decimation, true);
+	pthread_mutex_unlock(&device->conversion_mp);
+
+	device->sweep_pending = false;
+	if (!retuned)
+	{
+		/* The retune failed, skip the step */
+		sweep_next(device, device->sweep_start);
+		return !device->sweep_pending;
+	}
+
+	start = sweep_align(device, transfer->retune_end + device->sweep_settle_samples);
+	if (start > device->sweep_start)
+	{
+		device->sweep_start = start;
+	}
+	return true;
+}
+
+/* Deliver the parts of a converted block within the dwell of the sweep steps, return the callback result */
+static int sweep_deliver(airspy_device_t* device, airspy_transfer_t* transfer, int decimation)
+{
+	uint8_t* samples = (uint8_t *) transfer->samples;
+	uint64_t first = transfer->sample_index;
+	uint64_t end = first + transfer->sample_count;
+	uint64_t dwell_end;
+	uint64_t from;
+	uint64_t to;
+
+	while (true)
+	{
+		if (device->sweep_pending && !sweep_retuned(device, transfer, decimation))
 		{
-			return result;
+			/* Settling, the retune is not in effect yet */
+			return 0;
+		}
+
+		dwell_end = device->sweep_start + sweep_align(device, device->sweep_dwell_samples);
+		from = (first > device->sweep_start) ? first : device->sweep_start;
+		to = (end < dwell_end) ? end : dwell_end;
+		if (from < to)
+		{
+			transfer->samples = samples + block_bytes(device->sample_type, from - first);
+			transfer->sample_count = (int) (to - from);
+			transfer->sample_index = from;
+			transfer->freq_hz = device->sweep_freqs[device->sweep_step];
+			transfer->sweep_step = (int) device->sweep_step;
+			if (device->callback(transfer) != 0)
+			{
+				return -1;
+			}
+			transfer->dropped_samples = 0;
+		}
+
+		if (end < dwell_end)
+		{
+			return 0;
+		}
+		sweep_next(device, dwell_end);
+	}
+}
+
+/* Fresh resampler state for a new stream, input rate from the raw rate and the sample type */
+static int create_resampler(airspy_device_t* device)
+{
+	uint32_t input_rate;
+	int up;
+	int down;
+
+	if (device->streaming)
+	{
+		return AIRSPY_ERROR_BUSY;
+	}
+
+	resampler_free(device->resampler);
+	device->resampler = NULL;
+	if (device->resample_rate == 0)
+	{
+		return AIRSPY_SUCCESS;
+	}
+
+	switch (device->sample_type)
+	{
+	case AIRSPY_SAMPLE_FLOAT32_IQ:
+		input_rate = device->raw_sample_rate / 2;
+		break;
+
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+		input_rate = device->raw_sample_rate;
+		break;
+
+	default:
+		return AIRSPY_ERROR_INVALID_PARAM;
+	}
+
+	if (!resampler_ratio(input_rate, device->resample_rate, &up, &down))
+	{
+		return AIRSPY_ERROR_INVALID_PARAM;
+	}
+
+	device->resampler = resampler_create(up, down, device->sample_type == AIRSPY_SAMPLE_FLOAT32_IQ);
+	if (device->resampler == NULL)
+	{
+		return AIRSPY_ERROR_NO_MEM;
+	}
+	return AIRSPY_SUCCESS;
+}
+
+/* Empty burst gate and pre-roll delay line for a new stream */
+static int create_burst_gate(airspy_device_t* device)
+{
+	uint32_t block_samples;
+	uint64_t preroll_samples;
+	size_t block_size;
+	uint32_t i;
+
+	if (device->streaming)
+	{
+		return AIRSPY_ERROR_BUSY;
+	}
+
+	free(device->gate_blocks);
+	free(device->gate_buffer);
+	device->gate_blocks = NULL;
+	device->gate_buffer = NULL;
+	device->gate_block_count = 0;
+	device->gate_block_head = 0;
+	device->gate_block_fill = 0;
+	device->gate_active = false;
+	device->gate_last_active = false;
+	device->gate_hold_until = 0;
+	device->gate_hold_samples = (uint64_t) device->raw_sample_rate * device->gate_hold_ms / 1000;
+	if (device->gate_mode == GATE_OFF || device->gate_preroll_ms == 0)
+	{
+		return AIRSPY_SUCCESS;
+	}
+
+	/* Whole blocks, each as large as the output buffer */
+	block_samples = device->buffer_size / 2;
+	block_size = (size_t) block_samples * sizeof(float);
+	preroll_samples = (uint64_t) device->raw_sample_rate * device->gate_preroll_ms / 1000;
+	device->gate_block_count = (uint32_t) ((preroll_samples + block_samples - 1) / block_samples);
+
+	device->gate_blocks = (gate_block_t *) calloc(device->gate_block_count, sizeof(gate_block_t));
+	device->gate_buffer = (uint8_t *) malloc(device->gate_block_count * block_size);
+	if (device->gate_blocks == NULL || device->gate_buffer == NULL)
+	{
+		free(device->gate_blocks);
+		free(device->gate_buffer);
+		device->gate_blocks = NULL;
+		device->gate_buffer = NULL;
+		device->gate_block_count = 0;
+		return AIRSPY_ERROR_NO_MEM;
+	}
+
+	for (i = 0; i < device->gate_block_count; i++)
+	{
+		device->gate_blocks[i].samples = device->gate_buffer + i * block_size;
+	}
+	return AIRSPY_SUCCESS;
+}
+
+/* Whether the block of raw samples from raw_index at level rms is part of a burst */
+static bool gate_update(airspy_device_t* device, uint64_t raw_index, float rms)
+{
+	if (rms >= device->gate_open_rms || (device->gate_active && rms >= device->gate_close_rms))
+	{
+		device->gate_hold_until = raw_index + device->buffer_size / 2 + device->gate_hold_samples;
+		device->gate_active = true;
+	}
+	else
+	{
+		device->gate_active = raw_index < device->gate_hold_until;
+	}
+	return device->gate_active;
+}
+
+/* Flag the block and hand it to the callback, unless GATE_DROP leaves it out */
+static int gate_pass(airspy_device_t* device, airspy_transfer_t* transfer)
+{
+	bool active;
+
+	active = (transfer->burst & AIRSPY_BURST_ACTIVE) != 0;
+	if (active && !device->gate_last_active)
+	{
+		transfer->burst |= AIRSPY_BURST_START;
+	}
+	device->gate_last_active = active;
+
+	if (!active && device->gate_mode == GATE_DROP)
+	{
+		return 0;
+	}
+	return device->callback(transfer);
+}
+
+/* Burst gate on a converted block, delayed by the pre-roll. Return the callback result */
+static int gate_deliver(airspy_device_t* device, airspy_transfer_t* transfer, uint64_t raw_index)
+{
+	gate_block_t* block;
+	uint32_t i;
+	int result;
+
+	transfer->burst = gate_update(device, raw_index, transfer->rms) ? AIRSPY_BURST_ACTIVE : 0;
+	if (device->gate_block_count == 0)
+	{
+		return gate_pass(device, transfer);
+	}
+
+	if (transfer->burst)
+	{
+		/* The pre-roll joins the burst */
+		for (i = 0; i < device->gate_block_fill; i++)
+		{
+			device->gate_blocks[(device->gate_block_head + i) % device->gate_block_count].transfer.burst = AIRSPY_BURST_ACTIVE;
+		}
+	}
+
+	result = 0;
+	if (device->gate_block_fill == device->gate_block_count)
+	{
+		result = gate_pass(device, &device->gate_blocks[device->gate_block_head].transfer);
+		device->gate_block_head = (device->gate_block_head + 1) % device->gate_block_count;
+		device->gate_block_fill--;
+	}
+
+	block = &device->gate_blocks[(device->gate_block_head + device->gate_block_fill) % device->gate_block_count];
+	memcpy(block->samples, transfer->samples, block_bytes(device->sample_type, sweep_align(device, transfer->sample_count)));
+	block->transfer = *transfer;
+	block->transfer.samples = block->samples;
+	if (transfer->adc_histogram != NULL)
+	{
+		memcpy(block->adc_histogram, transfer->adc_histogram, sizeof(block->adc_histogram));
+		block->transfer.adc_histogram = block->adc_histogram;
+	}
+	device->gate_block_fill++;
+	return result;
+}
+
+/* Deliver the blocks left in the pre-roll delay line when the stream ends */
+static void gate_flush(airspy_device_t* device)
+{
+	gate_block_t* block;
+
+	while (device->gate_block_fill > 0)
+	{
+		block = &device->gate_blocks[device->gate_block_head];
+		device->gate_block_head = (device->gate_block_head + 1) % device->gate_block_count;
+		device->gate_block_fill--;
+		if (gate_pass(device, &block->transfer) != 0)
+		{
+			device->gate_block_fill = 0;
+		}
+	}
+}
+
+/* Fresh CIC decimator state for a new stream */
+static int create_cic_decimator(airspy_device_t* device)
+{
+	if (device->streaming)
+	{
+		return AIRSPY_ERROR_BUSY;
+	}
+
+	cic_decimator_free(device->cic);
+	device->cic = NULL;
+	if (device->cic_factor == 0)
+	{
+		return AIRSPY_SUCCESS;
+	}
+
+	if (device->sample_type != AIRSPY_SAMPLE_INT16_IQ)
+	{
+		return AIRSPY_ERROR_INVALID_PARAM;
+	}
+
+	device->cic = cic_decimator_create(device->cic_factor);
+	if (device->cic == NULL)
+	{
+		return AIRSPY_ERROR_NO_MEM;
+	}
+	return AIRSPY_SUCCESS;
+}
+
+/* The FIR filter applies to the float samples only, with real taps to the real ones */
+static int check_fir(airspy_device_t* device)
+{
+	if (device->fir == NULL)
+	{
+		return AIRSPY_SUCCESS;
+	}
+
+	switch (device->sample_type)
+	{
+	case AIRSPY_SAMPLE_FLOAT32_IQ:
+		return AIRSPY_SUCCESS;
+
+	case AIRSPY_SAMPLE_FLOAT32_REAL:
+		return device->fir->complex_taps ? AIRSPY_ERROR_INVALID_PARAM : AIRSPY_SUCCESS;
+
+	default:
+		return AIRSPY_ERROR_INVALID_PARAM;
+	}
+}
+
+static void* conversion_threadproc(void *arg)
+{
+	int sample_count;
+	uint16_t* input_samples;
+	raw_buffer_info_t* info;
+	int decimation;
+	uint64_t dropped_samples;
+	bool callback_stop;
+	airspy_device_t* device = (airspy_device_t*)arg;
+	airspy_transfer_t transfer;
+
+#ifdef _WIN32
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+#endif
+
+	callback_stop = false;
+	while (device->streaming && !device->stop_requested)
+	{
+		if (device->received_samples_queue_head == device->received_samples_queue_tail)
+		{
+			pthread_mutex_lock(&device->conversion_mp);
+			device->converter_is_waiting = true;
+			while (device->received_samples_queue_head == device->received_samples_queue_tail &&
+				!device->stop_requested && device->streaming)
+			{
+				pthread_cond_wait(&device->conversion_cv, &device->conversion_mp);
+			}
+			device->converter_is_waiting = false;
+			pthread_mutex_unlock(&device->conversion_mp);
+
+			if (device->stop_requested || !device->streaming)
+			{
+				continue;
+			}
+		}
+
+		input_samples = device->received_samples_queue[device->received_samples_queue_tail];
+		info = &device->received_samples_info[device->received_samples_queue_tail];
+		sample_count = device->buffer_size / 2;
+
+		sample_count = convert_samples(device->sample_type, device->cnv_f, device->cnv_i, input_samples, sample_count,
+			device->output_buffer, (uint8_t *) device->output_buffer + device->buffer_size, &transfer.samples, &transfer.stats,
+			device->adc_histogram_enabled ? device->adc_histogram : NULL);
+		transfer.adc_histogram = device->adc_histogram_enabled ? device->adc_histogram : NULL;
+		decimation = (device->buffer_size / 2) / sample_count;
+		dropped_samples = info->dropped_samples / decimation;
+
+		if (device->resampler != NULL)
+		{
+			if (dropped_samples > 0)
+			{
+				dropped_samples = resampler_skip(device->resampler, dropped_samples);
+			}
+			sample_count = resampler_process(device->resampler, (float *) transfer.samples, sample_count);
+		}
+
+		if (device->cic != NULL)
+		{
+			if (dropped_samples > 0)
+			{
+				dropped_samples = cic_decimator_skip(device->cic, dropped_samples);
+			}
+			sample_count = cic_decimator_process(device->cic, (int16_t *) transfer.samples, sample_count);
+		}
+
+		if (device->fir != NULL)
+		{
+			if (device->sample_type == AIRSPY_SAMPLE_FLOAT32_IQ)
+			{
+				fir_filter_process_complex(device->fir, (float *) transfer.samples, sample_count);
+			}
+			else
+			{
+				fir_filter_process_real(device->fir, (float *) transfer.samples, sample_count);
+			}
+		}
+
+		transfer.device = device;
+		transfer.ctx = device->ctx;
+		transfer.sample_count = sample_count;
+		transfer.sample_type = device->sample_type;
+		transfer.sample_index = output_index(device, info->sample_index, decimation, false);
+		transfer.timestamp = info->timestamp;
+		transfer.dropped_samples = dropped_samples;
+		transfer.sweep_step = -1;
+
+		pthread_mutex_lock(&device->conversion_mp);
+		transfer.freq_hz = device->freq_hz;
+		transfer.retune_begin = output_index(device, device->retune_begin, decimation, false);
+		transfer.retune_end = output_index(device, device->retune_end, decimation, true);
+		transfer.lna_gain = device->lna_gain;
+		transfer.mixer_gain = device->mixer_gain;
+		transfer.vga_gain = device->vga_gain;
+		pthread_mutex_unlock(&device->conversion_mp);
+
+		transfer.agc = device->agc;
+		transfer.rms = 0.0f;
+		transfer.gain = 1.0f;
+		if ((device->agc & AIRSPY_AGC_NORMALIZE) && device->sample_type == AIRSPY_SAMPLE_FLOAT32_IQ)
+		{
+			/* Measured by the normalization before scaling */
+			transfer.rms = device->cnv_f->norm_rms;
+			transfer.gain = device->cnv_f->norm_gain;
+		}
+		else if (device->resampler == NULL && device->cic == NULL && device->fir == NULL)
+		{
+			/* Samples as measured by the conversion */
+			transfer.rms = stats_rms(device->sample_type, &transfer.stats);
+		}
+		else if ((device->agc & AIRSPY_AGC_HOST) || device->gate_mode != GATE_OFF)
+		{
+			transfer.rms = block_rms(device->sample_type,
+				(device->sample_type == AIRSPY_SAMPLE_UINT16_REAL) ? (void *) input_samples : device->output_buffer,
+				(decimation == 2) ? sample_count * 2 : sample_count);
+		}
+
+		transfer.burst = AIRSPY_BURST_ACTIVE;
+
+		if (device->sweep_freqs != NULL)
+		{
+			if (sweep_deliver(device, &transfer, decimation) != 0)
+			{
+				device->stop_requested = true;
+				callback_stop = true;
+			}
+		}
+		else if (device->gate_mode != GATE_OFF)
+		{
+			if (gate_deliver(device, &transfer, info->sample_index) != 0)
+			{
+				device->stop_requested = true;
+				callback_stop = true;
+			}
+		}
+		else if (device->callback(&transfer) != 0)
+		{
+			device->stop_requested = true;
+			callback_stop = true;
+		}
+
+		if (device->agc & AIRSPY_AGC_HOST)
+		{
+			host_agc_update(device, info->sample_index, transfer.rms, transfer.stats.clipped);
+		}
+
+		device->received_samples_queue_tail = (device->received_samples_queue_tail + 1) & (RAW_BUFFER_COUNT - 1);
+
+		if (device->replay_file != NULL)
+		{
+			pthread_mutex_lock(&device->conversion_mp);
+			device->replay_converted++;
+			pthread_cond_signal(&device->replay_cv);
+			pthread_mutex_unlock(&device->conversion_mp);
+		}
+	}
+
+	/* Stopped, unplugged or at the end of the replay, not when the callback itself asked to stop */
+	if (device->gate_mode != GATE_OFF && device->sweep_freqs == NULL && !callback_stop)
+	{
+		gate_flush(device);
+	}
+
+	return NULL;
+}
+
+/* Hand a filled raw buffer to the conversion thread in exchange for a free one */
+static void push_raw_buffer(airspy_device_t* device, uint8_t** buffer, uint64_t timestamp)
+{
+	uint16_t *temp;
+	raw_buffer_info_t* info;
+
+	info = &device->received_samples_info[device->received_samples_queue_head];
+	info->sample_index = device->received_sample_index;
+	info->timestamp = timestamp;
+	info->dropped_samples = device->pending_dropped_samples;
+	device->pending_dropped_samples = 0;
+	device->received_sample_index += device->buffer_size / 2;
+
+	temp = device->received_samples_queue[device->received_samples_queue_head];
+	device->received_samples_queue[device->received_samples_queue_head] = (uint16_t *) *buffer;
+	*buffer = (uint8_t *) temp;
+	device->received_samples_queue_head = (device->received_samples_queue_head + 1) & (RAW_BUFFER_COUNT - 1);
+
+	if (device->converter_is_waiting)
+	{
+		pthread_mutex_lock(&device->conversion_mp);
+		pthread_cond_signal(&device->conversion_cv);
+		pthread_mutex_unlock(&device->conversion_mp);
+	}
+}
+
+/* Queue a filled raw buffer, or drop it if the conversion thread is behind. Return true if queued */
+static bool queue_raw_buffer(airspy_device_t* device, uint8_t** buffer, uint64_t timestamp)
+{
+	uint32_t sample_count;
+
+	if (device->received_samples_queue_head != device->received_samples_queue_tail || device->converter_is_waiting)
+	{
+		push_raw_buffer(device, buffer, timestamp);
+		return true;
+	}
+
+	/* Conversion thread too slow, the buffer is lost */
+	sample_count = device->buffer_size / 2;
+	device->pending_dropped_samples += sample_count;
+	device->total_dropped_samples += sample_count;
+	device->received_sample_index += sample_count;
+	return false;
+}
+
+static void airspy_libusb_transfer_callback(struct libusb_transfer* usb_transfer)
+{
+	airspy_device_t* device = (airspy_device_t*) usb_transfer->user_data;
+
+	if (!device->streaming || device->stop_requested)
+	{
+		return;
+	}
+
+	if (usb_transfer->status == LIBUSB_TRANSFER_COMPLETED)
+	{
+		/* Taken first, before any queue handling can add latency */
+		queue_raw_buffer(device, &usb_transfer->buffer, get_timestamp());
+	}
+
+	if (libusb_submit_transfer(usb_transfer) != 0)
+	{
+		device->streaming = false;
+	}
+}
+
+static void* transfer_threadproc(void* arg)
+{
+	airspy_device_t* device = (airspy_device_t*)arg;
+	int error;
+	struct timeval timeout = { 0, 500000 };
+
+#ifdef _WIN32
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+
+#endif
+
+	while (device->streaming && !device->stop_requested)
+	{
+		error = libusb_handle_events_timeout_completed(device->usb_context, &timeout, NULL);
+		if (error < 0)
+		{
+			if (error != LIBUSB_ERROR_INTERRUPTED)
+			device->streaming = false;
+		}
+	}
+
+	return NULL;
+}
+
+/* Reads the file in raw buffers as the USB transfers would deliver them */
+static void* replay_threadproc(void* arg)
+{
+	airspy_device_t* device = (airspy_device_t*)arg;
+	uint64_t start;
+	uint64_t buffer_count;
+	uint64_t queued;
+	uint64_t due;
+	uint64_t now;
+
+	start = get_timestamp();
+	buffer_count = 0;
+	queued = 0;
+
+	while (device->streaming && !device->stop_requested)
+	{
+		/* A last partial buffer is not replayed */
+		if (fread(device->replay_buffer, 1, device->buffer_size, device->replay_file) != device->buffer_size)
+		{
+			break;
+		}
+		buffer_count++;
+
+		if (device->replay_fast)
+		{
+			/* Wait for a free slot instead of dropping, a full ring (head == tail) would look empty */
+			pthread_mutex_lock(&device->conversion_mp);
+			while (queued - device->replay_converted >= RAW_BUFFER_COUNT - 1 && device->streaming && !device->stop_requested)
+			{
+				pthread_cond_wait(&device->replay_cv, &device->conversion_mp);
+			}
+			pthread_mutex_unlock(&device->conversion_mp);
+
+			push_raw_buffer(device, &device->replay_buffer, get_timestamp());
+			queued++;
+		}
+		else
+		{
+			/* Completion time of this buffer on a real device */
+			due = start + buffer_count * (device->buffer_size / 2) * 1000000000ULL / device->raw_sample_rate;
+			now = get_timestamp();
+			if (due > now)
+			{
+				sleep_ns(due - now);
+			}
+
+			if (queue_raw_buffer(device, &device->replay_buffer, get_timestamp()))
+			{
+				queued++;
+			}
+		}
+
+		/* Always under the lock, the conversion thread missing a wake-up would stall the replay */
+		pthread_mutex_lock(&device->conversion_mp);
+		pthread_cond_signal(&device->conversion_cv);
+		pthread_mutex_unlock(&device->conversion_mp);
+	}
+
+	/* End of file, the stream stops like an unplugged device once every queued buffer is converted */
+	pthread_mutex_lock(&device->conversion_mp);
+	while (device->replay_converted != queued && device->streaming && !device->stop_requested)
+	{
+		pthread_cond_wait(&device->replay_cv, &device->conversion_mp);
+	}
+	device->replay_done = true;
+	device->streaming = false;
+	pthread_cond_signal(&device->conversion_cv);
+	pthread_mutex_unlock(&device->conversion_mp);
+
+	return NULL;
+}
+
+static int kill_io_threads(airspy_device_t* device)
+{
+	if (device->streaming || device->replay_done)
+	{
+		device->stop_requested = true;
+		cancel_transfers(device);
+
+		pthread_cond_signal(&device->conversion_cv);
+
+		if (device->replay_file != NULL)
+		{
+			pthread_mutex_lock(&device->conversion_mp);
+			pthread_cond_signal(&device->replay_cv);
+			pthread_mutex_unlock(&device->conversion_mp);
+		}
+
+		pthread_mutex_lock(&device->conversion_mp);
+		pthread_cond_signal(&device->control_cv);
+		pthread_mutex_unlock(&device->conversion_mp);
+
+		pthread_join(device->transfer_thread, NULL);
+		pthread_join(device->conversion_thread, NULL);
+		pthread_join(device->control_thread, NULL);
+
+		device->stop_requested = false;
+		device->streaming = false;
+		device->replay_done = false;
+	}
+
+	return AIRSPY_SUCCESS;
+}
+
+static int create_io_threads(airspy_device_t* device, airspy_sample_block_cb_fn callback)
+{
+	int result;
+	pthread_attr_t attr;
+
+	if (device->replay_done)
+	{
+		/* Previous replay reached the end of the file */
+		kill_io_threads(device);
+	}
+
+	if (!device->streaming && !device->stop_requested)
+	{
+		device->callback = callback;
+		device->streaming = true;
+
+		if (device->replay_file != NULL)
+		{
+			rewind(device->replay_file);
+			device->replay_converted = 0;
+		}
+		else
+		{
+			result = prepare_transfers(device, LIBUSB_ENDPOINT_IN | 1, (libusb_transfer_cb_fn) airspy_libusb_transfer_callback);
+			if (result != AIRSPY_SUCCESS)
+			{
+				return result;
+			}
 		}
 
 		device->received_samples_queue_head = 0;
 		device->received_samples_queue_tail = 0;
 		device->converter_is_waiting = true;
+		device->received_sample_index = 0;
+		device->pending_dropped_samples = 0;
+		device->total_dropped_samples = 0;
+		device->sweep_step = 0;
+		device->sweep_start = sweep_align(device, device->sweep_settle_samples);
+		device->sweep_freq_request = 0;
+		device->sweep_pending = false;
+		device->retune_begin = 0;
+		device->retune_end = 0;
+		device->agc_vga_request = AIRSPY_GAIN_UNKNOWN;
 
 		pthread_attr_init(&attr);
 		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-		result = pthread_create(&device->conversion_thread, &attr, conversion_threadproc, device);
+		result = pthread_create(&device->conversion_thread, &attr, conversion_threadproc, device);
+		if (result != 0)
+		{
+			return AIRSPY_ERROR_THREAD;
+		}
+
+		result = pthread_create(&device->transfer_thread, &attr,
+			(device->replay_file != NULL) ? replay_threadproc : transfer_threadproc, device);
 		if (result != 0)
 		{
 			return AIRSPY_ERROR_THREAD;
 		}
 
-		result = pthread_create(&device->transfer_thread, &attr, transfer_threadproc, device);
+		result = pthread_create(&device->control_thread, &attr, control_threadproc, device);
 		if (result != 0)
 		{
 			return AIRSPY_ERROR_THREAD;
@@ -654,6 +1869,9 @@ static int airspy_open_init(airspy_device_t** device, uint64_t serial_number)
 		return result;
 	}
 
+	lib_device->replay_file = NULL;
+	lib_device->replay_buffer = NULL;
+	lib_device->replay_done = false;
 	lib_device->transfers = NULL;
 	lib_device->callback = NULL;
 	lib_device->transfer_count = 16;
@@ -661,6 +1879,29 @@ static int airspy_open_init(airspy_device_t** device, uint64_t serial_number)
 	lib_device->streaming = false;
 	lib_device->stop_requested = false;
 	lib_device->sample_type = AIRSPY_SAMPLE_FLOAT32_IQ;
+	lib_device->freq_hz = 0;
+	lib_device->lna_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->mixer_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->vga_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->agc_vga_request = AIRSPY_GAIN_UNKNOWN;
+	lib_device->agc = 0;
+	lib_device->sweep_freqs = NULL;
+	lib_device->sweep_count = 0;
+	lib_device->sweep_settle_samples = 0;
+	lib_device->sweep_dwell_samples = 0;
+	lib_device->fir = NULL;
+	lib_device->raw_sample_rate = 20000000;
+	lib_device->resample_rate = 0;
+	lib_device->resampler = NULL;
+	lib_device->cic_factor = 0;
+	lib_device->cic = NULL;
+	lib_device->gate_mode = GATE_OFF;
+	lib_device->gate_preroll_ms = 0;
+	lib_device->gate_hold_ms = 0;
+	lib_device->gate_blocks = NULL;
+	lib_device->gate_buffer = NULL;
+	lib_device->gate_block_count = 0;
+	lib_device->adc_histogram_enabled = false;
 
 	result = allocate_transfers(lib_device);
 	if( result != 0 )
@@ -670,11 +1911,75 @@ static int airspy_open_init(airspy_device_t** device, uint64_t serial_number)
 		return AIRSPY_ERROR_NO_MEM;
 	}
 
-	lib_device->cnv_f = iqconverter_float_create(HB_KERNEL_FLOAT, HB_KERNEL_FLOAT_LEN);
-	lib_device->cnv_i = iqconverter_int16_create(HB_KERNEL_INT16, HB_KERNEL_INT16_LEN);
+	result = create_converters(AIRSPY_CONVERTER_DEFAULT, &lib_device->cnv_f, &lib_device->cnv_i);
+	if (result != AIRSPY_SUCCESS)
+	{
+		free_transfers(lib_device);
+		airspy_open_exit(lib_device);
+		free(lib_device);
+		return result;
+	}
+
+	pthread_cond_init(&lib_device->conversion_cv, NULL);
+	pthread_cond_init(&lib_device->control_cv, NULL);
+	pthread_mutex_init(&lib_device->conversion_mp, NULL);
+	pthread_cond_init(&lib_device->replay_cv, NULL);
+
+	*device = lib_device;
+
+	return AIRSPY_SUCCESS;
+}
+
+static int airspy_open_file_init(airspy_device_t** device, const char* path, enum airspy_file_mode mode)
+{
+	airspy_device_t* lib_device;
+
+	*device = NULL;
+	lib_device = (airspy_device_t*)calloc(1, sizeof(airspy_device_t));
+	if(lib_device == NULL)
+	{
+		return AIRSPY_ERROR_NO_MEM;
+	}
+
+	lib_device->replay_file = fopen(path, "rb");
+	if(lib_device->replay_file == NULL)
+	{
+		free(lib_device);
+		return AIRSPY_ERROR_NOT_FOUND;
+	}
+
+	lib_device->replay_fast = (mode == AIRSPY_FILE_FAST);
+	lib_device->raw_sample_rate = 20000000;
+	lib_device->buffer_size = 262144;
+	lib_device->sample_type = AIRSPY_SAMPLE_FLOAT32_IQ;
+	lib_device->lna_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->mixer_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->vga_gain = AIRSPY_GAIN_UNKNOWN;
+	lib_device->agc_vga_request = AIRSPY_GAIN_UNKNOWN;
+
+	lib_device->replay_buffer = (uint8_t*)malloc(lib_device->buffer_size);
+	if (lib_device->replay_buffer == NULL || allocate_sample_buffers(lib_device) != AIRSPY_SUCCESS)
+	{
+		free_sample_buffers(lib_device);
+		free(lib_device->replay_buffer);
+		fclose(lib_device->replay_file);
+		free(lib_device);
+		return AIRSPY_ERROR_NO_MEM;
+	}
+
+	if (create_converters(AIRSPY_CONVERTER_DEFAULT, &lib_device->cnv_f, &lib_device->cnv_i) != AIRSPY_SUCCESS)
+	{
+		free_sample_buffers(lib_device);
+		free(lib_device->replay_buffer);
+		fclose(lib_device->replay_file);
+		free(lib_device);
+		return AIRSPY_ERROR_NO_MEM;
+	}
 
 	pthread_cond_init(&lib_device->conversion_cv, NULL);
+	pthread_cond_init(&lib_device->control_cv, NULL);
 	pthread_mutex_init(&lib_device->conversion_mp, NULL);
+	pthread_cond_init(&lib_device->replay_cv, NULL);
 
 	*device = lib_device;
 
@@ -721,6 +2026,14 @@ extern "C"
 		return result;
 	}
 
+	int ADDCALL airspy_open_file(airspy_device_t** device, const char* path, enum airspy_file_mode mode)
+	{
+		int result;
+
+		result = airspy_open_file_init(device, path, mode);
+		return result;
+	}
+
 	int ADDCALL airspy_close(airspy_device_t* device)
 	{
 		int result;
@@ -733,12 +2046,29 @@ extern "C"
 
 			iqconverter_float_free(device->cnv_f);
 			iqconverter_int16_free(device->cnv_i);
+			fir_filter_free(device->fir);
+			resampler_free(device->resampler);
+			cic_decimator_free(device->cic);
+			free(device->gate_blocks);
+			free(device->gate_buffer);
 
 			pthread_cond_destroy(&device->conversion_cv);
+			pthread_cond_destroy(&device->control_cv);
 			pthread_mutex_destroy(&device->conversion_mp);
+			pthread_cond_destroy(&device->replay_cv);
 
-			airspy_open_exit(device);
-			free_transfers(device);
+			if (device->replay_file != NULL)
+			{
+				fclose(device->replay_file);
+				free(device->replay_buffer);
+				free_sample_buffers(device);
+			}
+			else
+			{
+				airspy_open_exit(device);
+				free_transfers(device);
+			}
+			free(device->sweep_freqs);
 			free(device);
 		}
 
@@ -754,8 +2084,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_SAMPLERATE,
 		0,
@@ -769,6 +2099,7 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			device->raw_sample_rate = (samplerate == AIRSPY_SAMPLERATE_2_5MSPS) ? 5000000 : 20000000;
 			return AIRSPY_SUCCESS;
 		}
 	}
@@ -776,8 +2107,8 @@ extern "C"
 	int ADDCALL airspy_set_receiver_mode(airspy_device_t* device, receiver_mode_t value)
 	{
 		int result;
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_RECEIVER_MODE,
 		value,
@@ -799,6 +2130,30 @@ extern "C"
 	{
 		int result;
 
+		result = create_resampler(device);
+		if (result != AIRSPY_SUCCESS)
+		{
+			return result;
+		}
+
+		result = check_fir(device);
+		if (result != AIRSPY_SUCCESS)
+		{
+			return result;
+		}
+
+		result = create_cic_decimator(device);
+		if (result != AIRSPY_SUCCESS)
+		{
+			return result;
+		}
+
+		result = create_burst_gate(device);
+		if (result != AIRSPY_SUCCESS)
+		{
+			return result;
+		}
+
 		result = airspy_set_receiver_mode(device, RECEIVER_MODE_RX);
 		if( result == AIRSPY_SUCCESS )
 		{
@@ -827,8 +2182,8 @@ extern "C"
 		int result;
 
 		temp_value = 0;
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SI5351C_READ,
 		0,
@@ -850,8 +2205,8 @@ extern "C"
 	{
 		int result;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SI5351C_WRITE,
 		value,
@@ -872,8 +2227,8 @@ extern "C"
 	{
 		int result;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_R820T_READ,
 		0,
@@ -894,8 +2249,8 @@ extern "C"
 	{
 		int result;
 		
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_R820T_WRITE,
 		value,
@@ -920,8 +2275,8 @@ extern "C"
 		port_pin = ((uint8_t)port) << 5;
 		port_pin = port_pin | pin;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_GPIO_READ,
 		0,
@@ -946,8 +2301,8 @@ extern "C"
 		port_pin = ((uint8_t)port) << 5;
 		port_pin = port_pin | pin;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_GPIO_WRITE,
 		value,
@@ -973,8 +2328,8 @@ extern "C"
 		port_pin = ((uint8_t)port) << 5;
 		port_pin = port_pin | pin;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_GPIODIR_READ,
 		0,
@@ -999,8 +2354,8 @@ extern "C"
 		port_pin = ((uint8_t)port) << 5;
 		port_pin = port_pin | pin;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_GPIODIR_WRITE,
 		value,
@@ -1020,8 +2375,8 @@ extern "C"
 	int ADDCALL airspy_spiflash_erase(airspy_device_t* device)
 	{
 		int result;
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SPIFLASH_ERASE,
 		0,
@@ -1047,8 +2402,8 @@ extern "C"
 			return AIRSPY_ERROR_INVALID_PARAM;
 		}
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SPIFLASH_WRITE,
 		address >> 16,
@@ -1069,8 +2424,8 @@ extern "C"
 	{
 		int result;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SPIFLASH_READ,
 		address >> 16,
@@ -1090,8 +2445,8 @@ extern "C"
 	int ADDCALL airspy_board_id_read(airspy_device_t* device, uint8_t* value)
 	{
 		int result;
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_BOARD_ID_READ,
 		0,
@@ -1114,8 +2469,8 @@ extern "C"
 
 		memset(version, 0, length);
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_VERSION_STRING_READ,
 		0,
@@ -1139,8 +2494,8 @@ extern "C"
 		int result;
 		
 		length = sizeof(airspy_read_partid_serialno_t);
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_BOARD_PARTID_SERIALNO_READ,
 		0,
@@ -1171,6 +2526,75 @@ extern "C"
 		return AIRSPY_SUCCESS;
 	}
 
+	int ADDCALL airspy_set_converter_profile(airspy_device_t* device, enum airspy_converter_profile profile)
+	{
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		return replace_converters(profile, &device->cnv_f, &device->cnv_i);
+	}
+
+	int ADDCALL airspy_set_fir(airspy_device_t* device, const float* taps, uint32_t tap_count, uint8_t complex_taps)
+	{
+		fir_filter_t* fir = NULL;
+
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		if (taps != NULL && tap_count > 0)
+		{
+			if (tap_count > FIR_FILTER_MAX_TAPS || complex_taps > 1)
+			{
+				return AIRSPY_ERROR_INVALID_PARAM;
+			}
+
+			fir = fir_filter_create(taps, tap_count, complex_taps);
+			if (fir == NULL)
+			{
+				return AIRSPY_ERROR_NO_MEM;
+			}
+		}
+
+		fir_filter_free(device->fir);
+		device->fir = fir;
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_resampler(airspy_device_t* device, uint32_t output_rate)
+	{
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		device->resample_rate = output_rate;
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_int16_decimation(airspy_device_t* device, uint32_t factor)
+	{
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		if (factor <= 1)
+		{
+			factor = 0;
+		}
+		else if (factor < CIC_DECIMATOR_MIN_FACTOR || factor > CIC_DECIMATOR_MAX_FACTOR || (factor & 1))
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		device->cic_factor = factor;
+		return AIRSPY_SUCCESS;
+	}
+
 	int ADDCALL airspy_set_freq(airspy_device_t* device, const uint32_t freq_hz)
 	{
 		set_freq_params_t set_freq_params;
@@ -1180,8 +2604,8 @@ extern "C"
 		set_freq_params.freq_hz = TO_LE(freq_hz);
 		length = sizeof(set_freq_params_t);
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_FREQ,
 		0,
@@ -1195,8 +2619,58 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			pthread_mutex_lock(&device->conversion_mp);
+			device->freq_hz = freq_hz;
+			pthread_mutex_unlock(&device->conversion_mp);
+			return AIRSPY_SUCCESS;
+		}
+	}
+
+	int ADDCALL airspy_set_sweep(airspy_device_t* device, const uint32_t* freq_hz, uint32_t step_count,
+		uint32_t settle_samples, uint32_t dwell_samples)
+	{
+		uint32_t* freqs;
+		int result;
+
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		if (step_count == 0)
+		{
+			free(device->sweep_freqs);
+			device->sweep_freqs = NULL;
+			device->sweep_count = 0;
 			return AIRSPY_SUCCESS;
 		}
+
+		if (freq_hz == NULL || dwell_samples == 0)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		freqs = (uint32_t *) malloc(step_count * sizeof(uint32_t));
+		if (freqs == NULL)
+		{
+			return AIRSPY_ERROR_NO_MEM;
+		}
+		memcpy(freqs, freq_hz, step_count * sizeof(uint32_t));
+
+		free(device->sweep_freqs);
+		device->sweep_freqs = freqs;
+		device->sweep_count = step_count;
+		device->sweep_settle_samples = settle_samples;
+		device->sweep_dwell_samples = dwell_samples;
+
+		result = airspy_set_freq(device, freqs[0]);
+		if (result != AIRSPY_SUCCESS)
+		{
+			free(device->sweep_freqs);
+			device->sweep_freqs = NULL;
+			device->sweep_count = 0;
+		}
+		return result;
 	}
 
 	int ADDCALL airspy_set_lna_gain(airspy_device_t* device, uint8_t value)
@@ -1210,8 +2684,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_LNA_GAIN,
 		0,
@@ -1225,6 +2699,9 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			pthread_mutex_lock(&device->conversion_mp);
+			device->lna_gain = value;
+			pthread_mutex_unlock(&device->conversion_mp);
 			return AIRSPY_SUCCESS;
 		}
 	}
@@ -1240,8 +2717,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_MIXER_GAIN,
 		0,
@@ -1255,6 +2732,9 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			pthread_mutex_lock(&device->conversion_mp);
+			device->mixer_gain = value;
+			pthread_mutex_unlock(&device->conversion_mp);
 			return AIRSPY_SUCCESS;
 		}
 	}
@@ -1270,8 +2750,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_VGA_GAIN,
 		0,
@@ -1285,8 +2765,113 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			pthread_mutex_lock(&device->conversion_mp);
+			device->vga_gain = value;
+			pthread_mutex_unlock(&device->conversion_mp);
+			return AIRSPY_SUCCESS;
+		}
+	}
+
+	int ADDCALL airspy_set_host_agc(airspy_device_t* device, uint8_t value, float target_dbfs, float hysteresis_db)
+	{
+		uint8_t vga_gain;
+		int result;
+
+		if (value == 0)
+		{
+			device->agc &= ~AIRSPY_AGC_HOST;
+			return AIRSPY_SUCCESS;
+		}
+
+		if (target_dbfs > 0.0f || hysteresis_db <= 0.0f)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		/* The steps are relative to the VGA gain, unknown until set */
+		pthread_mutex_lock(&device->conversion_mp);
+		vga_gain = device->vga_gain;
+		pthread_mutex_unlock(&device->conversion_mp);
+		if (vga_gain == AIRSPY_GAIN_UNKNOWN)
+		{
+			result = airspy_set_vga_gain(device, HOST_AGC_VGA_START);
+			if (result != AIRSPY_SUCCESS)
+			{
+				return result;
+			}
+		}
+
+		device->host_agc_low = powf(10.0f, (target_dbfs - hysteresis_db) / 20.0f);
+		device->host_agc_high = powf(10.0f, (target_dbfs + hysteresis_db) / 20.0f);
+		device->agc |= AIRSPY_AGC_HOST;
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_normalization(airspy_device_t* device, uint8_t value, float target_dbfs)
+	{
+		if (value == 0)
+		{
+			device->agc &= ~AIRSPY_AGC_NORMALIZE;
+			iqconverter_float_set_normalization(device->cnv_f, 0.0f);
 			return AIRSPY_SUCCESS;
 		}
+
+		if (target_dbfs > 0.0f)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		iqconverter_float_set_normalization(device->cnv_f, powf(10.0f, target_dbfs / 20.0f));
+		device->agc |= AIRSPY_AGC_NORMALIZE;
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_iq_correction(airspy_device_t* device, uint8_t value)
+	{
+		if (value > 1)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		iqconverter_float_set_iq_correction(device->cnv_f, value);
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_adc_histogram(airspy_device_t* device, uint8_t value)
+	{
+		if (value > 1)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		device->adc_histogram_enabled = value;
+		return AIRSPY_SUCCESS;
+	}
+
+	int ADDCALL airspy_set_burst_gate(airspy_device_t* device, uint8_t value, float open_dbfs, float close_dbfs,
+		uint32_t preroll_ms, uint32_t hold_ms)
+	{
+		if (device->streaming)
+		{
+			return AIRSPY_ERROR_BUSY;
+		}
+
+		if (value > GATE_DROP)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		if (value != GATE_OFF && (open_dbfs > 0.0f || close_dbfs > open_dbfs || preroll_ms > GATE_PREROLL_MAX_MS))
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		device->gate_mode = value;
+		device->gate_open_rms = powf(10.0f, open_dbfs / 20.0f);
+		device->gate_close_rms = powf(10.0f, close_dbfs / 20.0f);
+		device->gate_preroll_ms = preroll_ms;
+		device->gate_hold_ms = hold_ms;
+		return AIRSPY_SUCCESS;
 	}
 
 	int ADDCALL airspy_set_lna_agc(airspy_device_t* device, uint8_t value)
@@ -1297,8 +2882,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_LNA_AGC,
 		0,
@@ -1312,6 +2897,7 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			device->agc = value ? (device->agc | AIRSPY_AGC_LNA) : (device->agc & ~AIRSPY_AGC_LNA);
 			return AIRSPY_SUCCESS;
 		}
 	}
@@ -1324,8 +2910,8 @@ extern "C"
 
 		length = 1;
 
-		result = libusb_control_transfer(
-		device->usb_device,
+		result = airspy_control_transfer(
+		device,
 		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
 		AIRSPY_SET_MIXER_AGC,
 		0,
@@ -1339,6 +2925,7 @@ extern "C"
 		{
 			return AIRSPY_ERROR_LIBUSB;
 		} else {
+			device->agc = value ? (device->agc | AIRSPY_AGC_MIXER) : (device->agc & ~AIRSPY_AGC_MIXER);
 			return AIRSPY_SUCCESS;
 		}
 	}
@@ -1395,6 +2982,92 @@ extern "C"
 		}
 	}
 
+	struct airspy_converter* ADDCALL airspy_converter_create(enum airspy_sample_type sample_type)
+	{
+		struct airspy_converter* converter;
+
+		if (sample_type >= AIRSPY_SAMPLE_END)
+		{
+			return NULL;
+		}
+
+		converter = (struct airspy_converter*) calloc(1, sizeof(struct airspy_converter));
+		if (converter == NULL)
+		{
+			return NULL;
+		}
+
+		converter->sample_type = sample_type;
+		if (create_converters(AIRSPY_CONVERTER_DEFAULT, &converter->cnv_f, &converter->cnv_i) != AIRSPY_SUCCESS)
+		{
+			free(converter);
+			return NULL;
+		}
+		return converter;
+	}
+
+	int ADDCALL airspy_converter_set_profile(struct airspy_converter* converter, enum airspy_converter_profile profile)
+	{
+		return replace_converters(profile, &converter->cnv_f, &converter->cnv_i);
+	}
+
+	int ADDCALL airspy_converter_process(struct airspy_converter* converter, const uint16_t* src, int count, void* dest)
+	{
+		void* samples;
+		int sample_count;
+
+		if (count < 0 || (count & 3) != 0)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		if (converter->sample_type == AIRSPY_SAMPLE_INT12_PACKED_IQ || converter->sample_type == AIRSPY_SAMPLE_INT8_BFP_IQ)
+		{
+			if (converter->work_count < count)
+			{
+				free(converter->work);
+				converter->work = (int16_t *) malloc(count * sizeof(int16_t));
+				converter->work_count = converter->work != NULL ? count : 0;
+				if (converter->work == NULL)
+				{
+					return AIRSPY_ERROR_NO_MEM;
+				}
+			}
+			return convert_samples(converter->sample_type, converter->cnv_f, converter->cnv_i, (uint16_t *) src, count,
+				converter->work, (uint8_t *) dest, &samples, &converter->stats, NULL);
+		}
+
+		sample_count = convert_samples(converter->sample_type, converter->cnv_f, converter->cnv_i, (uint16_t *) src, count,
+			dest, NULL, &samples, &converter->stats, NULL);
+		if (samples != dest)
+		{
+			memcpy(dest, samples, count * sizeof(uint16_t));
+		}
+		return sample_count;
+	}
+
+	int ADDCALL airspy_converter_get_stats(struct airspy_converter* converter, airspy_block_stats_t* stats)
+	{
+		if (converter == NULL || stats == NULL)
+		{
+			return AIRSPY_ERROR_INVALID_PARAM;
+		}
+
+		*stats = converter->stats;
+		return AIRSPY_SUCCESS;
+	}
+
+	void ADDCALL airspy_converter_free(struct airspy_converter* converter)
+	{
+		if (converter != NULL)
+		{
+			iqconverter_float_free(converter->cnv_f);
+			iqconverter_int16_free(converter->cnv_i);
+			free(converter->work);
+			free(converter);
+		}
+	}
+
 	const char* ADDCALL airspy_board_id_name(enum airspy_board_id board_id)
 	{
 		switch(board_id)
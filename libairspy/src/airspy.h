@@ -87,17 +87,102 @@ enum airspy_sample_type
 	AIRSPY_SAMPLE_INT16_IQ = 2,     /* 2 * 16bit int per sample */
 	AIRSPY_SAMPLE_INT16_REAL = 3,   /* 1 * 16bit int per sample */
 	AIRSPY_SAMPLE_UINT16_REAL = 4,  /* 1 * 16bit unsigned int per sample */
-	AIRSPY_SAMPLE_END = 5           /* Number of supported sample types */
+	AIRSPY_SAMPLE_INT12_PACKED_IQ = 5, /* 2 * 12bit int packed in 3 bytes per sample */
+	AIRSPY_SAMPLE_INT8_BFP_IQ = 6,  /* 2 * 8bit int per sample, blocks with a shared exponent */
+	AIRSPY_SAMPLE_END = 7           /* Number of supported sample types */
 };
 
+/*
+AIRSPY_SAMPLE_INT12_PACKED_IQ: little endian 24bit words, I in bits 0-11 and Q in bits 12-23,
+	both signed with the same scale as AIRSPY_SAMPLE_INT16_IQ divided by 16.
+AIRSPY_SAMPLE_INT8_BFP_IQ: blocks of AIRSPY_INT8_BFP_BLOCK_LEN samples (the last block of a transfer
+	may be shorter), each one exponent byte followed by the signed 8bit I/Q pairs.
+	INT16_IQ value = int8 value << exponent, exponent between 0 and 9.
+*/
+#define AIRSPY_INT8_BFP_BLOCK_LEN (256)
+#define AIRSPY_INT8_BFP_BLOCK_SIZE (1 + AIRSPY_INT8_BFP_BLOCK_LEN * 2) /* Bytes per full block */
+
+/* Half-band filter of the IQ conversion: image rejection against CPU cost, see airspy_convert -b */
+enum airspy_converter_profile
+{
+	AIRSPY_CONVERTER_FAST = 0,    /* 15 taps, image rejection above 33dB over 75% of the band */
+	AIRSPY_CONVERTER_LIGHT = 1,   /* 31 taps, above 50dB over 75% */
+	AIRSPY_CONVERTER_DEFAULT = 2, /* 47 taps, above 60dB over 75%, used unless set */
+	AIRSPY_CONVERTER_SHARP = 3,   /* 95 taps, above 74dB over 90% */
+	AIRSPY_CONVERTER_END = 4      /* Number of profiles */
+};
+
+enum airspy_file_mode
+{
+	AIRSPY_FILE_REALTIME = 0, /* Paced at the rate set with airspy_set_samplerate(), late buffers are dropped */
+	AIRSPY_FILE_FAST = 1      /* As fast as the callback consumes the samples, nothing is dropped */
+};
+
+#define AIRSPY_GAIN_UNKNOWN (0xFF) /* Gain never set since airspy_open() */
+
+/* airspy_transfer_t agc flags */
+#define AIRSPY_AGC_LNA (1) /* Hardware LNA AGC on */
+#define AIRSPY_AGC_MIXER (2) /* Hardware mixer AGC on */
+#define AIRSPY_AGC_HOST (4) /* Host AGC driving the VGA gain, see airspy_set_host_agc() */
+#define AIRSPY_AGC_NORMALIZE (8) /* Float IQ output normalization, see airspy_set_normalization() */
+
+/* airspy_transfer_t burst flags, see airspy_set_burst_gate() */
+#define AIRSPY_BURST_ACTIVE (1) /* Block of a burst, including its pre-roll and hold */
+#define AIRSPY_BURST_START (2) /* First block of a burst */
+
+/* airspy_transfer_t adc_histogram bins of 64 ADC codes each, see airspy_set_adc_histogram() */
+#define AIRSPY_ADC_HISTOGRAM_BINS (64)
+
 struct airspy_device;
 
+/* Levels of a converted block, 1.0 is full scale. The Q values are 0 for the real sample types */
+typedef struct {
+	float mean_i;
+	float mean_q;
+	float rms_i;
+	float rms_q;
+	float peak_i; /* Largest magnitude */
+	float peak_q;
+	uint32_t clipped; /* Raw samples at an ADC limit, code 0 or 4095 */
+} airspy_block_stats_t;
+
 typedef struct {
 	struct airspy_device* device;
 	void* ctx;
 	void* samples;
 	int sample_count;
 	enum airspy_sample_type sample_type;
+	uint64_t sample_index; /* Index of the first sample of the block, counted from airspy_start_rx() including dropped samples */
+	uint64_t timestamp; /* Host time of the USB transfer completion in nanoseconds since 1970-01-01 UTC */
+	uint64_t dropped_samples; /* Samples lost just before this block, 0 if contiguous with the previous block */
+	uint32_t freq_hz; /* Frequency set with airspy_set_freq() or by the sweep, 0 if never set */
+	int sweep_step; /* Index in the airspy_set_sweep() list, -1 when not sweeping */
+	/*
+	 * Last frequency, gain or tuner register change requested while streaming, both 0 if none:
+	 * samples before retune_begin were taken before the request was sent,
+	 * samples from retune_end on were taken after it completed.
+	 */
+	uint64_t retune_begin;
+	uint64_t retune_end;
+	/* Gains set when the block was converted, AIRSPY_GAIN_UNKNOWN if never set, see retune_begin/retune_end */
+	uint8_t lna_gain;
+	uint8_t mixer_gain;
+	uint8_t vga_gain;
+	uint8_t agc; /* AIRSPY_AGC_* flags */
+	/*
+	 * RMS level of the block before normalization, 1.0 is full scale. With the resampler, the CIC decimator
+	 * or the FIR it is measured after them, and only when the host AGC or the burst gate is on, 0 otherwise.
+	 */
+	float rms;
+	float gain; /* Normalization gain applied to the end of the block, 1.0 when off */
+	uint8_t burst; /* AIRSPY_BURST_* flags, AIRSPY_BURST_ACTIVE on every block when the burst gate is off */
+	/*
+	 * Measured by the conversion pass on the whole converted block, before the normalization, the
+	 * resampler, the CIC decimator and the FIR. The packed types are measured as AIRSPY_SAMPLE_INT16_IQ.
+	 */
+	airspy_block_stats_t stats;
+	/* Raw samples of the block per bin of ADC codes, lowest codes first, NULL when the histogram is off */
+	const uint32_t* adc_histogram;
 } airspy_transfer_t, airspy_transfer;
 
 typedef struct {
@@ -121,6 +206,11 @@ extern ADDAPI int ADDCALL airspy_exit(void);
  
 extern ADDAPI int ADDCALL airspy_open_sn(struct airspy_device** device, uint64_t serial_number);
 extern ADDAPI int ADDCALL airspy_open(struct airspy_device** device);
+/* Replay device streaming a raw capture (AIRSPY_SAMPLE_UINT16_REAL, e.g. airspy_rx -t 4) through the same conversions
+   as the hardware, from its start at each airspy_start_rx(). Control requests are accepted and ignored,
+   reads return zeros. The stream stops (airspy_is_streaming() false) at the end of the file, a last partial
+   block of 131072 samples is not replayed. */
+extern ADDAPI int ADDCALL airspy_open_file(struct airspy_device** device, const char* path, enum airspy_file_mode mode);
 extern ADDAPI int ADDCALL airspy_close(struct airspy_device* device);
 
 extern ADDAPI int ADDCALL airspy_set_samplerate(struct airspy_device* device, airspy_samplerate_t samplerate);
@@ -158,9 +248,52 @@ extern ADDAPI int ADDCALL airspy_board_partid_serialno_read(struct airspy_device
 
 extern ADDAPI int ADDCALL airspy_set_sample_type(struct airspy_device* device, enum airspy_sample_type sample_type);
 
+/* Not while streaming, the normalization and IQ correction settings are kept */
+extern ADDAPI int ADDCALL airspy_set_converter_profile(struct airspy_device* device, enum airspy_converter_profile profile);
+
+/*
+ * FIR filter applied in the conversion thread to the AIRSPY_SAMPLE_FLOAT32_IQ samples, or with real taps
+ * to the AIRSPY_SAMPLE_FLOAT32_REAL samples, after the resampler and before the callback: y[n] = sum taps[k] * x[n - k].
+ * taps: tap_count floats, or with complex_taps 1 tap_count interleaved re/im pairs. Up to 65536 taps,
+ * direct form for short filters and overlap-save FFT convolution for long ones, with the same output.
+ * taps NULL removes the filter. airspy_start_rx() returns AIRSPY_ERROR_INVALID_PARAM for another sample type,
+ * or for complex taps with AIRSPY_SAMPLE_FLOAT32_REAL. Not while streaming.
+ */
+extern ADDAPI int ADDCALL airspy_set_fir(struct airspy_device* device, const float* taps, uint32_t tap_count, uint8_t complex_taps);
+
+/*
+ * Resample the AIRSPY_SAMPLE_FLOAT32_IQ or AIRSPY_SAMPLE_FLOAT32_REAL output to output_rate samples per second,
+ * below the converter rate, e.g. 2400000, 2048000 or 1536000 for the IQ samples at 10MSPS. Polyphase
+ * Kaiser windowed sinc with 70dB of rejection, 80% of the output band is kept. The ratio is exact when it
+ * reduces to at most 1024 phases, the nearest such ratio otherwise. Sample indexes, dropped samples and
+ * retune ranges are counted at the output rate. Takes effect at airspy_start_rx(), which returns
+ * AIRSPY_ERROR_INVALID_PARAM for another sample type or rate. output_rate 0 disables. Not while streaming.
+ */
+extern ADDAPI int ADDCALL airspy_set_resampler(struct airspy_device* device, uint32_t output_rate);
+
+/*
+ * Decimate the AIRSPY_SAMPLE_INT16_IQ output by factor, even from 4 to 1024, for narrow channels:
+ * fixed point 5 stage CIC and a 64 taps compensation FIR, flat within 0.5dB over 80% of the output band.
+ * Sample indexes, dropped samples and retune ranges are counted at the output rate. Takes effect at
+ * airspy_start_rx(), which returns AIRSPY_ERROR_INVALID_PARAM for another sample type.
+ * factor 0 or 1 disables. Not while streaming.
+ */
+extern ADDAPI int ADDCALL airspy_set_int16_decimation(struct airspy_device* device, uint32_t factor);
+
 /* Parameter freq_hz shall be between 24000000(24MHz) and 1750000000(1.75GHz) */
 extern ADDAPI int ADDCALL airspy_set_freq(struct airspy_device* device, const uint32_t freq_hz);
 
+/*
+ * Sweep through step_count frequencies while streaming, set before airspy_start_rx().
+ * Each step delivers dwell_samples samples, in one or more blocks tagged with sweep_step and freq_hz.
+ * The retunes are issued from a control thread of the stream. The samples until a retune is in effect,
+ * those still in flight and the next settle_samples samples are discarded, a step failing to retune is skipped.
+ * For AIRSPY_SAMPLE_INT8_BFP_IQ both counts are rounded up to whole blocks.
+ * The list is copied, step_count 0 stops sweeping. If the retune to the first step fails, no sweep is set.
+ */
+extern ADDAPI int ADDCALL airspy_set_sweep(struct airspy_device* device, const uint32_t* freq_hz, uint32_t step_count,
+	uint32_t settle_samples, uint32_t dwell_samples);
+
 /* Parameter value shall be between 0 and 15 */
 extern ADDAPI int ADDCALL airspy_set_lna_gain(struct airspy_device* device, uint8_t value);
 
@@ -181,12 +314,74 @@ extern ADDAPI int ADDCALL airspy_set_lna_agc(struct airspy_device* device, uint8
 */
 extern ADDAPI int ADDCALL airspy_set_mixer_agc(struct airspy_device* device, uint8_t value);
 
+/*
+ * Host AGC: value 1 steps the VGA gain from a control thread of the stream to keep the RMS level of the blocks
+ * within target_dbfs +/- hysteresis_db, one step per block once the previous step is in effect.
+ * A block with clipped samples (airspy_block_stats_t clipped) steps it down whatever its level.
+ * LNA and mixer gains are left as set. The VGA gain starts from its value set with airspy_set_vga_gain(),
+ * or from 5, which value 1 sets, if it was never set. value 0 stops it, the VGA gain stays where it is.
+ */
+extern ADDAPI int ADDCALL airspy_set_host_agc(struct airspy_device* device, uint8_t value, float target_dbfs, float hysteresis_db);
+
+/*
+ * Normalization of AIRSPY_SAMPLE_FLOAT32_IQ blocks: value 1 scales the samples in place toward
+ * an RMS level of target_dbfs, never taking a block peak above full scale. The gain follows the
+ * level of the previous blocks, dropping at once and rising smoothly, and ramps within each block.
+ * value 0 turns it off. Other sample types are not affected.
+ */
+extern ADDAPI int ADDCALL airspy_set_normalization(struct airspy_device* device, uint8_t value, float target_dbfs);
+
+/*
+ * IQ correction of AIRSPY_SAMPLE_FLOAT32_IQ blocks: value 1 removes the residual DC and corrects the
+ * amplitude and phase imbalance between I and Q, estimated from the previous blocks. value 0 turns it
+ * off, setting it again restarts the estimation. Applied before the normalization.
+ */
+extern ADDAPI int ADDCALL airspy_set_iq_correction(struct airspy_device* device, uint8_t value);
+
+/*
+ * ADC code histogram: value 1 counts the raw samples of each block per AIRSPY_ADC_HISTOGRAM_BINS
+ * bin of codes in airspy_transfer_t adc_histogram, value 0 turns it off.
+ */
+extern ADDAPI int ADDCALL airspy_set_adc_histogram(struct airspy_device* device, uint8_t value);
+
+/*
+ * Burst gate on the RMS level of the blocks (airspy_transfer_t rms): a block at or above open_dbfs
+ * starts a burst, which goes on while the blocks stay at or above close_dbfs and for hold_ms after
+ * the last of them. The blocks of the preroll_ms before the start, up to 1000 ms, also belong to the
+ * burst: the blocks are delivered that much later, from a delay line.
+ * Parameter value:
+ *	0=Off
+ *	1=Mark, every block is delivered with its AIRSPY_BURST_* flags
+ *	2=Drop, only the blocks of bursts are delivered, sample_index jumps over the others
+ * Not applied while sweeping. The blocks still in the delay line when streaming stops are delivered
+ * before the stream ends, unless the callback asked to stop.
+ */
+extern ADDAPI int ADDCALL airspy_set_burst_gate(struct airspy_device* device, uint8_t value, float open_dbfs, float close_dbfs,
+	uint32_t preroll_ms, uint32_t hold_ms);
+
 /* Parameter value shall be 0=Disable BiasT or 1=Enable BiasT */
 extern ADDAPI int ADDCALL airspy_set_rf_bias(struct airspy_device* dev, uint8_t value);
 
 extern ADDAPI const char* ADDCALL airspy_error_name(enum airspy_error errcode);
 extern ADDAPI const char* ADDCALL airspy_board_id_name(enum airspy_board_id board_id);
 
+/*
+ * Offline conversion of raw AIRSPY_SAMPLE_UINT16_REAL samples, with the same filters as the streaming path.
+ * A converter keeps the filter state between calls, use one converter per independent stream or thread.
+ */
+struct airspy_converter;
+extern ADDAPI struct airspy_converter* ADDCALL airspy_converter_create(enum airspy_sample_type sample_type);
+/*
+ * count: raw samples in src, multiple of 4. dest holds count floats for the float types, count int16 otherwise.
+ * Return the number of output samples written to dest, or a negative enum airspy_error.
+ */
+extern ADDAPI int ADDCALL airspy_converter_process(struct airspy_converter* converter, const uint16_t* src, int count, void* dest);
+extern ADDAPI void ADDCALL airspy_converter_free(struct airspy_converter* converter);
+/* Levels of the samples converted by the last airspy_converter_process() call, as airspy_transfer_t stats */
+extern ADDAPI int ADDCALL airspy_converter_get_stats(struct airspy_converter* converter, airspy_block_stats_t* stats);
+/* Reset the filter state, AIRSPY_CONVERTER_DEFAULT after airspy_converter_create() */
+extern ADDAPI int ADDCALL airspy_converter_set_profile(struct airspy_converter* converter, enum airspy_converter_profile profile);
+
 #ifdef __cplusplus
 } // __cplusplus defined.
 #endif
@@ -0,0 +1,295 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "cic_decimator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && CIC_DECIMATOR_STAGES == 5
+#include <emmintrin.h>
+#define CIC_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define COMP_SHIFT (14) /* Fraction bits of the compensation taps */
+#define COMP_PASS (0.2) /* Passband edge, fraction of the CIC output rate */
+#define COMP_STOP (0.3) /* Aliases onto the passband edge after the final decimation by 2 */
+#define COMP_BETA (5.65) /* Kaiser window, about 60dB */
+#define COMP_GRID (2048) /* Integration points of the frequency sampling design */
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/* Normalized CIC response at x times the CIC output rate */
+static double cic_response(int cic_factor, double x)
+{
+	double h;
+
+	if (x == 0.0)
+	{
+		return 1.0;
+	}
+	h = sin(M_PI * x) / (cic_factor * sin(M_PI * x / cic_factor));
+	return pow(fabs(h), CIC_DECIMATOR_STAGES);
+}
+
+cic_decimator_t *cic_decimator_create(int factor)
+{
+	cic_decimator_t *cic;
+	double proto[CIC_DECIMATOR_COMP_TAPS];
+	double center = (CIC_DECIMATOR_COMP_TAPS - 1) / 2.0;
+	double gain, x, d, h, sum;
+	int n, k;
+
+	if (factor < CIC_DECIMATOR_MIN_FACTOR || factor > CIC_DECIMATOR_MAX_FACTOR || (factor & 1))
+	{
+		return NULL;
+	}
+
+	cic = (cic_decimator_t *) calloc(1, sizeof(cic_decimator_t));
+	if (cic == NULL)
+	{
+		return NULL;
+	}
+
+	cic->factor = factor;
+	cic->cic_factor = factor / 2;
+	gain = pow((double) cic->cic_factor, CIC_DECIMATOR_STAGES);
+	while (ldexp(1.0, cic->shift) < gain)
+	{
+		cic->shift++;
+	}
+
+	/* Frequency sampling of the inverse CIC response, tapered to zero across the transition band */
+	sum = 0.0;
+	for (n = 0; n < CIC_DECIMATOR_COMP_TAPS; n++)
+	{
+		h = 0.0;
+		for (k = 0; k < COMP_GRID; k++)
+		{
+			x = (k + 0.5) * COMP_STOP / COMP_GRID;
+			d = 1.0 / cic_response(cic->cic_factor, x);
+			if (x > COMP_PASS)
+			{
+				d *= (COMP_STOP - x) / (COMP_STOP - COMP_PASS);
+			}
+			h += d * cos(2.0 * M_PI * x * (n - center));
+		}
+		h *= bessel_i0(COMP_BETA * sqrt(1.0 - ((n - center) / center) * ((n - center) / center))) / bessel_i0(COMP_BETA);
+		proto[n] = h;
+		sum += h;
+	}
+
+	/* Unity DC gain, including what the shift leaves of the CIC gain */
+	for (n = 0; n < CIC_DECIMATOR_COMP_TAPS; n++)
+	{
+		cic->taps[n] = (int32_t) floor(proto[n] / sum * ldexp(1.0, cic->shift) / gain * (1 << COMP_SHIFT) + 0.5);
+	}
+
+	return cic;
+}
+
+void cic_decimator_free(cic_decimator_t *cic)
+{
+	free(cic);
+}
+
+static void integrate(cic_decimator_t *cic, const int16_t *samples, int count)
+{
+	int i;
+
+#ifdef CIC_SSE2
+
+	/* Unrolled for the 5 stages, the accumulators stay in registers */
+	__m128i a0 = _mm_loadu_si128((const __m128i *) (cic->integrators + 0));
+	__m128i a1 = _mm_loadu_si128((const __m128i *) (cic->integrators + 2));
+	__m128i a2 = _mm_loadu_si128((const __m128i *) (cic->integrators + 4));
+	__m128i a3 = _mm_loadu_si128((const __m128i *) (cic->integrators + 6));
+	__m128i a4 = _mm_loadu_si128((const __m128i *) (cic->integrators + 8));
+	__m128i x;
+
+	for (i = 0; i < count; i++)
+	{
+		/* Sign extend the I/Q pair to two 64 bit lanes */
+		x = _mm_cvtsi32_si128(*(const int *) (samples + 2 * i));
+		x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		x = _mm_unpacklo_epi32(x, _mm_srai_epi32(x, 31));
+
+		a0 = _mm_add_epi64(a0, x);
+		a1 = _mm_add_epi64(a1, a0);
+		a2 = _mm_add_epi64(a2, a1);
+		a3 = _mm_add_epi64(a3, a2);
+		a4 = _mm_add_epi64(a4, a3);
+	}
+
+	_mm_storeu_si128((__m128i *) (cic->integrators + 0), a0);
+	_mm_storeu_si128((__m128i *) (cic->integrators + 2), a1);
+	_mm_storeu_si128((__m128i *) (cic->integrators + 4), a2);
+	_mm_storeu_si128((__m128i *) (cic->integrators + 6), a3);
+	_mm_storeu_si128((__m128i *) (cic->integrators + 8), a4);
+
+#else
+
+	uint64_t x_i, x_q;
+	int k;
+
+	for (i = 0; i < count; i++)
+	{
+		x_i = (uint64_t) (int64_t) samples[2 * i];
+		x_q = (uint64_t) (int64_t) samples[2 * i + 1];
+
+		for (k = 0; k < CIC_DECIMATOR_STAGES; k++)
+		{
+			x_i = cic->integrators[2 * k] += x_i;
+			x_q = cic->integrators[2 * k + 1] += x_q;
+		}
+	}
+
+#endif
+}
+
+/* Comb section at the CIC output rate, the result goes to the compensation history */
+static void comb(cic_decimator_t *cic)
+{
+	uint64_t v, t;
+	int64_t y;
+	int c, k, pos;
+
+	for (c = 0; c < 2; c++)
+	{
+		v = cic->integrators[2 * (CIC_DECIMATOR_STAGES - 1) + c];
+		for (k = 0; k < CIC_DECIMATOR_STAGES; k++)
+		{
+			t = v - cic->combs[2 * k + c];
+			cic->combs[2 * k + c] = v;
+			v = t;
+		}
+
+		y = ((int64_t) v + ((int64_t) 1 << (cic->shift - 1))) >> cic->shift;
+		pos = 2 * cic->head + c;
+		cic->history[pos] = (int32_t) y;
+		cic->history[pos + 2 * CIC_DECIMATOR_COMP_TAPS] = (int32_t) y;
+	}
+
+	cic->head = (cic->head + 1) % CIC_DECIMATOR_COMP_TAPS;
+}
+
+static int16_t saturate(int64_t acc)
+{
+	acc = (acc + (1 << (COMP_SHIFT - 1))) >> COMP_SHIFT;
+	if (acc > 32767)
+	{
+		return 32767;
+	}
+	if (acc < -32768)
+	{
+		return -32768;
+	}
+	return (int16_t) acc;
+}
+
+/* Compensation FIR on the last CIC_DECIMATOR_COMP_TAPS CIC outputs, oldest first */
+static void compensate(const cic_decimator_t *cic, int16_t *output)
+{
+	const int32_t *window = cic->history + 2 * cic->head;
+	int64_t acc_i = 0;
+	int64_t acc_q = 0;
+	int k;
+
+	for (k = 0; k < CIC_DECIMATOR_COMP_TAPS; k++)
+	{
+		acc_i += (int64_t) cic->taps[k] * window[2 * k];
+		acc_q += (int64_t) cic->taps[k] * window[2 * k + 1];
+	}
+
+	output[0] = saturate(acc_i);
+	output[1] = saturate(acc_q);
+}
+
+int cic_decimator_process(cic_decimator_t *cic, int16_t *samples, int count)
+{
+	int i = 0;
+	int out = 0;
+	int phase;
+	int run;
+
+	while (i < count)
+	{
+		/* Integrate up to and including the next sample taken by the CIC */
+		phase = cic->pos % cic->cic_factor;
+		run = (phase == 0) ? 1 : cic->cic_factor - phase;
+		if (run > count - i)
+		{
+			run = count - i;
+		}
+
+		integrate(cic, samples + 2 * i, run);
+		if (phase == 0)
+		{
+			comb(cic);
+			if (cic->pos == 0)
+			{
+				compensate(cic, samples + 2 * out);
+				out++;
+			}
+		}
+
+		cic->pos = (cic->pos + run) % cic->factor;
+		i += run;
+	}
+
+	return out;
+}
+
+int cic_decimator_skip(cic_decimator_t *cic, uint64_t count)
+{
+	uint64_t first = (cic->factor - cic->pos) % cic->factor;
+	int skipped = 0;
+
+	/* Outputs that would have been taken within the lost samples, the filters go on with the next block */
+	if (count > first)
+	{
+		skipped = (int) ((count - first - 1) / cic->factor + 1);
+	}
+
+	cic->pos = (int) ((cic->pos + count) % cic->factor);
+	return skipped;
+}
+
+uint64_t cic_decimator_output_index(const cic_decimator_t *cic, uint64_t count)
+{
+	return (count + cic->factor - 1) / cic->factor;
+}
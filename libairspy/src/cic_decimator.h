@@ -0,0 +1,59 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CIC_DECIMATOR_H
+#define CIC_DECIMATOR_H
+
+#include <stdint.h>
+
+/*
+ * Decimation of int16 IQ pairs by factor: a CIC_DECIMATOR_STAGES stage CIC decimating by factor / 2 with
+ * 64 bit integrators, then a CIC_DECIMATOR_COMP_TAPS taps FIR decimating by 2 that flattens the CIC droop
+ * over 80% of the output band. Output n is taken at input n * factor.
+ */
+
+#define CIC_DECIMATOR_STAGES (5)
+#define CIC_DECIMATOR_COMP_TAPS (64)
+#define CIC_DECIMATOR_MIN_FACTOR (4)
+#define CIC_DECIMATOR_MAX_FACTOR (1024)
+
+typedef struct {
+	int factor; /* Even, CIC_DECIMATOR_MIN_FACTOR to CIC_DECIMATOR_MAX_FACTOR */
+	int cic_factor; /* factor / 2 */
+	int shift; /* Right shift of the CIC output, 2^shift >= CIC gain */
+	uint64_t integrators[CIC_DECIMATOR_STAGES * 2]; /* I/Q pairs, wrapping */
+	uint64_t combs[CIC_DECIMATOR_STAGES * 2];
+	int32_t taps[CIC_DECIMATOR_COMP_TAPS]; /* Q14, remaining CIC gain included */
+	int32_t history[CIC_DECIMATOR_COMP_TAPS * 4]; /* CIC outputs, written twice for a contiguous window */
+	int head;
+	int pos; /* Input index of the next sample modulo factor */
+} cic_decimator_t;
+
+cic_decimator_t *cic_decimator_create(int factor);
+void cic_decimator_free(cic_decimator_t *cic);
+/* count IQ pairs from samples, the output is written in place. Return the output pair count */
+int cic_decimator_process(cic_decimator_t *cic, int16_t *samples, int count);
+/* Account for count IQ pairs lost before the next block. Return the output pairs skipped */
+int cic_decimator_skip(cic_decimator_t *cic, uint64_t count);
+/* Output pairs for count input pairs, from the start of the stream */
+uint64_t cic_decimator_output_index(const cic_decimator_t *cic, uint64_t count);
+
+#endif // CIC_DECIMATOR_H
@@ -25,6 +25,66 @@ THE SOFTWARE.
 
 #include <stdint.h>
 
+/* Half-band kernels of the converter profiles, the 47 taps ones are the default */
+
+#define HB_KERNEL_FLOAT_15_LEN 15
+
+const float HB_KERNEL_FLOAT_15[HB_KERNEL_FLOAT_15_LEN] =
+{
+	-0.015027445627804819,
+	 0.000000000000000000,
+	 0.038846402916865419,
+	 0.000000000000000000,
+	-0.090572559984677350,
+	 0.000000000000000000,
+	 0.316753602695616754,
+	 0.500000000000000000,
+	 0.316753602695616754,
+	 0.000000000000000000,
+	-0.090572559984677350,
+	 0.000000000000000000,
+	 0.038846402916865419,
+	 0.000000000000000000,
+	-0.015027445627804819
+};
+
+#define HB_KERNEL_FLOAT_31_LEN 31
+
+const float HB_KERNEL_FLOAT_31[HB_KERNEL_FLOAT_31_LEN] =
+{
+	-0.001045898639481335,
+	 0.000000000000000000,
+	 0.003490383226208281,
+	 0.000000000000000000,
+	-0.008026732927155326,
+	 0.000000000000000000,
+	 0.015699765555881588,
+	 0.000000000000000000,
+	-0.028340671254613547,
+	 0.000000000000000000,
+	 0.050335930214810851,
+	 0.000000000000000000,
+	-0.097662687465365883,
+	 0.000000000000000000,
+	 0.315549911289715324,
+	 0.500000000000000000,
+	 0.315549911289715324,
+	 0.000000000000000000,
+	-0.097662687465365883,
+	 0.000000000000000000,
+	 0.050335930214810851,
+	 0.000000000000000000,
+	-0.028340671254613547,
+	 0.000000000000000000,
+	 0.015699765555881588,
+	 0.000000000000000000,
+	-0.008026732927155326,
+	 0.000000000000000000,
+	 0.003490383226208281,
+	 0.000000000000000000,
+	-0.001045898639481335
+};
+
 #define HB_KERNEL_FLOAT_LEN 47
 
 const float HB_KERNEL_FLOAT[HB_KERNEL_FLOAT_LEN] =
@@ -78,6 +138,165 @@ const float HB_KERNEL_FLOAT[HB_KERNEL_FLOAT_LEN] =
 	-0.000998606272947510
 };
 
+#define HB_KERNEL_FLOAT_95_LEN 95
+
+const float HB_KERNEL_FLOAT_95[HB_KERNEL_FLOAT_95_LEN] =
+{
+	-0.000028795969899898,
+	 0.000000000000000000,
+	 0.000074840908924348,
+	 0.000000000000000000,
+	-0.000150032604847844,
+	 0.000000000000000000,
+	 0.000264499011408749,
+	 0.000000000000000000,
+	-0.000430226453620137,
+	 0.000000000000000000,
+	 0.000661168249815561,
+	 0.000000000000000000,
+	-0.000973373120354352,
+	 0.000000000000000000,
+	 0.001385169092089919,
+	 0.000000000000000000,
+	-0.001917458963788118,
+	 0.000000000000000000,
+	 0.002594214241904833,
+	 0.000000000000000000,
+	-0.003443303427484263,
+	 0.000000000000000000,
+	 0.004497872180895500,
+	 0.000000000000000000,
+	-0.005798635881182646,
+	 0.000000000000000000,
+	 0.007397708349849041,
+	 0.000000000000000000,
+	-0.009365101371048535,
+	 0.000000000000000000,
+	 0.011800080433685011,
+	 0.000000000000000000,
+	-0.014851874027816741,
+	 0.000000000000000000,
+	 0.018759748527514639,
+	 0.000000000000000000,
+	-0.023937003137326079,
+	 0.000000000000000000,
+	 0.031167073036940385,
+	 0.000000000000000000,
+	-0.042135773300043540,
+	 0.000000000000000000,
+	 0.061240616167390849,
+	 0.000000000000000000,
+	-0.104636461241031750,
+	 0.000000000000000000,
+	 0.317825049298025075,
+	 0.500000000000000000,
+	 0.317825049298025075,
+	 0.000000000000000000,
+	-0.104636461241031750,
+	 0.000000000000000000,
+	 0.061240616167390849,
+	 0.000000000000000000,
+	-0.042135773300043540,
+	 0.000000000000000000,
+	 0.031167073036940385,
+	 0.000000000000000000,
+	-0.023937003137326079,
+	 0.000000000000000000,
+	 0.018759748527514639,
+	 0.000000000000000000,
+	-0.014851874027816741,
+	 0.000000000000000000,
+	 0.011800080433685011,
+	 0.000000000000000000,
+	-0.009365101371048535,
+	 0.000000000000000000,
+	 0.007397708349849041,
+	 0.000000000000000000,
+	-0.005798635881182646,
+	 0.000000000000000000,
+	 0.004497872180895500,
+	 0.000000000000000000,
+	-0.003443303427484263,
+	 0.000000000000000000,
+	 0.002594214241904833,
+	 0.000000000000000000,
+	-0.001917458963788118,
+	 0.000000000000000000,
+	 0.001385169092089919,
+	 0.000000000000000000,
+	-0.000973373120354352,
+	 0.000000000000000000,
+	 0.000661168249815561,
+	 0.000000000000000000,
+	-0.000430226453620137,
+	 0.000000000000000000,
+	 0.000264499011408749,
+	 0.000000000000000000,
+	-0.000150032604847844,
+	 0.000000000000000000,
+	 0.000074840908924348,
+	 0.000000000000000000,
+	-0.000028795969899898
+};
+
+#define HB_KERNEL_INT16_15_LEN 15
+
+const int16_t HB_KERNEL_INT16_15[HB_KERNEL_INT16_15_LEN] =
+{
+	-492,
+	 0,
+	 1273,
+	 0,
+	-2968,
+	 0,
+	 10379,
+	 16384,
+	 10379,
+	 0,
+	-2968,
+	 0,
+	 1273,
+	 0,
+	-492
+};
+
+#define HB_KERNEL_INT16_31_LEN 31
+
+const int16_t HB_KERNEL_INT16_31[HB_KERNEL_INT16_31_LEN] =
+{
+	-34,
+	 0,
+	 114,
+	 0,
+	-263,
+	 0,
+	 514,
+	 0,
+	-929,
+	 0,
+	 1649,
+	 0,
+	-3200,
+	 0,
+	 10340,
+	 16384,
+	 10340,
+	 0,
+	-3200,
+	 0,
+	 1649,
+	 0,
+	-929,
+	 0,
+	 514,
+	 0,
+	-263,
+	 0,
+	 114,
+	 0,
+	-34
+};
+
 #define HB_KERNEL_INT16_LEN 47
 
 const int16_t HB_KERNEL_INT16[HB_KERNEL_INT16_LEN] =
@@ -131,4 +350,105 @@ const int16_t HB_KERNEL_INT16[HB_KERNEL_INT16_LEN] =
 	-33
 };
 
+#define HB_KERNEL_INT16_95_LEN 95
+
+const int16_t HB_KERNEL_INT16_95[HB_KERNEL_INT16_95_LEN] =
+{
+	-1,
+	 0,
+	 2,
+	 0,
+	-5,
+	 0,
+	 9,
+	 0,
+	-14,
+	 0,
+	 22,
+	 0,
+	-32,
+	 0,
+	 45,
+	 0,
+	-63,
+	 0,
+	 85,
+	 0,
+	-113,
+	 0,
+	 147,
+	 0,
+	-190,
+	 0,
+	 242,
+	 0,
+	-307,
+	 0,
+	 387,
+	 0,
+	-487,
+	 0,
+	 615,
+	 0,
+	-784,
+	 0,
+	 1021,
+	 0,
+	-1381,
+	 0,
+	 2007,
+	 0,
+	-3429,
+	 0,
+	 10414,
+	 16384,
+	 10414,
+	 0,
+	-3429,
+	 0,
+	 2007,
+	 0,
+	-1381,
+	 0,
+	 1021,
+	 0,
+	-784,
+	 0,
+	 615,
+	 0,
+	-487,
+	 0,
+	 387,
+	 0,
+	-307,
+	 0,
+	 242,
+	 0,
+	-190,
+	 0,
+	 147,
+	 0,
+	-113,
+	 0,
+	 85,
+	 0,
+	-63,
+	 0,
+	 45,
+	 0,
+	-32,
+	 0,
+	 22,
+	 0,
+	-14,
+	 0,
+	 9,
+	 0,
+	-5,
+	 0,
+	 2,
+	 0,
+	-1
+};
+
 #endif // FILTERS_H
@@ -0,0 +1,543 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "fir_filter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FIR_FILTER_SSE
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define DIRECT_CHUNK (4096) /* Samples per pass of the direct form */
+#define FFT_SIZE_MIN (256)
+#define FFT_SIZE_FACTOR (4) /* FFT size against the tap count, about 3/4 of each FFT is new samples */
+
+/* Forward FFT of size complex interleaved values in place */
+static void fft(fir_filter_t *filter, float *data)
+{
+	int size = filter->fft_size;
+	int i, j, k;
+	int span, half, stride;
+	float w_re, w_im, t_re, t_im;
+	float tmp;
+	float *a, *b;
+
+	for (i = 0; i < size; i++)
+	{
+		j = filter->bit_reverse[i];
+		if (j > i)
+		{
+			tmp = data[2 * i]; data[2 * i] = data[2 * j]; data[2 * j] = tmp;
+			tmp = data[2 * i + 1]; data[2 * i + 1] = data[2 * j + 1]; data[2 * j + 1] = tmp;
+		}
+	}
+
+#ifdef FIR_FILTER_SSE
+
+	for (k = 0; k < size; k += 2)
+	{
+		a = data + 2 * k;
+		t_re = a[2];
+		t_im = a[3];
+		a[2] = a[0] - t_re;
+		a[3] = a[1] - t_im;
+		a[0] += t_re;
+		a[1] += t_im;
+	}
+
+	/* Two butterflies per vector, the twiddles of a stage are contiguous */
+	for (span = 4; span <= size; span <<= 1)
+	{
+		const float *w_r;
+		const float *w_i;
+		__m128 va, vb, t;
+
+		half = span >> 1;
+		w_r = filter->stage_re + 2 * (half - 2);
+		w_i = filter->stage_im + 2 * (half - 2);
+
+		for (k = 0; k < size; k += span)
+		{
+			a = data + 2 * k;
+			b = data + 2 * (k + half);
+
+			for (j = 0; j < 2 * half; j += 4)
+			{
+				va = _mm_loadu_ps(a + j);
+				vb = _mm_loadu_ps(b + j);
+				t = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(w_r + j), vb),
+					_mm_mul_ps(_mm_loadu_ps(w_i + j), _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 3, 0, 1))));
+				_mm_storeu_ps(b + j, _mm_sub_ps(va, t));
+				_mm_storeu_ps(a + j, _mm_add_ps(va, t));
+			}
+		}
+	}
+
+	(void) stride;
+	(void) w_re;
+	(void) w_im;
+
+#else
+
+	for (span = 2; span <= size; span <<= 1)
+	{
+		half = span >> 1;
+		stride = size / span;
+
+		for (j = 0; j < half; j++)
+		{
+			w_re = filter->twiddles[2 * j * stride];
+			w_im = filter->twiddles[2 * j * stride + 1];
+
+			for (k = j; k < size; k += span)
+			{
+				a = data + 2 * k;
+				b = data + 2 * (k + half);
+				t_re = w_re * b[0] - w_im * b[1];
+				t_im = w_re * b[1] + w_im * b[0];
+				b[0] = a[0] - t_re;
+				b[1] = a[1] - t_im;
+				a[0] += t_re;
+				a[1] += t_im;
+			}
+		}
+	}
+
+#endif
+}
+
+/* data times the taps spectrum, conjugated: the next forward FFT then gives the conjugated convolution */
+static void multiply_conj(fir_filter_t *filter, float *data)
+{
+	int i;
+	float re, im;
+	const float *h = filter->spectrum;
+
+	for (i = 0; i < 2 * filter->fft_size; i += 2)
+	{
+		re = data[i] * h[i] - data[i + 1] * h[i + 1];
+		im = data[i] * h[i + 1] + data[i + 1] * h[i];
+		data[i] = re;
+		data[i + 1] = -im;
+	}
+}
+
+/* Keep the last len values of history followed by the count values of samples */
+static void push_history(float *history, int len, const float *samples, int count)
+{
+	if (count >= len)
+	{
+		memcpy(history, samples + count - len, len * sizeof(float));
+	}
+	else
+	{
+		memmove(history, history + count, (len - count) * sizeof(float));
+		memcpy(history + len - count, samples, count * sizeof(float));
+	}
+}
+
+fir_filter_t *fir_filter_create(const float *taps, int tap_count, int complex_taps)
+{
+	fir_filter_t *filter;
+	int i, j, k;
+	int bits;
+	int half;
+	float re, im;
+
+	if (taps == NULL || tap_count < 1 || tap_count > FIR_FILTER_MAX_TAPS)
+	{
+		return NULL;
+	}
+
+	filter = (fir_filter_t *) calloc(1, sizeof(fir_filter_t));
+	if (filter == NULL)
+	{
+		return NULL;
+	}
+
+	filter->tap_count = tap_count;
+	filter->complex_taps = complex_taps;
+	filter->use_fft = (tap_count >= FIR_FILTER_FFT_MIN_TAPS);
+
+	if (!filter->use_fft)
+	{
+		filter->len = (tap_count + 3) & ~3;
+		filter->taps = (float *) calloc(filter->len, sizeof(float));
+		filter->taps_re = (float *) calloc(2 * filter->len, sizeof(float));
+		filter->taps_im = complex_taps ? (float *) calloc(2 * filter->len, sizeof(float)) : NULL;
+		filter->history = (float *) calloc(2 * (filter->len - 1), sizeof(float));
+		filter->work = (float *) malloc(2 * (filter->len - 1 + DIRECT_CHUNK) * sizeof(float));
+
+		if (filter->taps == NULL || filter->taps_re == NULL || (complex_taps && filter->taps_im == NULL)
+			|| filter->history == NULL || filter->work == NULL)
+		{
+			fir_filter_free(filter);
+			return NULL;
+		}
+
+		/* Reversed so that the output is a dot product with the input in memory order, zero padded at the old end */
+		for (k = 0; k < tap_count; k++)
+		{
+			j = filter->len - 1 - k;
+			re = complex_taps ? taps[2 * k] : taps[k];
+			im = complex_taps ? taps[2 * k + 1] : 0.0f;
+			filter->taps[j] = re;
+			filter->taps_re[2 * j] = re;
+			filter->taps_re[2 * j + 1] = re;
+			if (complex_taps)
+			{
+				filter->taps_im[2 * j] = -im;
+				filter->taps_im[2 * j + 1] = im;
+			}
+		}
+
+		return filter;
+	}
+
+	filter->len = tap_count;
+	filter->fft_size = FFT_SIZE_MIN;
+	while (filter->fft_size < FFT_SIZE_FACTOR * tap_count)
+	{
+		filter->fft_size <<= 1;
+	}
+	filter->step = filter->fft_size - tap_count + 1;
+
+	filter->history = (float *) calloc(2 * (tap_count - 1), sizeof(float));
+	filter->work = (float *) malloc(2 * filter->fft_size * sizeof(float));
+	filter->spectrum = (float *) calloc(2 * filter->fft_size, sizeof(float));
+	filter->twiddles = (float *) malloc(filter->fft_size * sizeof(float));
+	filter->stage_re = (float *) malloc(2 * filter->fft_size * sizeof(float));
+	filter->stage_im = (float *) malloc(2 * filter->fft_size * sizeof(float));
+	filter->bit_reverse = (int *) malloc(filter->fft_size * sizeof(int));
+
+	if (filter->history == NULL || filter->work == NULL || filter->spectrum == NULL || filter->twiddles == NULL
+		|| filter->stage_re == NULL || filter->stage_im == NULL || filter->bit_reverse == NULL)
+	{
+		fir_filter_free(filter);
+		return NULL;
+	}
+
+	for (bits = 0; (1 << bits) < filter->fft_size; bits++);
+	for (i = 0; i < filter->fft_size; i++)
+	{
+		for (j = 0, k = 0; k < bits; k++)
+		{
+			j |= ((i >> k) & 1) << (bits - 1 - k);
+		}
+		filter->bit_reverse[i] = j;
+	}
+
+	for (i = 0; i < filter->fft_size / 2; i++)
+	{
+		filter->twiddles[2 * i] = (float) cos(-2.0 * M_PI * i / filter->fft_size);
+		filter->twiddles[2 * i + 1] = (float) sin(-2.0 * M_PI * i / filter->fft_size);
+	}
+
+	/* Stage of half span h at 2 * (h - 2), twiddle j of the stage is twiddle j * fft_size / (2 * h) */
+	for (half = 2; half < filter->fft_size; half <<= 1)
+	{
+		for (j = 0; j < half; j++)
+		{
+			k = j * (filter->fft_size / (2 * half));
+			filter->stage_re[2 * (half - 2 + j)] = filter->twiddles[2 * k];
+			filter->stage_re[2 * (half - 2 + j) + 1] = filter->twiddles[2 * k];
+			filter->stage_im[2 * (half - 2 + j)] = -filter->twiddles[2 * k + 1];
+			filter->stage_im[2 * (half - 2 + j) + 1] = filter->twiddles[2 * k + 1];
+		}
+	}
+
+	/* The 1 / fft_size of the inverse transform is folded in the taps */
+	for (k = 0; k < tap_count; k++)
+	{
+		filter->spectrum[2 * k] = (complex_taps ? taps[2 * k] : taps[k]) / filter->fft_size;
+		filter->spectrum[2 * k + 1] = complex_taps ? taps[2 * k + 1] / filter->fft_size : 0.0f;
+	}
+	fft(filter, filter->spectrum);
+
+	return filter;
+}
+
+void fir_filter_free(fir_filter_t *filter)
+{
+	if (filter == NULL)
+	{
+		return;
+	}
+
+	free(filter->taps);
+	free(filter->taps_re);
+	free(filter->taps_im);
+	free(filter->history);
+	free(filter->work);
+	free(filter->spectrum);
+	free(filter->twiddles);
+	free(filter->stage_re);
+	free(filter->stage_im);
+	free(filter->bit_reverse);
+	free(filter);
+}
+
+static void direct_real(fir_filter_t *filter, float *samples, int count)
+{
+	int len = filter->len;
+	int i, n, r;
+	float acc;
+	const float *x;
+
+#ifdef FIR_FILTER_SSE
+
+	__m128 v;
+	float tmp[4];
+
+#endif
+
+	while (count > 0)
+	{
+		r = (count < DIRECT_CHUNK) ? count : DIRECT_CHUNK;
+		memcpy(filter->work, filter->history, (len - 1) * sizeof(float));
+		memcpy(filter->work + len - 1, samples, r * sizeof(float));
+
+		for (n = 0; n < r; n++)
+		{
+			x = filter->work + n;
+
+#ifdef FIR_FILTER_SSE
+
+			v = _mm_setzero_ps();
+			for (i = 0; i < len; i += 4)
+			{
+				v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(filter->taps + i), _mm_loadu_ps(x + i)));
+			}
+			_mm_storeu_ps(tmp, v);
+			acc = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+
+#else
+
+			acc = 0.0f;
+			for (i = 0; i < len; i++)
+			{
+				acc += filter->taps[i] * x[i];
+			}
+
+#endif
+
+			samples[n] = acc;
+		}
+
+		memcpy(filter->history, filter->work + r, (len - 1) * sizeof(float));
+		samples += r;
+		count -= r;
+	}
+}
+
+static void direct_complex(fir_filter_t *filter, float *samples, int count)
+{
+	int len = filter->len;
+	int i, n, r;
+	float acc_i, acc_q;
+	const float *x;
+
+#ifdef FIR_FILTER_SSE
+
+	__m128 v, xv;
+	float tmp[4];
+
+#endif
+
+	while (count > 0)
+	{
+		r = (count < DIRECT_CHUNK) ? count : DIRECT_CHUNK;
+		memcpy(filter->work, filter->history, 2 * (len - 1) * sizeof(float));
+		memcpy(filter->work + 2 * (len - 1), samples, 2 * r * sizeof(float));
+
+		for (n = 0; n < r; n++)
+		{
+			x = filter->work + 2 * n;
+
+#ifdef FIR_FILTER_SSE
+
+			/* Two taps per vector, (I, Q) pairs */
+			v = _mm_setzero_ps();
+			if (filter->taps_im == NULL)
+			{
+				for (i = 0; i < 2 * len; i += 4)
+				{
+					v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(filter->taps_re + i), _mm_loadu_ps(x + i)));
+				}
+			}
+			else
+			{
+				for (i = 0; i < 2 * len; i += 4)
+				{
+					xv = _mm_loadu_ps(x + i);
+					v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(filter->taps_re + i), xv));
+					v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(filter->taps_im + i), _mm_shuffle_ps(xv, xv, _MM_SHUFFLE(2, 3, 0, 1))));
+				}
+			}
+			_mm_storeu_ps(tmp, v);
+			acc_i = tmp[0] + tmp[2];
+			acc_q = tmp[1] + tmp[3];
+
+#else
+
+			acc_i = 0.0f;
+			acc_q = 0.0f;
+			for (i = 0; i < 2 * len; i += 2)
+			{
+				acc_i += filter->taps_re[i] * x[i];
+				acc_q += filter->taps_re[i + 1] * x[i + 1];
+				if (filter->taps_im != NULL)
+				{
+					acc_i += filter->taps_im[i] * x[i + 1];
+					acc_q += filter->taps_im[i + 1] * x[i];
+				}
+			}
+
+#endif
+
+			samples[2 * n] = acc_i;
+			samples[2 * n + 1] = acc_q;
+		}
+
+		memcpy(filter->history, filter->work + 2 * r, 2 * (len - 1) * sizeof(float));
+		samples += 2 * r;
+		count -= r;
+	}
+}
+
+/* Two consecutive runs of real samples per FFT, one as the real parts and one as the imaginary parts */
+static void overlap_save_real(fir_filter_t *filter, float *samples, int count)
+{
+	int keep = filter->tap_count - 1;
+	int r_a, r_b;
+	int i;
+	float *buf = filter->work;
+
+	while (count > 0)
+	{
+		r_a = (count < filter->step) ? count : filter->step;
+		r_b = (count - r_a < filter->step) ? count - r_a : filter->step;
+
+		memset(buf, 0, 2 * filter->fft_size * sizeof(float));
+		for (i = 0; i < keep; i++)
+		{
+			buf[2 * i] = filter->history[i];
+		}
+		for (i = 0; i < r_a; i++)
+		{
+			buf[2 * (keep + i)] = samples[i];
+		}
+		push_history(filter->history, keep, samples, r_a);
+
+		for (i = 0; i < keep; i++)
+		{
+			buf[2 * i + 1] = filter->history[i];
+		}
+		for (i = 0; i < r_b; i++)
+		{
+			buf[2 * (keep + i) + 1] = samples[r_a + i];
+		}
+		push_history(filter->history, keep, samples + r_a, r_b);
+
+		fft(filter, buf);
+		multiply_conj(filter, buf);
+		fft(filter, buf);
+
+		for (i = 0; i < r_a; i++)
+		{
+			samples[i] = buf[2 * (keep + i)];
+		}
+		for (i = 0; i < r_b; i++)
+		{
+			samples[r_a + i] = -buf[2 * (keep + i) + 1];
+		}
+
+		samples += r_a + r_b;
+		count -= r_a + r_b;
+	}
+}
+
+static void overlap_save_complex(fir_filter_t *filter, float *samples, int count)
+{
+	int keep = filter->tap_count - 1;
+	int r;
+	int i;
+	float *buf = filter->work;
+
+	while (count > 0)
+	{
+		r = (count < filter->step) ? count : filter->step;
+
+		memcpy(buf, filter->history, 2 * keep * sizeof(float));
+		memcpy(buf + 2 * keep, samples, 2 * r * sizeof(float));
+		memset(buf + 2 * (keep + r), 0, 2 * (filter->fft_size - keep - r) * sizeof(float));
+		push_history(filter->history, 2 * keep, samples, 2 * r);
+
+		fft(filter, buf);
+		multiply_conj(filter, buf);
+		fft(filter, buf);
+
+		for (i = 0; i < r; i++)
+		{
+			samples[2 * i] = buf[2 * (keep + i)];
+			samples[2 * i + 1] = -buf[2 * (keep + i) + 1];
+		}
+
+		samples += 2 * r;
+		count -= r;
+	}
+}
+
+void fir_filter_process_real(fir_filter_t *filter, float *samples, int count)
+{
+	if (filter->complex_taps)
+	{
+		return;
+	}
+
+	if (filter->use_fft)
+	{
+		overlap_save_real(filter, samples, count);
+	}
+	else
+	{
+		direct_real(filter, samples, count);
+	}
+}
+
+void fir_filter_process_complex(fir_filter_t *filter, float *samples, int count)
+{
+	if (filter->use_fft)
+	{
+		overlap_save_complex(filter, samples, count);
+	}
+	else
+	{
+		direct_complex(filter, samples, count);
+	}
+}
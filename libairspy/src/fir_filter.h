@@ -0,0 +1,64 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FIR_FILTER_H
+#define FIR_FILTER_H
+
+#include <stdint.h>
+
+/*
+ * User FIR applied in place to the converted float samples, with the same output as the direct
+ * form y[n] = sum h[k] x[n - k] whichever implementation is used: the direct form for up to
+ * FIR_FILTER_FFT_MIN_TAPS taps, overlap-save FFT convolution above.
+ */
+
+#define FIR_FILTER_MAX_TAPS (65536)
+#define FIR_FILTER_FFT_MIN_TAPS (40)
+
+typedef struct {
+	int tap_count; /* Taps as given */
+	int complex_taps;
+	int use_fft;
+	int len; /* Direct form: tap_count rounded up to a multiple of 4, FFT: tap_count */
+	float *taps; /* Direct form: reversed real parts of the taps */
+	float *taps_re; /* Direct form: reversed real parts, duplicated for the I/Q pairs */
+	float *taps_im; /* Direct form: reversed imaginary parts as (-im, im) pairs, NULL for real taps */
+	float *history; /* Last len - 1 input samples, complex or real */
+	float *work;
+	/* Overlap-save */
+	int fft_size;
+	int step; /* New samples per FFT, fft_size - tap_count + 1 */
+	float *spectrum; /* FFT of the taps, scaled by 1 / fft_size */
+	float *twiddles;
+	float *stage_re; /* Twiddles of each FFT stage from span 4 on, as (re, re) and (-im, im) pairs */
+	float *stage_im;
+	int *bit_reverse;
+} fir_filter_t;
+
+/* taps: tap_count real values, or tap_count interleaved re/im pairs. Return NULL on error */
+fir_filter_t *fir_filter_create(const float *taps, int tap_count, int complex_taps);
+void fir_filter_free(fir_filter_t *filter);
+/* count real samples, real taps only */
+void fir_filter_process_real(fir_filter_t *filter, float *samples, int count);
+/* count interleaved I/Q samples */
+void fir_filter_process_complex(fir_filter_t *filter, float *samples, int count);
+
+#endif // FIR_FILTER_H
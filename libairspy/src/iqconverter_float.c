@@ -23,6 +23,7 @@ THE SOFTWARE.
 #include "iqconverter_float.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <stdio.h>
 
@@ -52,9 +53,18 @@ THE SOFTWARE.
 	#endif
 #endif
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define CNV_USE_SSE
+	#include <xmmintrin.h>
+#endif
+
 #define SIZE_FACTOR 2
 #define DEFAULT_ALIGNMENT 16
 #define HPF_COEFF 0.01f
+#define NORM_MAX_GAIN 10000.0f /* +80 dB, keeps an empty block from blowing up the gain */
+#define NORM_DECAY 0.1f /* Fraction of the way toward a higher gain covered per block */
+#define IQ_CORR_ALPHA 0.1f /* Weight of the last block in the IQ correction estimates */
+#define IQ_CORR_MAX_SIN2 0.5f /* Phase error beyond 45 degrees is not trusted */
 
 iqconveter_float_t *iqconverter_float_create(const float *hb_kernel, int len)
 {
@@ -69,6 +79,11 @@ iqconveter_float_t *iqconverter_float_create(const float *hb_kernel, int len)
 	size_t buffer_size;
 	iqconveter_float_t *cnv = (iqconveter_float_t *) _aligned_malloc(sizeof(iqconveter_float_t), DEFAULT_ALIGNMENT);
 
+	if (cnv == NULL)
+	{
+		return NULL;
+	}
+
 	for (i = 0; i < IQCONVERTER_NZEROS + 1; i++)
 	{
 		cnv->x_delay[i] = 0.0f;
@@ -83,6 +98,12 @@ iqconveter_float_t *iqconverter_float_create(const float *hb_kernel, int len)
 	cnv->fir_index = 0;
 	cnv->len = len / 2 + 1;
 
+	iqconverter_float_set_normalization(cnv, 0.0f);
+	iqconverter_float_set_iq_correction(cnv, 0);
+	cnv->mean_i = cnv->mean_q = 0.0f;
+	cnv->rms_i = cnv->rms_q = 0.0f;
+	cnv->peak_i = cnv->peak_q = 0.0f;
+
 #ifdef FIR_USE_SSE2
 
 	original_length = cnv->len;
@@ -102,6 +123,12 @@ iqconveter_float_t *iqconverter_float_create(const float *hb_kernel, int len)
 	cnv->fir_queue = (float *) _aligned_malloc(buffer_size * SIZE_FACTOR, DEFAULT_ALIGNMENT);
 	cnv->delay_line = (float *) _aligned_malloc(buffer_size / 2, DEFAULT_ALIGNMENT);
 
+	if (cnv->fir_kernel == NULL || cnv->fir_queue == NULL || cnv->delay_line == NULL)
+	{
+		iqconverter_float_free(cnv);
+		return NULL;
+	}
+
 	memset(cnv->fir_queue, 0, buffer_size * SIZE_FACTOR);
 	memset(cnv->delay_line, 0, buffer_size / 2);
 
@@ -267,29 +294,364 @@ static void fir_interleaved(iqconveter_float_t *cnv, float *samples, int len)
 	cnv->fir_index = fir_index;
 }
 
+#ifndef FIR_USE_SSE2
+
+/*
+ * Folded FIR fully unrolled for the kernel lengths of the converter profiles, summed in
+ * the same order as FIR_STANDARD so the output does not depend on the specialization.
+ */
+#define FIR_FOLD(n, j) (kernel[j] * (queue[j] + queue[(n) - 1 - (j)]))
+#define FIR_FOLD4(n, j) (FIR_FOLD(n, j) + FIR_FOLD(n, (j) + 1) + FIR_FOLD(n, (j) + 2) + FIR_FOLD(n, (j) + 3))
+
+static _inline float fir_folded_8(const float *kernel, const float *queue)
+{
+	return FIR_FOLD4(8, 0);
+}
+
+static _inline float fir_folded_16(const float *kernel, const float *queue)
+{
+	return FIR_FOLD4(16, 0) + FIR_FOLD4(16, 4);
+}
+
+static _inline float fir_folded_24(const float *kernel, const float *queue)
+{
+	return FIR_FOLD4(24, 0) + FIR_FOLD4(24, 4) + FIR_FOLD4(24, 8);
+}
+
+static _inline float fir_folded_48(const float *kernel, const float *queue)
+{
+	return FIR_FOLD4(48, 0) + FIR_FOLD4(48, 4) + FIR_FOLD4(48, 8)
+		+ FIR_FOLD4(48, 12) + FIR_FOLD4(48, 16) + FIR_FOLD4(48, 20);
+}
+
+/* fir_interleaved() for a kernel of n taps */
+#define FIR_INTERLEAVED_FIXED(n) \
+static void fir_interleaved_##n(iqconveter_float_t *cnv, float *samples, int len) \
+{ \
+	int i; \
+	int fir_index; \
+	float *queue; \
+ \
+	fir_index = cnv->fir_index; \
+ \
+	for (i = 0; i < len; i += 2) \
+	{ \
+		queue = cnv->fir_queue + fir_index; \
+		queue[0] = samples[i]; \
+		samples[i] = fir_folded_##n(cnv->fir_kernel, queue); \
+ \
+		if (--fir_index < 0) \
+		{ \
+			fir_index = (n) * (SIZE_FACTOR - 1); \
+			memcpy(cnv->fir_queue + fir_index + 1, cnv->fir_queue, ((n) - 1) * sizeof(float)); \
+		} \
+	} \
+ \
+	cnv->fir_index = fir_index; \
+}
+
+FIR_INTERLEAVED_FIXED(8)
+FIR_INTERLEAVED_FIXED(16)
+FIR_INTERLEAVED_FIXED(24)
+FIR_INTERLEAVED_FIXED(48)
+
+#endif
+
+/* Block statistics from the sums over n IQ pairs */
+static void set_stats(iqconveter_float_t *cnv, float sum_i, float sum_q, float sum_ii, float sum_qq,
+	float peak_i, float peak_q, int n)
+{
+	if (n == 0)
+	{
+		return;
+	}
+
+	cnv->mean_i = sum_i / n;
+	cnv->mean_q = sum_q / n;
+	cnv->rms_i = sqrtf(sum_ii / n);
+	cnv->rms_q = sqrtf(sum_qq / n);
+	cnv->peak_i = peak_i;
+	cnv->peak_q = peak_q;
+}
+
+/*
+ * Delay of the Q samples by half the kernel, the I samples being final after the FIR.
+ * The block statistics are gathered on the same pass.
+ */
 static void delay_interleaved(iqconveter_float_t *cnv, float *samples, int len)
 {
 	int i;
 	int index;
 	int half_len;
-	float res;
-	
+	float x_i, x_q;
+	float sum_i, sum_q, sum_ii, sum_qq, peak_i, peak_q;
+
+#ifdef CNV_USE_SSE
+
+	/* Two IQ pairs per vector */
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 acc = _mm_setzero_ps();
+	__m128 acc_sq = _mm_setzero_ps();
+	__m128 max = _mm_setzero_ps();
+	__m128 v, d, x;
+	float tmp[4];
+
+#endif
+
 	half_len = cnv->len >> 1;
 	index = cnv->delay_index;
+	sum_i = sum_q = sum_ii = sum_qq = peak_i = peak_q = 0.0f;
 
-	for (i = 0; i < len; i += 2)
+	for (i = 0; i < len; )
 	{
-		res = cnv->delay_line[index];
-		cnv->delay_line[index] = samples[i];
-		samples[i] = res;
+#ifdef CNV_USE_SSE
+
+		if (i + 4 <= len && index + 2 <= half_len)
+		{
+			v = _mm_loadu_ps(samples + i);
+			d = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (cnv->delay_line + index));
+			_mm_storel_pi((__m64 *) (cnv->delay_line + index), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 3, 1)));
+			x = _mm_unpacklo_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 0, 2, 0)), d);
+			_mm_storeu_ps(samples + i, x);
+
+			acc = _mm_add_ps(acc, x);
+			acc_sq = _mm_add_ps(acc_sq, _mm_mul_ps(x, x));
+			max = _mm_max_ps(max, _mm_andnot_ps(sign, x));
+
+			if ((index += 2) >= half_len)
+			{
+				index = 0;
+			}
+
+			i += 4;
+			continue;
+		}
+
+#endif
+
+		/* Tail, or a pair where the delay line wraps */
+		x_i = samples[i];
+		x_q = cnv->delay_line[index];
+		cnv->delay_line[index] = samples[i + 1];
+		samples[i + 1] = x_q;
+
+		sum_i += x_i;
+		sum_q += x_q;
+		sum_ii += x_i * x_i;
+		sum_qq += x_q * x_q;
+		peak_i = fabsf(x_i) > peak_i ? fabsf(x_i) : peak_i;
+		peak_q = fabsf(x_q) > peak_q ? fabsf(x_q) : peak_q;
+
+		if (++index >= half_len)
+		{
+			index = 0;
+		}
+
+		i += 2;
+	}
+
+	cnv->delay_index = index;
+
+#ifdef CNV_USE_SSE
+
+	_mm_storeu_ps(tmp, acc);
+	sum_i += tmp[0] + tmp[2];
+	sum_q += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, acc_sq);
+	sum_ii += tmp[0] + tmp[2];
+	sum_qq += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, max);
+	tmp[0] = tmp[2] > tmp[0] ? tmp[2] : tmp[0];
+	tmp[1] = tmp[3] > tmp[1] ? tmp[3] : tmp[1];
+	peak_i = tmp[0] > peak_i ? tmp[0] : peak_i;
+	peak_q = tmp[1] > peak_q ? tmp[1] : peak_q;
+
+#endif
+
+	set_stats(cnv, sum_i, sum_q, sum_ii, sum_qq, peak_i, peak_q, len / 2);
+}
+
+/*
+ * delay_interleaved() on the Q samples fused with the IQ correction: DC removal then
+ * Q = c1 * I + c2 * Q, which equalizes the I and Q powers and makes them orthogonal.
+ * The statistics of the block are gathered on the same pass and folded into the
+ * running estimates the coefficients of the next block are computed from, along
+ * with those of the corrected output.
+ */
+static void delay_correct_interleaved(iqconveter_float_t *cnv, float *samples, int len)
+{
+	int i;
+	int index;
+	int half_len;
+	int n;
+	float dc_i, dc_q, c1, c2;
+	float x_i, x_q;
+	float sum_i, sum_q, sum_ii, sum_qq, sum_iq;
+	float out_i, out_q, out_ii, out_qq, peak_i, peak_q;
+	float m_i, m_q, sin2, a;
+
+#ifdef CNV_USE_SSE
+
+	/* Two IQ pairs per vector */
+	__m128 dc = _mm_setr_ps(cnv->dc_i, cnv->dc_q, cnv->dc_i, cnv->dc_q);
+	__m128 m1 = _mm_setr_ps(1.0f, cnv->corr_c2, 1.0f, cnv->corr_c2);
+	__m128 m2 = _mm_setr_ps(0.0f, cnv->corr_c1, 0.0f, cnv->corr_c1);
+	__m128 sign = _mm_set1_ps(-0.0f);
+	__m128 acc = _mm_setzero_ps();
+	__m128 acc_sq = _mm_setzero_ps();
+	__m128 acc_x = _mm_setzero_ps();
+	__m128 out = _mm_setzero_ps();
+	__m128 out_sq = _mm_setzero_ps();
+	__m128 max = _mm_setzero_ps();
+	__m128 v, d, x;
+	float tmp[4];
+
+#endif
+
+	half_len = cnv->len >> 1;
+	index = cnv->delay_index;
+	dc_i = cnv->dc_i;
+	dc_q = cnv->dc_q;
+	c1 = cnv->corr_c1;
+	c2 = cnv->corr_c2;
+	sum_i = sum_q = sum_ii = sum_qq = sum_iq = 0.0f;
+	out_i = out_q = out_ii = out_qq = peak_i = peak_q = 0.0f;
+
+	for (i = 0; i < len; )
+	{
+#ifdef CNV_USE_SSE
+
+		if (i + 4 <= len && index + 2 <= half_len)
+		{
+			v = _mm_loadu_ps(samples + i);
+			d = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (cnv->delay_line + index));
+			_mm_storel_pi((__m64 *) (cnv->delay_line + index), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 3, 1)));
+			x = _mm_sub_ps(_mm_unpacklo_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 0, 2, 0)), d), dc);
+
+			acc = _mm_add_ps(acc, x);
+			acc_sq = _mm_add_ps(acc_sq, _mm_mul_ps(x, x));
+			acc_x = _mm_add_ps(acc_x, _mm_mul_ps(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1))));
+
+			x = _mm_add_ps(_mm_mul_ps(x, m1), _mm_mul_ps(_mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 0, 0)), m2));
+			_mm_storeu_ps(samples + i, x);
+
+			out = _mm_add_ps(out, x);
+			out_sq = _mm_add_ps(out_sq, _mm_mul_ps(x, x));
+			max = _mm_max_ps(max, _mm_andnot_ps(sign, x));
+
+			if ((index += 2) >= half_len)
+			{
+				index = 0;
+			}
+
+			i += 4;
+			continue;
+		}
+
+#endif
+
+		/* Tail, or a pair where the delay line wraps */
+		x_i = samples[i] - dc_i;
+		x_q = cnv->delay_line[index] - dc_q;
+		cnv->delay_line[index] = samples[i + 1];
+
+		sum_i += x_i;
+		sum_q += x_q;
+		sum_ii += x_i * x_i;
+		sum_qq += x_q * x_q;
+		sum_iq += x_i * x_q;
+
+		samples[i] = x_i;
+		samples[i + 1] = c1 * x_i + c2 * x_q;
+
+		x_q = samples[i + 1];
+		out_i += x_i;
+		out_q += x_q;
+		out_ii += x_i * x_i;
+		out_qq += x_q * x_q;
+		peak_i = fabsf(x_i) > peak_i ? fabsf(x_i) : peak_i;
+		peak_q = fabsf(x_q) > peak_q ? fabsf(x_q) : peak_q;
 
 		if (++index >= half_len)
 		{
 			index = 0;
 		}
+
+		i += 2;
 	}
-	
+
 	cnv->delay_index = index;
+
+#ifdef CNV_USE_SSE
+
+	_mm_storeu_ps(tmp, acc);
+	sum_i += tmp[0] + tmp[2];
+	sum_q += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, acc_sq);
+	sum_ii += tmp[0] + tmp[2];
+	sum_qq += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, acc_x);
+	sum_iq += tmp[0] + tmp[2];
+	_mm_storeu_ps(tmp, out);
+	out_i += tmp[0] + tmp[2];
+	out_q += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, out_sq);
+	out_ii += tmp[0] + tmp[2];
+	out_qq += tmp[1] + tmp[3];
+	_mm_storeu_ps(tmp, max);
+	tmp[0] = tmp[2] > tmp[0] ? tmp[2] : tmp[0];
+	tmp[1] = tmp[3] > tmp[1] ? tmp[3] : tmp[1];
+	peak_i = tmp[0] > peak_i ? tmp[0] : peak_i;
+	peak_q = tmp[1] > peak_q ? tmp[1] : peak_q;
+
+#endif
+
+	set_stats(cnv, out_i, out_q, out_ii, out_qq, peak_i, peak_q, len / 2);
+
+	n = len / 2;
+	if (n == 0)
+	{
+		return;
+	}
+
+	/* Residual mean and centered moments of the block */
+	m_i = sum_i / n;
+	m_q = sum_q / n;
+	sum_ii = sum_ii / n - m_i * m_i;
+	sum_qq = sum_qq / n - m_q * m_q;
+	sum_iq = sum_iq / n - m_i * m_q;
+
+	cnv->dc_i += m_i * IQ_CORR_ALPHA;
+	cnv->dc_q += m_q * IQ_CORR_ALPHA;
+
+	if (cnv->est_ii == 0.0f)
+	{
+		cnv->est_ii = sum_ii;
+		cnv->est_qq = sum_qq;
+		cnv->est_iq = sum_iq;
+	}
+	else
+	{
+		cnv->est_ii += (sum_ii - cnv->est_ii) * IQ_CORR_ALPHA;
+		cnv->est_qq += (sum_qq - cnv->est_qq) * IQ_CORR_ALPHA;
+		cnv->est_iq += (sum_iq - cnv->est_iq) * IQ_CORR_ALPHA;
+	}
+
+	if (cnv->est_ii <= 0.0f || cnv->est_qq <= 0.0f)
+	{
+		return;
+	}
+
+	/* Q scaled by a = |I| / |Q|, then its projection on I removed: sin = <I, Q> / (|I| |Q|) */
+	a = sqrtf(cnv->est_ii / cnv->est_qq);
+	sin2 = cnv->est_iq * cnv->est_iq / (cnv->est_ii * cnv->est_qq);
+	if (sin2 > IQ_CORR_MAX_SIN2)
+	{
+		return;
+	}
+
+	cnv->corr_c2 = a / sqrtf(1.0f - sin2);
+	cnv->corr_c1 = -cnv->est_iq / cnv->est_ii * cnv->corr_c2;
 }
 
 #define SCALE   (1.0f/1.158384440e+00f)
@@ -322,12 +684,170 @@ static void translate_fs_4(iqconveter_float_t *cnv, float *samples, int len)
 		samples[i + 3] = samples[i + 3] * 0.5f;
 	}
 
+#ifndef FIR_USE_SSE2
+
+	switch (cnv->len)
+	{
+	case 8:
+		fir_interleaved_8(cnv, samples, len);
+		break;
+
+	case 16:
+		fir_interleaved_16(cnv, samples, len);
+		break;
+
+	case 24:
+		fir_interleaved_24(cnv, samples, len);
+		break;
+
+	case 48:
+		fir_interleaved_48(cnv, samples, len);
+		break;
+
+	default:
+		fir_interleaved(cnv, samples, len);
+		break;
+	}
+
+#else
+
 	fir_interleaved(cnv, samples, len);
-	delay_interleaved(cnv, samples + 1, len);
+
+#endif
+
+	if (cnv->iq_correct)
+	{
+		delay_correct_interleaved(cnv, samples, len);
+	}
+	else
+	{
+		delay_interleaved(cnv, samples, len);
+	}
+}
+
+/*
+ * Scale the IQ block in place with the gain ramping from norm_gain to norm_next,
+ * measuring its level on the same pass. The gain for the following block is
+ * derived from that level: lowered at once, raised by NORM_DECAY per block.
+ */
+static void normalize(iqconveter_float_t *cnv, float *samples, int len)
+{
+	int i;
+	float gain;
+	float step;
+	float sum;
+	float peak;
+	float x;
+	float rms;
+	float target;
+
+	gain = cnv->norm_gain;
+	step = (cnv->norm_next - gain) / (float) (len / 2);
+	sum = 0.0f;
+	peak = 0.0f;
+	i = 0;
+
+#ifdef CNV_USE_SSE
+
+	{
+		/* Two IQ pairs per vector, I and Q share the gain */
+		__m128 g = _mm_setr_ps(gain, gain, gain + step, gain + step);
+		__m128 g_step = _mm_set1_ps(2.0f * step);
+		__m128 acc = _mm_setzero_ps();
+		__m128 max = _mm_setzero_ps();
+		__m128 v;
+		float tmp[4];
+
+		for (; i + 4 <= len; i += 4)
+		{
+			v = _mm_loadu_ps(samples + i);
+			acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+			max = _mm_max_ps(max, _mm_max_ps(v, _mm_sub_ps(_mm_setzero_ps(), v)));
+			_mm_storeu_ps(samples + i, _mm_mul_ps(v, g));
+			g = _mm_add_ps(g, g_step);
+		}
+
+		_mm_storeu_ps(tmp, acc);
+		sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+		_mm_storeu_ps(tmp, max);
+		peak = tmp[0];
+		peak = tmp[1] > peak ? tmp[1] : peak;
+		peak = tmp[2] > peak ? tmp[2] : peak;
+		peak = tmp[3] > peak ? tmp[3] : peak;
+		gain += step * (float) (i / 2);
+	}
+
+#endif
+
+	for (; i < len; i += 2)
+	{
+		x = samples[i];
+		sum += x * x;
+		peak = fabsf(x) > peak ? fabsf(x) : peak;
+		samples[i] = x * gain;
+
+		x = samples[i + 1];
+		sum += x * x;
+		peak = fabsf(x) > peak ? fabsf(x) : peak;
+		samples[i + 1] = x * gain;
+
+		gain += step;
+	}
+
+	rms = sqrtf(sum / (float) len);
+	cnv->norm_rms = rms;
+	cnv->norm_peak = peak;
+	cnv->norm_gain = cnv->norm_next;
+
+	/* Target level, without pushing the peak of the block past full scale */
+	target = NORM_MAX_GAIN;
+	if (rms * target > cnv->norm_target)
+	{
+		target = cnv->norm_target / rms;
+	}
+	if (peak * target > 1.0f)
+	{
+		target = 1.0f / peak;
+	}
+
+	if (target < cnv->norm_next)
+	{
+		cnv->norm_next = target;
+	}
+	else
+	{
+		cnv->norm_next += (target - cnv->norm_next) * NORM_DECAY;
+	}
+}
+
+void iqconverter_float_set_normalization(iqconveter_float_t *cnv, float target_rms)
+{
+	cnv->norm_target = target_rms;
+	cnv->norm_gain = 1.0f;
+	cnv->norm_next = 1.0f;
+	cnv->norm_rms = 0.0f;
+	cnv->norm_peak = 0.0f;
+}
+
+void iqconverter_float_set_iq_correction(iqconveter_float_t *cnv, int enable)
+{
+	cnv->iq_correct = enable;
+	cnv->dc_i = 0.0f;
+	cnv->dc_q = 0.0f;
+	cnv->est_ii = 0.0f;
+	cnv->est_qq = 0.0f;
+	cnv->est_iq = 0.0f;
+	cnv->corr_c1 = 0.0f;
+	cnv->corr_c2 = 1.0f;
 }
 
 void iqconverter_float_process(iqconveter_float_t *cnv, float *samples, int len)
 {
 	apply_bpf(cnv, samples, len);
 	translate_fs_4(cnv, samples, len);
+
+	if (cnv->norm_target > 0.0f && len > 0)
+	{
+		normalize(cnv, samples, len);
+	}
 }
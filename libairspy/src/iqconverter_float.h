@@ -37,10 +37,33 @@ typedef struct {
 	float *fir_kernel;
 	float *fir_queue;
 	float *delay_line;
+	float norm_target; /* Output RMS of the normalization, 0 when off */
+	float norm_gain; /* Gain applied at the end of the last block */
+	float norm_next; /* Gain reached at the end of the next block */
+	float norm_rms; /* RMS and peak of the last block before normalization */
+	float norm_peak;
+	int iq_correct; /* IQ imbalance and DC correction on */
+	float dc_i; /* Running DC estimate */
+	float dc_q;
+	float est_ii; /* Running second moments of the IQ without DC */
+	float est_qq;
+	float est_iq;
+	float corr_c1; /* Q = c1 * I + c2 * Q */
+	float corr_c2;
+	float mean_i; /* Mean, RMS and peak of I and Q of the last block, before normalization */
+	float mean_q;
+	float rms_i;
+	float rms_q;
+	float peak_i;
+	float peak_q;
 } iqconveter_float_t;
 
 iqconveter_float_t *iqconverter_float_create(const float *hb_kernel, int len);
 void iqconverter_float_free(iqconveter_float_t *cnv);
 void iqconverter_float_process(iqconveter_float_t *cnv, float *samples, int len);
+/* target_rms 0 disables the normalization and resets its gain to 1 */
+void iqconverter_float_set_normalization(iqconveter_float_t *cnv, float target_rms);
+/* Enabling or disabling restarts the estimation */
+void iqconverter_float_set_iq_correction(iqconveter_float_t *cnv, int enable);
 
 #endif // IQCONVERTER_FLOAT_H
\ No newline at end of file
@@ -23,6 +23,7 @@ THE SOFTWARE.
 #include "iqconverter_int16.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #if defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR)
   #include <malloc.h>
@@ -41,8 +42,14 @@ THE SOFTWARE.
   #define _inline inline
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CNV_USE_SSE2
+	#include <emmintrin.h>
+#endif
+
 #define SIZE_FACTOR 2
 #define DEFAULT_ALIGNMENT 16
+#define STATS_FLUSH 16384 /* Vectors summed in 32 bit before the sums overflow */
 
 iqconveter_int16_t *iqconverter_int16_create(const int16_t *hb_kernel, int len)
 {
@@ -50,11 +57,20 @@ iqconveter_int16_t *iqconverter_int16_create(const int16_t *hb_kernel, int len)
 	size_t buffer_size;
 	iqconveter_int16_t *cnv = (iqconveter_int16_t *) _aligned_malloc(sizeof(iqconveter_int16_t), DEFAULT_ALIGNMENT);
 
+	if (cnv == NULL)
+	{
+		return NULL;
+	}
+
 	cnv->old_x = 0;
 	cnv->old_y = 0;
+	cnv->old_e = 0;
 	cnv->delay_index = 0;
 	cnv->fir_index = 0;
 	cnv->len = len / 2 + 1;
+	cnv->mean_i = cnv->mean_q = 0.0f;
+	cnv->rms_i = cnv->rms_q = 0.0f;
+	cnv->peak_i = cnv->peak_q = 0.0f;
 
 	buffer_size = cnv->len * sizeof(int32_t);
 
@@ -62,6 +78,15 @@ iqconveter_int16_t *iqconverter_int16_create(const int16_t *hb_kernel, int len)
 	cnv->fir_queue = (int32_t *) _aligned_malloc(buffer_size * SIZE_FACTOR, DEFAULT_ALIGNMENT);
 	cnv->delay_line = (int16_t *) _aligned_malloc(buffer_size / 4, DEFAULT_ALIGNMENT);
 
+	if (cnv->fir_kernel == NULL || cnv->fir_queue == NULL || cnv->delay_line == NULL)
+	{
+		iqconverter_int16_free(cnv);
+		return NULL;
+	}
+
+	memset(cnv->fir_queue, 0, buffer_size * SIZE_FACTOR);
+	memset(cnv->delay_line, 0, buffer_size / 4);
+
 	for (i = 0; i < cnv->len; i++)
 	{
 		cnv->fir_kernel[i] = hb_kernel[i * 2];
@@ -116,29 +141,216 @@ static void fir_interleaved(iqconveter_int16_t *cnv, int16_t *samples, int len)
 	cnv->fir_index = fir_index;
 }
 
+/* FIR fully unrolled for the kernel lengths of the converter profiles */
+#define FIR_MAC(j) (kernel[j] * queue[j])
+#define FIR_MAC4(j) (FIR_MAC(j) + FIR_MAC((j) + 1) + FIR_MAC((j) + 2) + FIR_MAC((j) + 3))
+
+static _inline int32_t fir_8(const int32_t *kernel, const int32_t *queue)
+{
+	return FIR_MAC4(0) + FIR_MAC4(4);
+}
+
+static _inline int32_t fir_16(const int32_t *kernel, const int32_t *queue)
+{
+	return FIR_MAC4(0) + FIR_MAC4(4) + FIR_MAC4(8) + FIR_MAC4(12);
+}
+
+static _inline int32_t fir_24(const int32_t *kernel, const int32_t *queue)
+{
+	return FIR_MAC4(0) + FIR_MAC4(4) + FIR_MAC4(8) + FIR_MAC4(12) + FIR_MAC4(16) + FIR_MAC4(20);
+}
+
+static _inline int32_t fir_48(const int32_t *kernel, const int32_t *queue)
+{
+	return FIR_MAC4(0) + FIR_MAC4(4) + FIR_MAC4(8) + FIR_MAC4(12) + FIR_MAC4(16) + FIR_MAC4(20)
+		+ FIR_MAC4(24) + FIR_MAC4(28) + FIR_MAC4(32) + FIR_MAC4(36) + FIR_MAC4(40) + FIR_MAC4(44);
+}
+
+/* fir_interleaved() for a kernel of n taps */
+#define FIR_INTERLEAVED_FIXED(n) \
+static void fir_interleaved_##n(iqconveter_int16_t *cnv, int16_t *samples, int len) \
+{ \
+	int i; \
+	int fir_index; \
+	int32_t *queue; \
+	int32_t acc; \
+ \
+	fir_index = cnv->fir_index; \
+ \
+	for (i = 0; i < len; i += 2) \
+	{ \
+		queue = cnv->fir_queue + fir_index; \
+		queue[0] = samples[i]; \
+		acc = fir_##n(cnv->fir_kernel, queue); \
+ \
+		if (--fir_index < 0) \
+		{ \
+			fir_index = (n) * (SIZE_FACTOR - 1); \
+			memcpy(cnv->fir_queue + fir_index + 1, cnv->fir_queue, ((n) - 1) * sizeof(int32_t)); \
+		} \
+ \
+		samples[i] = acc >> 15; \
+	} \
+ \
+	cnv->fir_index = fir_index; \
+}
+
+FIR_INTERLEAVED_FIXED(8)
+FIR_INTERLEAVED_FIXED(16)
+FIR_INTERLEAVED_FIXED(24)
+FIR_INTERLEAVED_FIXED(48)
+
+/*
+ * Delay of the Q samples by half the kernel, the I samples being final after the FIR.
+ * The block statistics are gathered on the same pass.
+ */
 static void delay_interleaved(iqconveter_int16_t *cnv, int16_t *samples, int len)
 {
 	int i;
 	int index;
 	int half_len;
-	int16_t res;
-	
+	int n;
+	int32_t x_i, x_q;
+	int64_t sum_i, sum_q, sum_ii, sum_qq;
+	int32_t peak_i, peak_q;
+
+#ifdef CNV_USE_SSE2
+
+	/* Four IQ pairs per vector, I in the low half of each 32 bit lane */
+	__m128i mask_i = _mm_set1_epi32(0xFFFF);
+	__m128i acc_i = _mm_setzero_si128();
+	__m128i acc_q = _mm_setzero_si128();
+	__m128i sq_i = _mm_setzero_si128();
+	__m128i sq_q = _mm_setzero_si128();
+	__m128i max = _mm_set1_epi16(-32768);
+	__m128i min = _mm_set1_epi16(32767);
+	__m128i v, d, x, s;
+	int32_t tmp32[4];
+	int64_t tmp64[2];
+	int16_t tmp16[8];
+	int count;
+
+	count = 0;
+
+#endif
+
 	half_len = cnv->len >> 1;
 	index = cnv->delay_index;
+	sum_i = sum_q = sum_ii = sum_qq = 0;
+	peak_i = peak_q = 0;
 
-	for (i = 0; i < len; i += 2)
+	for (i = 0; i < len; )
 	{
-		res = cnv->delay_line[index];
-		cnv->delay_line[index] = samples[i];
-		samples[i] = res;
+#ifdef CNV_USE_SSE2
+
+		if (i + 8 <= len && index + 4 <= half_len)
+		{
+			v = _mm_loadu_si128((const __m128i *) (samples + i));
+			d = _mm_loadl_epi64((const __m128i *) (cnv->delay_line + index));
+			s = _mm_srai_epi32(v, 16);
+			_mm_storel_epi64((__m128i *) (cnv->delay_line + index), _mm_packs_epi32(s, s));
+			x = _mm_or_si128(_mm_and_si128(v, mask_i), _mm_slli_epi32(_mm_unpacklo_epi16(d, d), 16));
+			_mm_storeu_si128((__m128i *) (samples + i), x);
+
+			acc_i = _mm_add_epi32(acc_i, _mm_srai_epi32(_mm_slli_epi32(x, 16), 16));
+			acc_q = _mm_add_epi32(acc_q, _mm_srai_epi32(x, 16));
+			s = _mm_madd_epi16(_mm_and_si128(x, mask_i), x);
+			sq_i = _mm_add_epi64(sq_i, _mm_add_epi64(_mm_unpacklo_epi32(s, _mm_setzero_si128()),
+				_mm_unpackhi_epi32(s, _mm_setzero_si128())));
+			s = _mm_madd_epi16(_mm_andnot_si128(mask_i, x), x);
+			sq_q = _mm_add_epi64(sq_q, _mm_add_epi64(_mm_unpacklo_epi32(s, _mm_setzero_si128()),
+				_mm_unpackhi_epi32(s, _mm_setzero_si128())));
+			max = _mm_max_epi16(max, x);
+			min = _mm_min_epi16(min, x);
+
+			if (++count == STATS_FLUSH)
+			{
+				_mm_storeu_si128((__m128i *) tmp32, acc_i);
+				sum_i += (int64_t) tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+				_mm_storeu_si128((__m128i *) tmp32, acc_q);
+				sum_q += (int64_t) tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+				acc_i = _mm_setzero_si128();
+				acc_q = _mm_setzero_si128();
+				count = 0;
+			}
+
+			if ((index += 4) >= half_len)
+			{
+				index = 0;
+			}
+
+			i += 8;
+			continue;
+		}
+
+#endif
+
+		/* Tail, or pairs where the delay line wraps */
+		x_i = samples[i];
+		x_q = cnv->delay_line[index];
+		cnv->delay_line[index] = samples[i + 1];
+		samples[i + 1] = (int16_t) x_q;
+
+		sum_i += x_i;
+		sum_q += x_q;
+		sum_ii += x_i * x_i;
+		sum_qq += x_q * x_q;
+		peak_i = abs(x_i) > peak_i ? abs(x_i) : peak_i;
+		peak_q = abs(x_q) > peak_q ? abs(x_q) : peak_q;
 
 		if (++index >= half_len)
 		{
 			index = 0;
 		}
+
+		i += 2;
 	}
-	
+
 	cnv->delay_index = index;
+
+#ifdef CNV_USE_SSE2
+
+	_mm_storeu_si128((__m128i *) tmp32, acc_i);
+	sum_i += (int64_t) tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+	_mm_storeu_si128((__m128i *) tmp32, acc_q);
+	sum_q += (int64_t) tmp32[0] + tmp32[1] + tmp32[2] + tmp32[3];
+	_mm_storeu_si128((__m128i *) tmp64, sq_i);
+	sum_ii += tmp64[0] + tmp64[1];
+	_mm_storeu_si128((__m128i *) tmp64, sq_q);
+	sum_qq += tmp64[0] + tmp64[1];
+
+	/* Even lanes I, odd lanes Q */
+	_mm_storeu_si128((__m128i *) tmp16, max);
+	for (n = 0; n < 8; n++)
+	{
+		if (n & 1)
+			peak_q = tmp16[n] > peak_q ? tmp16[n] : peak_q;
+		else
+			peak_i = tmp16[n] > peak_i ? tmp16[n] : peak_i;
+	}
+	_mm_storeu_si128((__m128i *) tmp16, min);
+	for (n = 0; n < 8; n++)
+	{
+		if (n & 1)
+			peak_q = -tmp16[n] > peak_q ? -tmp16[n] : peak_q;
+		else
+			peak_i = -tmp16[n] > peak_i ? -tmp16[n] : peak_i;
+	}
+
+#endif
+
+	n = len / 2;
+	if (n == 0)
+	{
+		return;
+	}
+
+	cnv->mean_i = (float) sum_i / (32768.0f * n);
+	cnv->mean_q = (float) sum_q / (32768.0f * n);
+	cnv->rms_i = sqrtf((float) sum_ii / n) / 32768.0f;
+	cnv->rms_q = sqrtf((float) sum_qq / n) / 32768.0f;
+	cnv->peak_i = peak_i / 32768.0f;
+	cnv->peak_q = peak_q / 32768.0f;
 }
 
 static void remove_dc(iqconveter_int16_t *cnv, int16_t *samples, int len)
@@ -181,8 +393,30 @@ static void translate_fs_4(iqconveter_int16_t *cnv, int16_t *samples, int len)
 		samples[i + 3] = samples[i + 3] >> 1;
 	}
 
-	fir_interleaved(cnv, samples, len);
-	delay_interleaved(cnv, samples + 1, len);
+	switch (cnv->len)
+	{
+	case 8:
+		fir_interleaved_8(cnv, samples, len);
+		break;
+
+	case 16:
+		fir_interleaved_16(cnv, samples, len);
+		break;
+
+	case 24:
+		fir_interleaved_24(cnv, samples, len);
+		break;
+
+	case 48:
+		fir_interleaved_48(cnv, samples, len);
+		break;
+
+	default:
+		fir_interleaved(cnv, samples, len);
+		break;
+	}
+
+	delay_interleaved(cnv, samples, len);
 }
 
 void iqconverter_int16_process(iqconveter_int16_t *cnv, int16_t *samples, int len)
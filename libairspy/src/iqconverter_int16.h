@@ -35,6 +35,12 @@ typedef struct {
 	int32_t *fir_kernel;
 	int32_t *fir_queue;
 	int16_t *delay_line;
+	float mean_i; /* Mean, RMS and peak of I and Q of the last block, 1.0 is full scale */
+	float mean_q;
+	float rms_i;
+	float rms_q;
+	float peak_i;
+	float peak_q;
 } iqconveter_int16_t;
 
 iqconveter_int16_t *iqconverter_int16_create(const int16_t *hb_kernel, int len);
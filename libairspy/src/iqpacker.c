@@ -0,0 +1,190 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "iqpacker.h"
+#include "airspy.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IQPACKER_SSE2
+#endif
+
+#define INT12_MIN (-2048)
+#define INT12_MAX (2047)
+#define INT8_BFP_MAX (127)
+
+static int16_t to_int12(int16_t x)
+{
+	int32_t y;
+
+	/* Round to nearest, +8 may step just past the 12bit range */
+	y = ((int32_t) x + 8) >> 4;
+	return (int16_t) (y > INT12_MAX ? INT12_MAX : y);
+}
+
+void iqpacker_int12(const int16_t *src, uint8_t *dest, int count)
+{
+	int i;
+	uint16_t re;
+	uint16_t im;
+
+	// Plain byte arithmetic, auto vectorized by GCC and VS2013 with optimizations
+	for (i = 0; i < count; i++)
+	{
+		re = (uint16_t) to_int12(src[2 * i]) & 0xFFF;
+		im = (uint16_t) to_int12(src[2 * i + 1]) & 0xFFF;
+		dest[3 * i + 0] = (uint8_t) re;
+		dest[3 * i + 1] = (uint8_t) ((re >> 8) | (im << 4));
+		dest[3 * i + 2] = (uint8_t) (im >> 4);
+	}
+}
+
+/* Smallest right shift bringing the peak magnitude within int8 */
+static int bfp_exponent(int32_t max, int32_t min)
+{
+	int32_t peak;
+	int exponent;
+
+	peak = (max > -min) ? max : -min;
+	exponent = 0;
+	while ((peak >> exponent) > INT8_BFP_MAX)
+	{
+		exponent++;
+	}
+	return exponent;
+}
+
+#ifdef IQPACKER_SSE2
+
+static void bfp_block(const int16_t *src, uint8_t *dest, int len)
+{
+	__m128i vmax;
+	__m128i vmin;
+	__m128i x0;
+	__m128i x1;
+	__m128i bias;
+	__m128i shift;
+	int16_t lanes[8];
+	int32_t max;
+	int32_t min;
+	int exponent;
+	int i;
+	int n;
+
+	n = len & ~15;
+
+	vmax = _mm_set1_epi16(-32768);
+	vmin = _mm_set1_epi16(32767);
+	for (i = 0; i < n; i += 8)
+	{
+		x0 = _mm_loadu_si128((const __m128i *) (src + i));
+		vmax = _mm_max_epi16(vmax, x0);
+		vmin = _mm_min_epi16(vmin, x0);
+	}
+
+	_mm_storeu_si128((__m128i *) lanes, vmax);
+	max = lanes[0];
+	for (i = 1; i < 8; i++)
+		max = lanes[i] > max ? lanes[i] : max;
+	_mm_storeu_si128((__m128i *) lanes, vmin);
+	min = lanes[0];
+	for (i = 1; i < 8; i++)
+		min = lanes[i] < min ? lanes[i] : min;
+	for (i = n; i < len; i++)
+	{
+		max = src[i] > max ? src[i] : max;
+		min = src[i] < min ? src[i] : min;
+	}
+
+	exponent = bfp_exponent(max, min);
+	dest[0] = (uint8_t) exponent;
+	dest++;
+
+	bias = _mm_set1_epi16(exponent > 0 ? (int16_t) (1 << (exponent - 1)) : 0);
+	shift = _mm_cvtsi32_si128(exponent);
+	for (i = 0; i < n; i += 16)
+	{
+		x0 = _mm_loadu_si128((const __m128i *) (src + i));
+		x1 = _mm_loadu_si128((const __m128i *) (src + i + 8));
+		x0 = _mm_sra_epi16(_mm_adds_epi16(x0, bias), shift);
+		x1 = _mm_sra_epi16(_mm_adds_epi16(x1, bias), shift);
+		_mm_storeu_si128((__m128i *) (dest + i), _mm_packs_epi16(x0, x1));
+	}
+
+	for (i = n; i < len; i++)
+	{
+		x0 = _mm_cvtsi32_si128(src[i]);
+		x0 = _mm_sra_epi16(_mm_adds_epi16(x0, bias), shift);
+		dest[i] = (uint8_t) (int8_t) _mm_cvtsi128_si32(_mm_packs_epi16(x0, x0));
+	}
+}
+
+#else
+
+static void bfp_block(const int16_t *src, uint8_t *dest, int len)
+{
+	int32_t max;
+	int32_t min;
+	int32_t bias;
+	int32_t y;
+	int exponent;
+	int i;
+
+	max = -32768;
+	min = 32767;
+	for (i = 0; i < len; i++)
+	{
+		max = src[i] > max ? src[i] : max;
+		min = src[i] < min ? src[i] : min;
+	}
+
+	exponent = bfp_exponent(max, min);
+	dest[0] = (uint8_t) exponent;
+	dest++;
+
+	bias = exponent > 0 ? (1 << (exponent - 1)) : 0;
+	/* Same saturations as the SSE2 version, the output is bit exact on every platform */
+	for (i = 0; i < len; i++)
+	{
+		y = src[i] + bias;
+		y = (y > 32767 ? 32767 : y) >> exponent;
+		dest[i] = (uint8_t) (int8_t) (y > INT8_BFP_MAX ? INT8_BFP_MAX : y);
+	}
+}
+
+#endif
+
+int iqpacker_int8_bfp(const int16_t *src, uint8_t *dest, int count)
+{
+	int i;
+	int len;
+	int size;
+
+	size = 0;
+	for (i = 0; i < count; i += AIRSPY_INT8_BFP_BLOCK_LEN)
+	{
+		len = (count - i) < AIRSPY_INT8_BFP_BLOCK_LEN ? (count - i) : AIRSPY_INT8_BFP_BLOCK_LEN;
+		bfp_block(src + i * 2, dest + size, len * 2);
+		size += 1 + len * 2;
+	}
+
+	return size;
+}
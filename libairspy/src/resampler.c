@@ -0,0 +1,290 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "resampler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RESAMPLER_SSE
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define CHUNK (4096) /* Input samples per pass */
+#define ATTENUATION (70.0) /* Stopband, dB */
+#define TRANSITION (0.2) /* Transition band width, fraction of the output rate */
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+int resampler_ratio(uint32_t in_rate, uint32_t out_rate, int *up, int *down)
+{
+	uint64_t a = out_rate;
+	uint64_t b = in_rate;
+	uint64_t t, q;
+	uint64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0, p2, q2;
+
+	if (out_rate == 0 || out_rate >= in_rate)
+	{
+		return 0;
+	}
+
+	/* Continued fraction of out_rate / in_rate, exact unless the numerator exceeds RESAMPLER_MAX_PHASES */
+	while (b != 0)
+	{
+		q = a / b;
+		p2 = q * p1 + p0;
+		q2 = q * q1 + q0;
+		if (p2 > RESAMPLER_MAX_PHASES)
+		{
+			break;
+		}
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	if (p1 == 0 || q1 <= p1 || q1 > 0x7FFFFFFF)
+	{
+		return 0;
+	}
+
+	*up = (int) p1;
+	*down = (int) q1;
+	return 1;
+}
+
+resampler_t *resampler_create(int up, int down, int complex_samples)
+{
+	resampler_t *rs;
+	double ratio = (double) up / down;
+	double beta = 0.1102 * (ATTENUATION - 8.7);
+	double fc = 0.5 / down;
+	double center, x, h, sum;
+	float *proto;
+	int n, m, p, k;
+
+	rs = (resampler_t *) calloc(1, sizeof(resampler_t));
+	if (rs == NULL)
+	{
+		return NULL;
+	}
+
+	rs->up = up;
+	rs->down = down;
+	rs->complex_samples = complex_samples;
+	rs->len = (int) ceil((ATTENUATION - 8.0) / (14.36 * TRANSITION * ratio));
+	rs->len = (rs->len + 3) & ~3;
+
+	n = rs->len * up;
+	proto = (float *) malloc(n * sizeof(float));
+	rs->bank = (float *) malloc(n * sizeof(float));
+	rs->bank_iq = (float *) malloc(2 * n * sizeof(float));
+	rs->history = (float *) calloc(2 * (rs->len - 1), sizeof(float));
+	rs->work = (float *) malloc(2 * (rs->len - 1 + CHUNK) * sizeof(float));
+
+	if (proto == NULL || rs->bank == NULL || rs->bank_iq == NULL || rs->history == NULL || rs->work == NULL)
+	{
+		free(proto);
+		resampler_free(rs);
+		return NULL;
+	}
+
+	/* Kaiser windowed sinc at up times the input rate, cut at half the output rate */
+	center = (n - 1) / 2.0;
+	sum = 0.0;
+	for (m = 0; m < n; m++)
+	{
+		x = m - center;
+		h = (x == 0.0) ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x);
+		h *= bessel_i0(beta * sqrt(1.0 - (x / center) * (x / center))) / bessel_i0(beta);
+		proto[m] = (float) h;
+		sum += h;
+	}
+
+	/* Unity gain per phase, taps reversed so that the output is a dot product with the input in memory order */
+	for (p = 0; p < up; p++)
+	{
+		for (k = 0; k < rs->len; k++)
+		{
+			h = proto[p + k * up] * up / sum;
+			m = p * rs->len + rs->len - 1 - k;
+			rs->bank[m] = (float) h;
+			rs->bank_iq[2 * m] = (float) h;
+			rs->bank_iq[2 * m + 1] = (float) h;
+		}
+	}
+
+	free(proto);
+	return rs;
+}
+
+void resampler_free(resampler_t *rs)
+{
+	if (rs == NULL)
+	{
+		return;
+	}
+
+	free(rs->bank);
+	free(rs->bank_iq);
+	free(rs->history);
+	free(rs->work);
+	free(rs);
+}
+
+static void next_output(resampler_t *rs)
+{
+	rs->phase += rs->down;
+	rs->pos += rs->phase / rs->up;
+	rs->phase %= rs->up;
+}
+
+int resampler_process(resampler_t *rs, float *samples, int count)
+{
+	int ch = rs->complex_samples ? 2 : 1;
+	int keep = ch * (rs->len - 1);
+	int taps = ch * rs->len;
+	int out = 0;
+	int r, i;
+	const float *x;
+	const float *h;
+	float *dest = samples;
+	float acc, acc_q;
+
+#ifdef RESAMPLER_SSE
+
+	__m128 v;
+	float tmp[4];
+
+#endif
+
+	while (count > 0)
+	{
+		r = (count < CHUNK) ? count : CHUNK;
+		memcpy(rs->work, rs->history, keep * sizeof(float));
+		memcpy(rs->work + keep, samples, ch * r * sizeof(float));
+
+		while (rs->pos < r)
+		{
+			x = rs->work + ch * rs->pos;
+			h = (ch == 2 ? rs->bank_iq : rs->bank) + taps * rs->phase;
+
+#ifdef RESAMPLER_SSE
+
+			v = _mm_setzero_ps();
+			for (i = 0; i < taps; i += 4)
+			{
+				v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(h + i), _mm_loadu_ps(x + i)));
+			}
+			_mm_storeu_ps(tmp, v);
+			if (ch == 2)
+			{
+				acc = tmp[0] + tmp[2];
+				acc_q = tmp[1] + tmp[3];
+			}
+			else
+			{
+				acc = (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+				acc_q = 0.0f;
+			}
+
+#else
+
+			acc = 0.0f;
+			acc_q = 0.0f;
+			if (ch == 2)
+			{
+				for (i = 0; i < taps; i += 2)
+				{
+					acc += h[i] * x[i];
+					acc_q += h[i + 1] * x[i + 1];
+				}
+			}
+			else
+			{
+				for (i = 0; i < taps; i++)
+				{
+					acc += h[i] * x[i];
+				}
+			}
+
+#endif
+
+			/* Never past the input already copied to work */
+			dest[ch * out] = acc;
+			if (ch == 2)
+			{
+				dest[2 * out + 1] = acc_q;
+			}
+			out++;
+			next_output(rs);
+		}
+
+		memcpy(rs->history, rs->work + ch * r, keep * sizeof(float));
+		rs->pos -= r;
+		samples += ch * r;
+		count -= r;
+	}
+
+	return out;
+}
+
+int resampler_skip(resampler_t *rs, uint64_t count)
+{
+	int skipped = 0;
+	int64_t pos = (int64_t) rs->pos - (int64_t) count;
+
+	/* Outputs that would have been taken within the lost samples */
+	while (pos < 0)
+	{
+		rs->phase += rs->down;
+		pos += rs->phase / rs->up;
+		rs->phase %= rs->up;
+		skipped++;
+	}
+
+	rs->pos = (int) pos;
+	return skipped;
+}
+
+uint64_t resampler_output_index(const resampler_t *rs, uint64_t count)
+{
+	return (count * rs->up + rs->down - 1) / rs->down;
+}
@@ -0,0 +1,59 @@
+/*
+This file is part of AirSpy.
+
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+		Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the 
+		documentation and/or other materials provided with the distribution.
+		Neither the name of AirSpy nor the names of its contributors may be used to endorse or promote products derived from this software
+		without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stdint.h>
+
+/*
+ * Polyphase resampler by up / down, up <= down: output n is taken at input time n * down / up
+ * with the phase (n * down) % up of a Kaiser windowed sinc bank, passband 40% and stopband 60%
+ * of the output rate with about 70dB of rejection.
+ */
+
+#define RESAMPLER_MAX_PHASES (1024)
+
+typedef struct {
+	int up;
+	int down;
+	int complex_samples;
+	int len; /* Taps per phase, multiple of 4 */
+	float *bank; /* up phases of len reversed taps */
+	float *bank_iq; /* Same taps duplicated for the I/Q pairs */
+	float *history; /* Last len - 1 input samples */
+	float *work;
+	int pos; /* Input sample of the next output, from the start of the next block */
+	int phase;
+} resampler_t;
+
+/* Reduce the ratio out_rate / in_rate to up / down, nearest fraction with up <= RESAMPLER_MAX_PHASES. Return 0 if out_rate >= in_rate */
+int resampler_ratio(uint32_t in_rate, uint32_t out_rate, int *up, int *down);
+resampler_t *resampler_create(int up, int down, int complex_samples);
+void resampler_free(resampler_t *rs);
+/* count input samples from samples, the output is written in place. Return the output sample count */
+int resampler_process(resampler_t *rs, float *samples, int count);
+/* Account for count input samples lost before the next block. Return the output samples skipped */
+int resampler_skip(resampler_t *rs, uint64_t count);
+/* Output samples for count input samples, from the start of the stream */
+uint64_t resampler_output_index(const resampler_t *rs, uint64_t count);
+
+#endif // RESAMPLER_H